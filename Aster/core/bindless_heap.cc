@@ -0,0 +1,203 @@
+// =============================================
+//  Aster: bindless_heap.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "bindless_heap.h"
+
+BindlessHeap::BindlessHeap(BindlessHeap&& _other) noexcept: set_layout{ std::exchange(_other.set_layout, nullptr) }
+                                                          , set{ std::exchange(_other.set, nullptr) }
+                                                          , stats{ _other.stats }
+                                                          , device_{ std::exchange(_other.device_, nullptr) }
+                                                          , pool_{ std::exchange(_other.pool_, nullptr) }
+                                                          , free_{ std::move(_other.free_) }
+                                                          , next_{ _other.next_ }
+                                                          , mutex_{ std::move(_other.mutex_) } {}
+
+BindlessHeap& BindlessHeap::operator=(BindlessHeap&& _other) noexcept {
+	if (this == &_other) return *this;
+	std::swap(set_layout, _other.set_layout);
+	std::swap(set, _other.set);
+	std::swap(stats, _other.stats);
+	std::swap(device_, _other.device_);
+	std::swap(pool_, _other.pool_);
+	std::swap(free_, _other.free_);
+	std::swap(next_, _other.next_);
+	std::swap(mutex_, _other.mutex_);
+	return *this;
+}
+
+Res<BindlessHeap> BindlessHeap::create(const vk::Device& _device, const vk::PhysicalDevice& _physical_device, const Capacities& _capacities) {
+	const auto property_chain = _physical_device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+	const auto& limits = property_chain.get<vk::PhysicalDeviceVulkan12Properties>();
+
+	// Every array lives in one set used by every stage, so both the set and the per-stage limits apply.
+	const std::array<u32, kind_count> capacity = {
+		std::min({ _capacities.sampled_images, limits.maxDescriptorSetUpdateAfterBindSampledImages, limits.maxPerStageDescriptorUpdateAfterBindSampledImages }),
+		std::min({ _capacities.storage_images, limits.maxDescriptorSetUpdateAfterBindStorageImages, limits.maxPerStageDescriptorUpdateAfterBindStorageImages }),
+		std::min({ _capacities.samplers, limits.maxDescriptorSetUpdateAfterBindSamplers, limits.maxPerStageDescriptorUpdateAfterBindSamplers }),
+		std::min({ _capacities.storage_buffers, limits.maxDescriptorSetUpdateAfterBindStorageBuffers, limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers }),
+	};
+
+	std::array<vk::DescriptorSetLayoutBinding, kind_count> bindings;
+	std::array<vk::DescriptorBindingFlags, kind_count> binding_flags;
+	std::array<vk::DescriptorPoolSize, kind_count> pool_sizes;
+	for (u32 i_ = 0; i_ < kind_count; ++i_) {
+		bindings[i_] = {
+			.binding = i_,
+			.descriptorType = kind_types[i_],
+			.descriptorCount = capacity[i_],
+			.stageFlags = vk::ShaderStageFlagBits::eAll,
+		};
+		binding_flags[i_] = vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+		pool_sizes[i_] = {
+			.type = kind_types[i_],
+			.descriptorCount = capacity[i_],
+		};
+	}
+
+	vk::DescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {
+		.bindingCount = cast<u32>(binding_flags.size()),
+		.pBindingFlags = binding_flags.data(),
+	};
+	auto [result, set_layout] = _device.createDescriptorSetLayout({
+		.pNext = &binding_flags_info,
+		.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+		.bindingCount = cast<u32>(bindings.size()),
+		.pBindings = bindings.data(),
+	});
+	if (failed(result)) {
+		return Err::make(std::fmt("Bindless set layout creation failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	vk::DescriptorPool pool;
+	tie(result, pool) = _device.createDescriptorPool({
+		.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+		.maxSets = 1,
+		.poolSizeCount = cast<u32>(pool_sizes.size()),
+		.pPoolSizes = pool_sizes.data(),
+	});
+	if (failed(result)) {
+		_device.destroyDescriptorSetLayout(set_layout);
+		return Err::make(std::fmt("Bindless descriptor pool creation failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	std::vector<vk::DescriptorSet> sets;
+	tie(result, sets) = _device.allocateDescriptorSets({
+		.descriptorPool = pool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &set_layout,
+	});
+	if (failed(result)) {
+		_device.destroyDescriptorPool(pool);
+		_device.destroyDescriptorSetLayout(set_layout);
+		return Err::make(std::fmt("Bindless descriptor set allocation failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	BindlessHeap heap;
+	heap.set_layout = set_layout;
+	heap.set = sets.front();
+	heap.stats.capacity = capacity;
+	heap.device_ = _device;
+	heap.pool_ = pool;
+	heap.mutex_ = std::make_unique<std::mutex>();
+	return std::move(heap);
+}
+
+Res<u32> BindlessHeap::register_sampled_image(const vk::ImageView _view, const vk::ImageLayout _layout) {
+	const vk::DescriptorImageInfo image_info = {
+		.imageView = _view,
+		.imageLayout = _layout,
+	};
+	return register_descriptor(Kind::eSampledImage, &image_info, nullptr);
+}
+
+Res<u32> BindlessHeap::register_storage_image(const vk::ImageView _view) {
+	const vk::DescriptorImageInfo image_info = {
+		.imageView = _view,
+		.imageLayout = vk::ImageLayout::eGeneral,
+	};
+	return register_descriptor(Kind::eStorageImage, &image_info, nullptr);
+}
+
+Res<u32> BindlessHeap::register_sampler(const vk::Sampler _sampler) {
+	const vk::DescriptorImageInfo image_info = {
+		.sampler = _sampler,
+	};
+	return register_descriptor(Kind::eSampler, &image_info, nullptr);
+}
+
+Res<u32> BindlessHeap::register_storage_buffer(const vk::DescriptorBufferInfo& _buffer_info) {
+	return register_descriptor(Kind::eStorageBuffer, nullptr, &_buffer_info);
+}
+
+void BindlessHeap::release(const Kind _kind, const u32 _index) {
+	if (_index == invalid_index || !mutex_) return;
+
+	std::lock_guard lock{ *mutex_ };
+	const auto kind = cast<usize>(_kind);
+	if (_index >= next_[kind]) {
+		ERROR(std::fmt("Bindless %s %u was never registered", to_cstr(_kind), _index));
+		return;
+	}
+	if (std::ranges::find(free_[kind], _index) != free_[kind].end()) {
+		ERROR(std::fmt("Bindless %s %u released twice", to_cstr(_kind), _index));
+		return;
+	}
+	free_[kind].push_back(_index);
+	--stats.live[kind];
+}
+
+void BindlessHeap::bind(const vk::CommandBuffer _cmd, const vk::PipelineBindPoint _bind_point, const vk::PipelineLayout _layout) const {
+	_cmd.bindDescriptorSets(_bind_point, _layout, set_index, { set }, {});
+}
+
+Res<u32> BindlessHeap::register_descriptor(const Kind _kind, const vk::DescriptorImageInfo* _image_info, const vk::DescriptorBufferInfo* _buffer_info) {
+	if (!valid()) {
+		return Err::make(std::fmt("Bindless %s registered without a heap" CODE_LOC, to_cstr(_kind)), vk::Result::eErrorFeatureNotPresent);
+	}
+
+	std::lock_guard lock{ *mutex_ };
+	const auto kind = cast<usize>(_kind);
+
+	u32 index;
+	if (!free_[kind].empty()) {
+		index = free_[kind].back();
+		free_[kind].pop_back();
+	} else if (next_[kind] < stats.capacity[kind]) {
+		index = next_[kind]++;
+	} else {
+		return Err::make(std::fmt("Bindless %s array is full at %u" CODE_LOC, to_cstr(_kind), stats.capacity[kind]), vk::Result::eErrorOutOfPoolMemory);
+	}
+	++stats.live[kind];
+
+	device_.updateDescriptorSets({
+		vk::WriteDescriptorSet{
+			.dstSet = set,
+			.dstBinding = cast<u32>(_kind),
+			.dstArrayElement = index,
+			.descriptorCount = 1,
+			.descriptorType = kind_types[kind],
+			.pImageInfo = _image_info,
+			.pBufferInfo = _buffer_info,
+		}
+	}, {});
+	++stats.writes;
+	return index;
+}
+
+void BindlessHeap::destroy() {
+	if (!device_) return;
+
+	// The set goes with its pool.
+	device_.destroyDescriptorPool(pool_);
+	device_.destroyDescriptorSetLayout(set_layout);
+	pool_ = nullptr;
+	set = nullptr;
+	set_layout = nullptr;
+	device_ = nullptr;
+}
+
+BindlessHeap::~BindlessHeap() {
+	destroy();
+}
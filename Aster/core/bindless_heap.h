@@ -0,0 +1,134 @@
+// =============================================
+//  Aster: bindless_heap.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @class BindlessHeap
+ *
+ * @brief One global descriptor set of large resource arrays, indexed by shaders through push constants.
+ *
+ * Sampled images, storage images, samplers and storage buffers each get an array binding created with
+ * UPDATE_AFTER_BIND and PARTIALLY_BOUND, so resources are registered while the set is bound and unused
+ * slots never need a valid descriptor. A registered resource keeps its index until it is released, and
+ * released indices are handed out again. Shaders declare the set at `set_index` (see bindless.hlsli);
+ * pipeline layouts built by the PipelineFactory pick up `set_layout` for it.
+ */
+class BindlessHeap {
+public:
+	// The highest set every device is guaranteed to bind, so it stays clear of per-pipeline sets.
+	static constexpr u32 set_index = 3;
+	static constexpr u32 invalid_index = max_value<u32>;
+
+	enum class Kind : u32 {
+		eSampledImage,
+		eStorageImage,
+		eSampler,
+		eStorageBuffer,
+	};
+
+	static constexpr usize kind_count = 4;
+
+	// Each kind is the array at the binding of its value.
+	static constexpr std::array<vk::DescriptorType, kind_count> kind_types = {
+		vk::DescriptorType::eSampledImage,
+		vk::DescriptorType::eStorageImage,
+		vk::DescriptorType::eSampler,
+		vk::DescriptorType::eStorageBuffer,
+	};
+
+	struct Capacities {
+		u32 sampled_images{ 16384 };
+		u32 storage_images{ 1024 };
+		u32 samplers{ 256 };
+		u32 storage_buffers{ 16384 };
+	};
+
+	struct Stats {
+		std::array<u32, kind_count> capacity{};
+		std::array<u32, kind_count> live{};
+		u64 writes{};
+	};
+
+	vk::DescriptorSetLayout set_layout;
+	vk::DescriptorSet set;
+	Stats stats;
+
+	BindlessHeap() = default;
+
+	BindlessHeap(const BindlessHeap& _other) = delete;
+	BindlessHeap(BindlessHeap&& _other) noexcept;
+	BindlessHeap& operator=(const BindlessHeap& _other) = delete;
+	BindlessHeap& operator=(BindlessHeap&& _other) noexcept;
+
+	/**
+	 * Capacities are clamped to the device's update-after-bind limits.
+	 */
+	static Res<BindlessHeap> create(const vk::Device& _device, const vk::PhysicalDevice& _physical_device, const Capacities& _capacities = {});
+
+	[[nodiscard]]
+	b8 valid() const {
+		return cast<b8>(set);
+	}
+
+	/**
+	 * Write a descriptor into a free slot of its array and return the slot's index.
+	 * Fails once the array is full.
+	 */
+	[[nodiscard]]
+	Res<u32> register_sampled_image(vk::ImageView _view, vk::ImageLayout _layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+	[[nodiscard]]
+	Res<u32> register_storage_image(vk::ImageView _view);
+	[[nodiscard]]
+	Res<u32> register_sampler(vk::Sampler _sampler);
+	[[nodiscard]]
+	Res<u32> register_storage_buffer(const vk::DescriptorBufferInfo& _buffer_info);
+
+	/**
+	 * Return `_index` to the free list. The slot keeps its stale descriptor until reused,
+	 * so the caller must be sure no pending work still reads it.
+	 */
+	void release(Kind _kind, u32 _index);
+
+	/**
+	 * Bind the heap at `set_index`. Stays bound across pipelines whose layouts agree on the lower sets.
+	 */
+	void bind(vk::CommandBuffer _cmd, vk::PipelineBindPoint _bind_point, vk::PipelineLayout _layout) const;
+
+	void destroy();
+
+	~BindlessHeap();
+
+private:
+	[[nodiscard]]
+	Res<u32> register_descriptor(Kind _kind, const vk::DescriptorImageInfo* _image_info, const vk::DescriptorBufferInfo* _buffer_info);
+
+	vk::Device device_;
+	vk::DescriptorPool pool_;
+
+	std::array<std::vector<u32>, kind_count> free_;
+	// Indices below this were handed out at least once.
+	std::array<u32, kind_count> next_{};
+
+	// Resources may be registered from loading threads.
+	std::unique_ptr<std::mutex> mutex_;
+};
+
+constexpr const char* to_cstr(const BindlessHeap::Kind _kind) {
+	switch (_kind) {
+	case BindlessHeap::Kind::eSampledImage: return "sampled image";
+	case BindlessHeap::Kind::eStorageImage: return "storage image";
+	case BindlessHeap::Kind::eSampler: return "sampler";
+	case BindlessHeap::Kind::eStorageBuffer: return "storage buffer";
+	}
+	return "unknown";
+}
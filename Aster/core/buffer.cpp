@@ -6,20 +6,32 @@
 #include "buffer.h"
 #include <core/device.h>
 
-Res<Buffer> Buffer::create(const std::string& _name, const Borrowed<Device>& _device, usize _size, vk::BufferUsageFlags _usage, vma::MemoryUsage _memory_usage) {
+Res<Buffer> Buffer::create(const std::string& _name, const Borrowed<Device>& _device, usize _size, vk::BufferUsageFlags _usage, vma::MemoryUsage _memory_usage, vma::AllocationCreateFlags _allocation_flags, MemoryCategory _category) {
+	// The tagged name shows up against the allocation in the memory report.
+	auto allocation_name = std::fmt("[%s] %s", to_cstr(_category), _name.c_str());
+
+	// Device local memory is host visible on unified memory devices, so map it and let uploads skip staging.
+	if (_memory_usage == vma::MemoryUsage::eGpuOnly && _device->physical_device.is_unified_memory()) {
+		_allocation_flags |= vma::AllocationCreateFlagBits::eMapped;
+	}
+
+	vma::AllocationInfo allocation_info;
 	auto [result, buffer] = _device->allocator.createBuffer({
 		.size = _size,
 		.usage = _usage,
 		.sharingMode = vk::SharingMode::eExclusive,
 	}, {
+		.flags = _allocation_flags | vma::AllocationCreateFlagBits::eUserDataCopyString,
 		.usage = _memory_usage,
-	});
+		.pUserData = allocation_name.data(),
+	}, allocation_info);
 
 	if (failed(result)) {
 		return Err::make(std::fmt("Buffer %s creation failed with %s", _name.c_str(), to_cstr(result)));
 	}
 
 	_device->set_object_name(buffer.first, _name);
+	_device->memory.track(_category, allocation_info.size);
 
 	return Buffer{
 		_device,
@@ -29,11 +41,35 @@ Res<Buffer> Buffer::create(const std::string& _name, const Borrowed<Device>& _de
 		_memory_usage,
 		_size,
 		_name,
+		cast<u8*>(allocation_info.pMappedData),
+		_device->allocator.getMemoryTypeProperties(allocation_info.memoryType),
+		_category,
+		allocation_info.size,
 	};
 }
 
+Res<u32> Buffer::register_storage() {
+	if (storage_index != BindlessHeap::invalid_index) return storage_index;
+	if (!(usage & vk::BufferUsageFlagBits::eStorageBuffer)) {
+		return Err::make(std::fmt("Buffer '%s' is not a storage buffer. Use vk::BufferUsageFlagBits::eStorageBuffer during creation" CODE_LOC, name.c_str()));
+	}
+
+	auto index = parent_device->bindless.register_storage_buffer({
+		.buffer = buffer,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	});
+	if (!index) {
+		return Err::make(std::fmt("Buffer '%s' could not be registered" CODE_LOC, name.c_str()), std::move(index.error()));
+	}
+	storage_index = index.value();
+	return storage_index;
+}
+
 Buffer::~Buffer() {
 	if (buffer) {
+		parent_device->bindless.release(BindlessHeap::Kind::eStorageBuffer, storage_index);
 		parent_device->allocator.destroyBuffer(buffer, allocation);
+		parent_device->memory.untrack(category, allocated_size);
 	}
 }
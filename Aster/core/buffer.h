@@ -6,6 +6,8 @@
 #pragma once
 
 #include <global.h>
+#include <core/memory_tracker.h>
+#include <core/bindless_heap.h>
 
 class Device;
 
@@ -17,17 +19,30 @@ struct Buffer {
 	vma::MemoryUsage memory_usage = vma::MemoryUsage::eUnknown;
 	usize size = 0;
 	std::string name;
+	// Bytes VMA actually allocated, which the memory tracker counts. At least `size`.
+	usize allocated_size = 0;
+
+	// Set for buffers created with vma::AllocationCreateFlagBits::eMapped; stays valid for the buffer's lifetime.
+	u8* mapped = nullptr;
+	vk::MemoryPropertyFlags memory_flags;
+	MemoryCategory category = MemoryCategory::eGeneric;
+	// Slot in the device's bindless heap, released with the buffer.
+	u32 storage_index = BindlessHeap::invalid_index;
 
 	Buffer() = default;
 
-	Buffer(const Borrowed<Device>& _parent_device, const vk::Buffer& _buffer, const vma::Allocation& _allocation, const vk::BufferUsageFlags& _usage, vma::MemoryUsage _memory_usage, usize _size, const std::string& _name)
+	Buffer(const Borrowed<Device>& _parent_device, const vk::Buffer& _buffer, const vma::Allocation& _allocation, const vk::BufferUsageFlags& _usage, vma::MemoryUsage _memory_usage, usize _size, const std::string& _name, u8* _mapped = nullptr, const vk::MemoryPropertyFlags& _memory_flags = {}, MemoryCategory _category = MemoryCategory::eGeneric, usize _allocated_size = 0)
 		: parent_device{ _parent_device }
 		, buffer(_buffer)
 		, allocation(_allocation)
 		, usage(_usage)
 		, memory_usage(_memory_usage)
 		, size(_size)
-		, name(_name) {}
+		, name(_name)
+		, allocated_size(_allocated_size)
+		, mapped(_mapped)
+		, memory_flags(_memory_flags)
+		, category(_category) {}
 
 	Buffer(const Buffer& _other) = delete;
 
@@ -38,7 +53,12 @@ struct Buffer {
 		, usage{ _other.usage }
 		, memory_usage{ _other.memory_usage }
 		, size{ _other.size }
-		, name{ std::move(_other.name) } {}
+		, name{ std::move(_other.name) }
+		, allocated_size{ _other.allocated_size }
+		, mapped{ std::exchange(_other.mapped, nullptr) }
+		, memory_flags{ _other.memory_flags }
+		, category{ _other.category }
+		, storage_index{ std::exchange(_other.storage_index, BindlessHeap::invalid_index) } {}
 
 	Buffer& operator=(const Buffer& _other) = delete;
 
@@ -49,12 +69,39 @@ struct Buffer {
 		std::swap(allocation, _other.allocation);
 		usage = _other.usage;
 		memory_usage = _other.memory_usage;
-		size = _other.size;
+		// Size and category travel with the allocation so the swapped-out buffer untracks correctly.
+		std::swap(size, _other.size);
 		name = std::move(_other.name);
+		std::swap(allocated_size, _other.allocated_size);
+		std::swap(mapped, _other.mapped);
+		memory_flags = _other.memory_flags;
+		std::swap(category, _other.category);
+		std::swap(storage_index, _other.storage_index);
 		return *this;
 	}
 
-	static Res<Buffer> create(const std::string& _name, const Borrowed<Device>& _device, usize _size, vk::BufferUsageFlags _usage, vma::MemoryUsage _memory_usage);
+	static Res<Buffer> create(const std::string& _name, const Borrowed<Device>& _device, usize _size, vk::BufferUsageFlags _usage, vma::MemoryUsage _memory_usage, vma::AllocationCreateFlags _allocation_flags = {}, MemoryCategory _category = MemoryCategory::eGeneric);
+
+	[[nodiscard]]
+	b8 is_host_coherent() const {
+		return cast<b8>(memory_flags & vk::MemoryPropertyFlagBits::eHostCoherent);
+	}
+
+	/**
+	 * Mapped for its whole lifetime, so it can be written without staging. On unified memory devices
+	 * this includes eGpuOnly buffers.
+	 */
+	[[nodiscard]]
+	b8 is_host_writable() const {
+		return mapped != nullptr;
+	}
+
+	/**
+	 * Register the whole buffer in the bindless heap once and return its index. Later calls return the same index.
+	 * Fails unless the buffer was created with storage buffer usage.
+	 */
+	[[nodiscard]]
+	Res<u32> register_storage();
 
 	~Buffer();
 };
@@ -0,0 +1,117 @@
+// =============================================
+//  Aster: command_allocator.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "command_allocator.h"
+
+CommandAllocator::CommandAllocator(CommandAllocator&& _other) noexcept: device_{ std::exchange(_other.device_, nullptr) }
+                                                                      , frames_{ std::move(_other.frames_) }
+                                                                      , current_{ _other.current_ }
+                                                                      , mutex_{ std::move(_other.mutex_) }
+                                                                      , counters_{ std::move(_other.counters_) } {}
+
+CommandAllocator& CommandAllocator::operator=(CommandAllocator&& _other) noexcept {
+	if (this == &_other) return *this;
+	std::swap(device_, _other.device_);
+	std::swap(frames_, _other.frames_);
+	std::swap(current_, _other.current_);
+	std::swap(mutex_, _other.mutex_);
+	std::swap(counters_, _other.counters_);
+	return *this;
+}
+
+Res<vk::CommandBuffer> CommandAllocator::allocate(const u32 _queue_family) {
+	Pool* pool;
+	{
+		std::lock_guard lock{ *mutex_ };
+		pool = &frames_[current_].pools[{ std::this_thread::get_id(), _queue_family }];
+	}
+
+	if (!pool->pool) {
+		auto [result, command_pool] = device_.createCommandPool({
+			.flags = vk::CommandPoolCreateFlagBits::eTransient,
+			.queueFamilyIndex = _queue_family,
+		});
+		if (failed(result)) {
+			return Err::make(std::fmt("Command pool creation failed with %s" CODE_LOC, to_cstr(result)), result);
+		}
+		pool->pool = command_pool;
+		counters_->pools_created.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (pool->next == pool->buffers.size()) {
+		std::array<vk::CommandBuffer, buffer_growth> buffers;
+		vk::CommandBufferAllocateInfo allocate_info = {
+			.commandPool = pool->pool,
+			.level = vk::CommandBufferLevel::ePrimary,
+			.commandBufferCount = buffer_growth,
+		};
+		if (const auto result = device_.allocateCommandBuffers(&allocate_info, buffers.data()); failed(result)) {
+			return Err::make(std::fmt("Command buffer allocation failed with %s" CODE_LOC, to_cstr(result)), result);
+		}
+		pool->buffers.insert(pool->buffers.end(), buffers.begin(), buffers.end());
+		counters_->buffers_created.fetch_add(buffer_growth, std::memory_order_relaxed);
+	}
+
+	counters_->allocations.fetch_add(1, std::memory_order_relaxed);
+	return pool->buffers[pool->next++];
+}
+
+Res<> CommandAllocator::begin_frame(std::vector<RetirePoint>&& _retire_current) {
+	frames_[current_].retire_at = std::move(_retire_current);
+
+	current_ = (current_ + 1) % cast<u32>(frames_.size());
+	auto& frame = frames_[current_];
+
+	for (auto& [timeline_, value_] : frame.retire_at) {
+		const auto result = device_.waitSemaphores({
+			.semaphoreCount = 1,
+			.pSemaphores = &timeline_,
+			.pValues = &value_,
+		}, max_value<u64>);
+		if (failed(result)) {
+			return Err::make(std::fmt("Frame %u retire wait failed with %s" CODE_LOC, current_, to_cstr(result)), result);
+		}
+	}
+	frame.retire_at.clear();
+
+	std::lock_guard lock{ *mutex_ };
+	for (auto& [key_, pool_] : frame.pools) {
+		if (pool_.next == 0) continue;
+		if (const auto result = device_.resetCommandPool(pool_.pool, {}); failed(result)) {
+			return Err::make(std::fmt("Command pool reset failed with %s" CODE_LOC, to_cstr(result)), result);
+		}
+		pool_.next = 0;
+		counters_->resets.fetch_add(1, std::memory_order_relaxed);
+	}
+	return {};
+}
+
+CommandAllocator::Stats CommandAllocator::stats() const {
+	if (!counters_) return {};
+	return {
+		.allocations = counters_->allocations.load(std::memory_order_relaxed),
+		.pools_created = counters_->pools_created.load(std::memory_order_relaxed),
+		.buffers_created = counters_->buffers_created.load(std::memory_order_relaxed),
+		.resets = counters_->resets.load(std::memory_order_relaxed),
+	};
+}
+
+void CommandAllocator::destroy() {
+	if (!device_) return;
+
+	// Destroying a pool frees its buffers, and the owner idles the device first.
+	for (auto& frame_ : frames_) {
+		for (auto& [key_, pool_] : frame_.pools) {
+			device_.destroyCommandPool(pool_.pool);
+		}
+		frame_.pools.clear();
+	}
+	frames_.clear();
+	device_ = nullptr;
+}
+
+CommandAllocator::~CommandAllocator() {
+	destroy();
+}
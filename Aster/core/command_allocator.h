@@ -0,0 +1,111 @@
+// =============================================
+//  Aster: command_allocator.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class CommandAllocator
+ *
+ * @brief Hands out transient primary command buffers from one pool per (thread, frame, queue family).
+ *
+ * Buffers are handed out linearly and never freed individually. When a frame slot comes
+ * around again its pools are reset wholesale once the work submitted during it has retired.
+ * Any thread may allocate and record; frame boundaries must not overlap with recording.
+ */
+class CommandAllocator {
+public:
+	static constexpr u32 default_frames_in_flight = 3;
+
+	struct Stats {
+		u64 allocations{};
+		u64 pools_created{};
+		u64 buffers_created{};
+		u64 resets{};
+	};
+
+	// Timeline semaphore and value that must be reached before a frame's pools can be reset.
+	using RetirePoint = std::pair<vk::Semaphore, u64>;
+
+	CommandAllocator() = default;
+
+	CommandAllocator(const vk::Device& _device, const u32 _frames_in_flight)
+		: device_(_device)
+		, frames_(_frames_in_flight)
+		, mutex_(std::make_unique<std::mutex>())
+		, counters_(std::make_unique<Counters>()) {}
+
+	CommandAllocator(const CommandAllocator& _other) = delete;
+	CommandAllocator(CommandAllocator&& _other) noexcept;
+	CommandAllocator& operator=(const CommandAllocator& _other) = delete;
+	CommandAllocator& operator=(CommandAllocator&& _other) noexcept;
+
+	/**
+	 * Fetch a primary command buffer for `_queue_family` from the calling thread's pool for the current frame.
+	 * Valid until the frame slot is reused.
+	 */
+	[[nodiscard]]
+	Res<vk::CommandBuffer> allocate(u32 _queue_family);
+
+	/**
+	 * Close the current frame slot, which may be reused once everything in `_retire_current` is reached.
+	 * Then move to the next slot, waiting for its last use to retire and resetting its pools.
+	 */
+	[[nodiscard]]
+	Res<> begin_frame(std::vector<RetirePoint>&& _retire_current);
+
+	[[nodiscard]]
+	u32 frame_index() const {
+		return current_;
+	}
+
+	/**
+	 * Snapshot of the counters, which allocating threads bump concurrently.
+	 */
+	[[nodiscard]]
+	Stats stats() const;
+
+	void destroy();
+
+	~CommandAllocator();
+
+private:
+	struct Pool {
+		vk::CommandPool pool;
+		std::vector<vk::CommandBuffer> buffers;
+		usize next{ 0 };
+	};
+
+	struct Frame {
+		std::map<std::pair<std::thread::id, u32>, Pool> pools;
+		std::vector<RetirePoint> retire_at;
+	};
+
+	static constexpr u32 buffer_growth = 4;
+
+	vk::Device device_;
+	std::vector<Frame> frames_;
+	u32 current_{ 0 };
+
+	// Only guards the pool maps. A pool is only ever touched by the thread that owns it.
+	std::unique_ptr<std::mutex> mutex_;
+
+	struct Counters {
+		std::atomic<u64> allocations;
+		std::atomic<u64> pools_created;
+		std::atomic<u64> buffers_created;
+		std::atomic<u64> resets;
+	};
+
+	std::unique_ptr<Counters> counters_;
+};
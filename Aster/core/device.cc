@@ -9,6 +9,7 @@
 #include <core/window.h>
 
 #include <vector>
+#include <numeric>
 #include <map>
 #include <set>
 
@@ -16,9 +17,17 @@ Device::Device(Device&& _other) noexcept: parent_context{ std::move(_other.paren
                                         , physical_device{ _other.physical_device }
                                         , device{ std::exchange(_other.device, nullptr) }
                                         , queues{ _other.queues }
+                                        , extensions{ _other.extensions }
+                                        , timelines{ std::move(_other.timelines) }
                                         , allocator{ std::exchange(_other.allocator, nullptr) }
-                                        , transfer_cmd_pool{ std::exchange(_other.transfer_cmd_pool, nullptr) }
-                                        , graphics_cmd_pool{ std::exchange(_other.graphics_cmd_pool, nullptr) }
+                                        , memory{ std::move(_other.memory) }
+                                        , commands{ std::move(_other.commands) }
+                                        , staging_ring{ std::move(_other.staging_ring) }
+                                        , uploads{ std::move(_other.uploads) }
+                                        , uniforms{ std::move(_other.uniforms) }
+                                        , bindless{ std::move(_other.bindless) }
+                                        , fence_pool{ std::move(_other.fence_pool) }
+                                        , semaphore_pool{ std::move(_other.semaphore_pool) }
                                         , name{ std::move(_other.name) } {}
 
 Device& Device::operator=(Device&& _other) noexcept {
@@ -27,23 +36,61 @@ Device& Device::operator=(Device&& _other) noexcept {
 	physical_device = _other.physical_device;
 	device = std::exchange(_other.device, nullptr);
 	queues = _other.queues;
+	extensions = _other.extensions;
+	timelines = std::move(_other.timelines);
 	allocator = std::exchange(_other.allocator, nullptr);
-	transfer_cmd_pool = std::exchange(_other.transfer_cmd_pool, nullptr);
-	graphics_cmd_pool = std::exchange(_other.graphics_cmd_pool, nullptr);
+	memory = std::move(_other.memory);
+	commands = std::move(_other.commands);
+	staging_ring = std::move(_other.staging_ring);
+	uploads = std::move(_other.uploads);
+	uniforms = std::move(_other.uniforms);
+	bindless = std::move(_other.bindless);
+	fence_pool = std::move(_other.fence_pool);
+	semaphore_pool = std::move(_other.semaphore_pool);
 	name = std::move(_other.name);
 	return *this;
 }
 
-Res<Device> Device::create(const std::string_view& _name, Borrowed<Context>&& _context, const PhysicalDeviceInfo& _physical_device_info, const vk::PhysicalDeviceFeatures& _enabled_features) {
+Res<Device> Device::create(const std::string_view& _name, Borrowed<Context>&& _context, const PhysicalDeviceInfo& _physical_device_info, const vk::PhysicalDeviceFeatures& _enabled_features, const vk::PhysicalDeviceVulkan12Features& _enabled_features12, const usize _staging_ring_capacity, const usize _uniform_frame_capacity) {
 	const auto& physical_device = _physical_device_info.device;
 	const auto& queue_families = _physical_device_info.queue_families;
 
+	if (!_physical_device_info.features12.timelineSemaphore) {
+		return Err::make(std::fmt("Device %s does not support timeline semaphores" CODE_LOC, _physical_device_info.properties.deviceName.data()), vk::Result::eErrorFeatureNotPresent);
+	}
+
+	// Submission tracking is built on timeline semaphores.
+	auto enabled_features12 = _enabled_features12;
+	enabled_features12.pNext = nullptr;
+	enabled_features12.timelineSemaphore = true;
+
+	// Everything the bindless heap needs; it is skipped unless all of it is there.
+	const auto& supported12 = _physical_device_info.features12;
+	const b8 descriptor_indexing = supported12.runtimeDescriptorArray && supported12.descriptorBindingPartiallyBound && supported12.descriptorBindingUpdateUnusedWhilePending
+		&& supported12.descriptorBindingSampledImageUpdateAfterBind && supported12.descriptorBindingStorageImageUpdateAfterBind && supported12.descriptorBindingStorageBufferUpdateAfterBind;
+	if (descriptor_indexing) {
+		enabled_features12.runtimeDescriptorArray = true;
+		enabled_features12.descriptorBindingPartiallyBound = true;
+		enabled_features12.descriptorBindingUpdateUnusedWhilePending = true;
+		enabled_features12.descriptorBindingSampledImageUpdateAfterBind = true;
+		enabled_features12.descriptorBindingStorageImageUpdateAfterBind = true;
+		enabled_features12.descriptorBindingStorageBufferUpdateAfterBind = true;
+	}
+
 	// Logical Device
+	// A role the device has no family for (compute, on some devices) is left out instead of indexed.
 	std::map<u32, u16> unique_queue_families;
-	unique_queue_families[queue_families.graphics_idx]++;
-	unique_queue_families[queue_families.present_idx]++;
-	unique_queue_families[queue_families.transfer_idx]++;
-	unique_queue_families[queue_families.compute_idx]++;
+	for (const auto family_ : { queue_families.graphics_idx, queue_families.present_idx, queue_families.transfer_idx, queue_families.compute_idx }) {
+		if (family_ != QueueFamilyIndices::invalid_value) {
+			unique_queue_families[family_]++;
+		}
+	}
+
+	// Roles sharing a family get their own queue only while the family has enough of them.
+	const auto family_properties = physical_device.getQueueFamilyProperties();
+	for (auto& [index_, count_] : unique_queue_families) {
+		count_ = std::min(count_, cast<u16>(family_properties[index_].queueCount));
+	}
 
 	std::array<f32, 4> queue_priority = { 1.0f, 1.0f, 1.0f, 1.0f };
 	std::vector<vk::DeviceQueueCreateInfo> queue_create_infos;
@@ -55,15 +102,68 @@ Res<Device> Device::create(const std::string_view& _name, Borrowed<Context>&& _c
 		});
 	}
 
+	// Optional extensions are enabled when the device has them.
+	std::vector<const char*> device_extensions = _context->device_extensions;
+	OptionalExtensions extensions;
+	extensions.descriptor_indexing = descriptor_indexing;
+	vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR executable_features = {};
+#if defined(VK_EXT_graphics_pipeline_library)
+	vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library_features = {};
+#endif
+	if (auto [ext_result, extension_properties] = physical_device.enumerateDeviceExtensionProperties(); !failed(ext_result)) {
+		auto is_supported = [&extension_properties](const std::string_view& _extension) {
+			return std::ranges::any_of(extension_properties, [&_extension](const vk::ExtensionProperties& _ext) {
+				return std::string_view{ _ext.extensionName.data() } == _extension;
+			});
+		};
+		auto enable_if_supported = [&is_supported, &device_extensions](const std::string_view& _extension) {
+			const b8 supported = is_supported(_extension);
+			if (supported && std::ranges::none_of(device_extensions, [&_extension](const char* _ext) { return std::string_view{ _ext } == _extension; })) {
+				device_extensions.push_back(_extension.data());
+			}
+			return supported;
+		};
+		extensions.memory_budget = enable_if_supported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		extensions.pipeline_creation_feedback = enable_if_supported(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+
+		if (is_supported(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME)) {
+			const auto feature_chain = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR>();
+			if (feature_chain.get<vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR>().pipelineExecutableInfo) {
+				extensions.pipeline_executable_properties = enable_if_supported(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME);
+				executable_features.pipelineExecutableInfo = true;
+				executable_features.pNext = enabled_features12.pNext;
+				enabled_features12.pNext = &executable_features;
+			}
+		}
+
+#if defined(VK_EXT_graphics_pipeline_library)
+		// The extension alone is not enough, the feature has to be there and enabled too.
+		if (is_supported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) && is_supported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+			const auto feature_chain = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>();
+			if (feature_chain.get<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>().graphicsPipelineLibrary) {
+				enable_if_supported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+				extensions.graphics_pipeline_library = enable_if_supported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+				library_features.graphicsPipelineLibrary = true;
+				library_features.pNext = enabled_features12.pNext;
+				enabled_features12.pNext = &library_features;
+
+				const auto property_chain = physical_device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceGraphicsPipelineLibraryPropertiesEXT>();
+				INFO_IF(!property_chain.get<vk::PhysicalDeviceGraphicsPipelineLibraryPropertiesEXT>().graphicsPipelineLibraryFastLinking, "Graphics pipeline library links are not fast on this device");
+			}
+		}
+#endif
+	}
+
 	vk::Result result;
 	vk::Device device;
 	tie(result, device) = physical_device.createDevice({
+		.pNext = &enabled_features12,
 		.queueCreateInfoCount = cast<u32>(queue_create_infos.size()),
 		.pQueueCreateInfos = queue_create_infos.data(),
 		.enabledLayerCount = _context->enable_validation_layers ? cast<u32>(_context->validation_layers.size()) : 0,
 		.ppEnabledLayerNames = _context->enable_validation_layers ? _context->validation_layers.data() : nullptr,
-		.enabledExtensionCount = cast<u32>(_context->device_extensions.size()),
-		.ppEnabledExtensionNames = _context->device_extensions.data(),
+		.enabledExtensionCount = cast<u32>(device_extensions.size()),
+		.ppEnabledExtensionNames = device_extensions.data(),
 		.pEnabledFeatures = &_enabled_features,
 	});
 	if (failed(result)) {
@@ -73,61 +173,116 @@ Res<Device> Device::create(const std::string_view& _name, Borrowed<Context>&& _c
 	INFO("Logical Device Created!");
 
 	vma::Allocator allocator;
+	// VMA tops out at 1.1, which is enough for it to query budgets without extra instance extensions.
 	std::tie(result, allocator) = vma::createAllocator({
+		.flags = extensions.memory_budget ? vma::AllocatorCreateFlagBits::eExtMemoryBudget : vma::AllocatorCreateFlags{},
 		.physicalDevice = physical_device,
 		.device = device,
 		.instance = _context->instance,
+		.vulkanApiVersion = VK_API_VERSION_1_1,
 	});
 	if (failed(result)) {
 		device.destroy();
 		return Err::make(std::fmt("Memory allocator creation failed with %s" CODE_LOC, to_cstr(result)), result);
 	}
 	VERBOSE("Memory Allocator Created");
+	INFO_IF(extensions.memory_budget, "Memory budget extension enabled");
+	INFO_IF(extensions.pipeline_creation_feedback, "Pipeline creation feedback extension enabled");
+	INFO_IF(extensions.graphics_pipeline_library, "Graphics pipeline library extension enabled");
+	INFO_IF(extensions.pipeline_executable_properties, "Pipeline executable properties extension enabled");
 
 	INFO(std::fmt("Created Device '%s' Successfully", _name.data()));
 
 	Queues queues;
 	// Setup queues
 	{
-		u32 compute_idx = --unique_queue_families[queue_families.compute_idx];
-		u32 transfer_idx = --unique_queue_families[queue_families.transfer_idx];
-		u32 present_idx = --unique_queue_families[queue_families.present_idx];
-		u32 graphics_idx = --unique_queue_families[queue_families.graphics_idx];
+		// Hands out the family's queues from the top; once it runs out, the rest share queue 0.
+		const auto next_queue_index = [&unique_queue_families](const u32 _family) -> u32 {
+			auto& remaining = unique_queue_families[_family];
+			return remaining > 1 ? --remaining : 0;
+		};
+		u32 compute_idx = queue_families.has_compute() ? next_queue_index(queue_families.compute_idx) : 0;
+		u32 transfer_idx = next_queue_index(queue_families.transfer_idx);
+		u32 present_idx = next_queue_index(queue_families.present_idx);
+		u32 graphics_idx = next_queue_index(queue_families.graphics_idx);
 
 		queues.graphics = device.getQueue(queue_families.graphics_idx, graphics_idx);
 		queues.present = device.getQueue(queue_families.present_idx, present_idx);
 		queues.transfer = device.getQueue(queue_families.transfer_idx, transfer_idx);
-		queues.compute = device.getQueue(queue_families.graphics_idx, compute_idx);
+		if (queue_families.has_compute()) {
+			queues.compute = device.getQueue(queue_families.compute_idx, compute_idx);
+		}
 		INFO(std::fmt("Graphics Queue Index: (%i, %i)", queue_families.graphics_idx, graphics_idx));
 		INFO(std::fmt("Present Queue Index: (%i, %i)", queue_families.present_idx, present_idx));
 		INFO(std::fmt("Transfer Queue Index: (%i, %i)", queue_families.transfer_idx, transfer_idx));
 		INFO(std::fmt("Compute Queue Index: (%i, %i)", queue_families.compute_idx, compute_idx));
+		INFO_IF(queue_families.has_async_compute(), "Async compute available");
+		INFO_IF(queue_families.has_dedicated_transfer(), "Dedicated transfer available");
 	}
 
-	vk::CommandPool transfer_cmd_pool;
-	tie(result, transfer_cmd_pool) = device.createCommandPool({
-		.flags = vk::CommandPoolCreateFlagBits::eTransient,
-		.queueFamilyIndex = queue_families.transfer_idx,
-	});
-	if (failed(result)) {
+	auto staging_ring = StagingRing::create(device, allocator, _staging_ring_capacity);
+	if (!staging_ring) {
 		allocator.destroy();
 		device.destroy();
-		return Err::make(std::fmt("Transfer command pool creation failed with %s" CODE_LOC, to_cstr(result)), result);
+		return Err::make("Staging ring creation failed" CODE_LOC, std::move(staging_ring.error()));
 	}
-	VERBOSE("Transfer Command Pool Created");
+	VERBOSE(std::fmt("Staging Ring Created (%llu bytes)", cast<u64>(staging_ring->capacity)));
 
-	vk::CommandPool graphics_cmd_pool;
-	tie(result, graphics_cmd_pool) = device.createCommandPool({
-		.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
-		.queueFamilyIndex = queue_families.graphics_idx,
-	});
-	if (failed(result)) {
-		device.destroyCommandPool(transfer_cmd_pool);
+	auto uploads = UploadBatcher::create(device, queue_families.transfer_idx);
+	if (!uploads) {
+		staging_ring->destroy();
 		allocator.destroy();
 		device.destroy();
-		return Err::make(std::fmt("Graphics command pool creation failed with %s" CODE_LOC, to_cstr(result)), result);
+		return Err::make("Upload batcher creation failed" CODE_LOC, std::move(uploads.error()));
+	}
+	VERBOSE("Upload Batcher Created");
+
+	// Constants are read by async compute passes as well as graphics.
+	auto uniforms = UniformRing::create(allocator, _uniform_frame_capacity, CommandAllocator::default_frames_in_flight, _physical_device_info.properties.limits.minUniformBufferOffsetAlignment, queue_families.async_compute_families());
+	if (!uniforms) {
+		uploads->destroy();
+		staging_ring->destroy();
+		allocator.destroy();
+		device.destroy();
+		return Err::make("Uniform ring creation failed" CODE_LOC, std::move(uniforms.error()));
+	}
+	VERBOSE(std::fmt("Uniform Ring Created (%u x %llu bytes)", uniforms->frame_count, cast<u64>(uniforms->frame_capacity)));
+
+	const std::array<std::pair<vk::Queue, u32>, 4> queue_families_in_use = {
+		std::pair{ queues.graphics, queue_families.graphics_idx },
+		std::pair{ queues.present, queue_families.present_idx },
+		std::pair{ queues.transfer, queue_families.transfer_idx },
+		std::pair{ queues.compute.value_or(vk::Queue{}), queue_families.compute_idx },
+	};
+
+	std::vector<QueueTimeline> timelines;
+	for (auto& [queue_, family_] : queue_families_in_use) {
+		if (!queue_ || std::ranges::any_of(timelines, [queue = queue_](const QueueTimeline& _t) { return _t.queue == queue; })) continue;
+
+		vk::SemaphoreTypeCreateInfo type_info = {
+			.semaphoreType = vk::SemaphoreType::eTimeline,
+			.initialValue = 0,
+		};
+		vk::Semaphore semaphore;
+		tie(result, semaphore) = device.createSemaphore({ .pNext = &type_info });
+		if (failed(result)) {
+			for (auto& timeline_ : timelines) {
+				device.destroySemaphore(timeline_.semaphore);
+			}
+			uniforms->destroy();
+			uploads->destroy();
+			staging_ring->destroy();
+			allocator.destroy();
+			device.destroy();
+			return Err::make(std::fmt("Timeline semaphore creation failed with %s" CODE_LOC, to_cstr(result)), result);
+		}
+		timelines.push_back({
+			.queue = queue_,
+			.family = family_,
+			.semaphore = semaphore,
+		});
 	}
-	VERBOSE("Graphics Command Pool Created");
+	VERBOSE(std::fmt("%llu Queue Timelines Created", cast<u64>(timelines.size())));
 
 	Device final_device{
 		_name,
@@ -135,94 +290,307 @@ Res<Device> Device::create(const std::string_view& _name, Borrowed<Context>&& _c
 		_physical_device_info,
 		device,
 		queues,
+		extensions,
 		allocator,
-		transfer_cmd_pool,
-		graphics_cmd_pool
+		std::move(staging_ring.value()),
+		std::move(uploads.value()),
+		std::move(uniforms.value()),
+		std::move(timelines),
 	};
 
 	final_device.set_name(_name);
-	final_device.set_object_name(transfer_cmd_pool, "Async transfer command pool");
-	final_device.set_object_name(graphics_cmd_pool, "Single use Graphics command pool");
+	final_device.set_object_name(final_device.staging_ring.buffer, "Staging ring");
+	final_device.set_object_name(final_device.uniforms.buffer, "Uniform ring");
+	final_device.memory.track(MemoryCategory::eStaging, final_device.staging_ring.capacity);
+	final_device.memory.track(MemoryCategory::eUniform, final_device.uniforms.frame_capacity * final_device.uniforms.frame_count);
+
+	// The heap is an optional fast path, so a device without it still comes up.
+	if (extensions.descriptor_indexing) {
+		if (auto bindless = BindlessHeap::create(device, physical_device)) {
+			final_device.bindless = std::move(bindless.value());
+			final_device.set_object_name(final_device.bindless.set_layout, "Bindless set layout");
+			final_device.set_object_name(final_device.bindless.set, "Bindless set");
+			INFO(std::fmt("Bindless heap created (%u sampled images, %u storage images, %u samplers, %u storage buffers)", final_device.bindless.stats.capacity[0], final_device.bindless.stats.capacity[1], final_device.bindless.stats.capacity[2], final_device.bindless.stats.capacity[3]));
+		} else {
+			WARN(std::fmt("Bindless heap creation failed, continuing without it\n|> %s", bindless.error().what()));
+		}
+	}
+
+	for (auto& timeline_ : final_device.timelines) {
+		final_device.set_object_name(timeline_.semaphore, std::fmt("Queue %p timeline", cast<VkQueue>(timeline_.queue)));
+	}
 
 	return std::move(final_device);
 }
 
 Device::~Device() {
 	if (!device) return;
-	if (graphics_cmd_pool) device.destroyCommandPool(graphics_cmd_pool);
-	if (transfer_cmd_pool) device.destroyCommandPool(transfer_cmd_pool);
+	WARN_IF(failed(device.waitIdle()), "Device wait idle failed");
+	retire();
+	for (auto& timeline_ : timelines) {
+		device.destroySemaphore(timeline_.semaphore);
+	}
+	const auto command_stats = commands.stats();
+	INFO(std::fmt("Command allocator: %llu allocations, %llu buffers in %llu pools", command_stats.allocations, command_stats.buffers_created, command_stats.pools_created));
+	commands.destroy();
+	uploads.destroy();
+	staging_ring.destroy();
+	INFO(std::fmt("Uniform ring: %llu allocations, peak %llu of %llu bytes per frame", uniforms.stats.allocations, cast<u64>(uniforms.stats.peak_frame_used), cast<u64>(uniforms.stats.frame_capacity)));
+	uniforms.destroy();
+	bindless.destroy();
+	INFO(std::fmt("Fence pool: %llu hits, %llu misses", fence_pool.stats.hits, fence_pool.stats.misses));
+	INFO(std::fmt("Semaphore pool: %llu hits, %llu misses", semaphore_pool.stats.hits, semaphore_pool.stats.misses));
+	fence_pool.destroy();
+	semaphore_pool.destroy();
 	if (allocator) allocator.destroy();
 	device.destroy();
 	INFO("Device '" + name + "' Destroyed");
 }
 
-Res<vk::CommandBuffer> Device::alloc_temp_command_buffer(vk::CommandPool _pool) const {
-	vk::CommandBuffer cmd;
-	vk::CommandBufferAllocateInfo cmd_buf_alloc_info = {
-		.commandPool = _pool,
-		.level = vk::CommandBufferLevel::ePrimary,
-		.commandBufferCount = 1,
-	};
-	if (const auto result = device.allocateCommandBuffers(&cmd_buf_alloc_info, &cmd); failed(result)) {
-		return Err::make(std::fmt("Temp Command buffer allocation failed with %s" CODE_LOC, to_cstr(result)), result);
+Res<vk::CommandBuffer> Device::alloc_temp_command_buffer(const vk::Queue _queue) {
+	auto cmd = commands.allocate(timeline(_queue).family);
+	if (!cmd) {
+		return Err::make("Temp Command buffer allocation failed" CODE_LOC, std::move(cmd.error()));
 	}
 	return cmd;
 }
 
-Res<SubmitTask<Buffer>> Device::upload_data(const Borrowed<Buffer>& _host_buffer, Buffer&& _staging_buffer) {
-	ERROR_IF(!(_host_buffer->usage & vk::BufferUsageFlagBits::eTransferDst), std::fmt("Buffer %s is not a transfer dst. Use vk::BufferUsageFlagBits::eTransferDst during creation", _host_buffer->name.data()))
-	ELSE_IF_ERROR(!(_staging_buffer.usage & vk::BufferUsageFlagBits::eTransferSrc), std::fmt("Buffer %s is not a transfer src. Use vk::BufferUsageFlagBits::eTransferSrc during creation", _staging_buffer.name.data()))
-	ELSE_IF_WARN(_host_buffer->memory_usage != vma::MemoryUsage::eGpuOnly, std::fmt("Memory %s is not GPU only. Upload not required", _host_buffer->name.data()))
-	ELSE_IF_WARN(_host_buffer->memory_usage != vma::MemoryUsage::eCpuOnly, std::fmt("Memory %s is not CPU only. Staging should ideally be a CPU only buffer", _staging_buffer.name.data()));
+Res<> Device::begin_frame() {
+	// Everything submitted so far may have used the closing slot's buffers.
+	std::vector<CommandAllocator::RetirePoint> retire_at;
+	retire_at.reserve(timelines.size());
+	for (auto& timeline_ : timelines) {
+		if (timeline_.next_value > 1) {
+			retire_at.emplace_back(timeline_.semaphore, timeline_.next_value - 1);
+		}
+	}
 
-	vk::CommandBuffer cmd;
-	vk::CommandBufferAllocateInfo allocate_info = {
-		.commandPool = transfer_cmd_pool,
-		.level = vk::CommandBufferLevel::ePrimary,
-		.commandBufferCount = 1,
-	};
+	if (auto res = commands.begin_frame(std::move(retire_at)); !res) {
+		return Err::make(std::fmt("Frame %u could not begin" CODE_LOC, commands.frame_index()), std::move(res.error()));
+	}
+	uniforms.begin_frame(commands.frame_index());
+	return {};
+}
 
-	auto result = device.allocateCommandBuffers(&allocate_info, &cmd);
-	if (failed(result)) {
-		return Err::make(std::fmt("Transfer command pool allocation failed with %s" CODE_LOC, to_cstr(result)), result);
+Res<u64> Device::submit(const vk::Queue _queue, const std::vector<vk::CommandBuffer>& _cmd, const std::vector<vk::Semaphore>& _wait_on, const vk::PipelineStageFlags& _wait_stage, const std::vector<vk::Semaphore>& _signal_to, const vk::Fence _fence, const std::vector<TimelineWait>& _wait_timelines) {
+	uniforms.flush();
+
+	auto& queue_timeline = timeline(_queue);
+	const auto value = queue_timeline.next_value;
+
+	std::vector<vk::Semaphore> wait_on = _wait_on;
+	std::vector<vk::PipelineStageFlags> wait_stages(_wait_on.size(), _wait_stage);
+	std::vector<u64> wait_values(_wait_on.size(), 0);
+	for (const auto& wait_ : _wait_timelines) {
+		wait_on.push_back(timeline(wait_.queue).semaphore);
+		wait_stages.push_back(wait_.stage);
+		wait_values.push_back(wait_.value);
 	}
-	set_object_name(cmd, std::fmt("%s transfer command", _host_buffer->name.data()));
 
-	result = cmd.begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit, });
+	// Binary semaphores ignore their entry in the value array.
+	std::vector<vk::Semaphore> signal_to = _signal_to;
+	signal_to.push_back(queue_timeline.semaphore);
+	std::vector<u64> signal_values(signal_to.size(), 0);
+	signal_values.back() = value;
+
+	vk::TimelineSemaphoreSubmitInfo timeline_info = {
+		.waitSemaphoreValueCount = cast<u32>(wait_values.size()),
+		.pWaitSemaphoreValues = wait_values.data(),
+		.signalSemaphoreValueCount = cast<u32>(signal_values.size()),
+		.pSignalSemaphoreValues = signal_values.data(),
+	};
+	const auto result = _queue.submit({
+		{
+			.pNext = &timeline_info,
+			.waitSemaphoreCount = cast<u32>(wait_on.size()),
+			.pWaitSemaphores = wait_on.data(),
+			.pWaitDstStageMask = wait_stages.data(),
+			.commandBufferCount = cast<u32>(_cmd.size()),
+			.pCommandBuffers = _cmd.data(),
+			.signalSemaphoreCount = cast<u32>(signal_to.size()),
+			.pSignalSemaphores = signal_to.data(),
+		} }, _fence);
 	if (failed(result)) {
-		return Err::make(std::fmt("Command buffer begin failed with %s" CODE_LOC, to_cstr(result)), result);
+		return Err::make(std::fmt("Submit failed with %s" CODE_LOC, to_cstr(result)), result);
 	}
 
-	cmd.copyBuffer(_staging_buffer.buffer, _host_buffer->buffer, {
-		{
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = cast<u32>(_staging_buffer.size)
-		} });
-	result = cmd.end();
+	++queue_timeline.next_value;
+	return value;
+}
+
+b8 Device::is_complete(const vk::Queue _queue, const u64 _value) {
+	auto& queue_timeline = timeline(_queue);
+	if (_value <= queue_timeline.completed_value) return true;
+
+	auto [result, counter] = device.getSemaphoreCounterValue(queue_timeline.semaphore);
+	WARN_IF(failed(result), std::fmt("Timeline query failed with %s", to_cstr(result)));
+	if (failed(result)) return false;
+
+	queue_timeline.completed_value = counter;
+	return _value <= counter;
+}
+
+Res<> Device::wait(const vk::Queue _queue, const u64 _value, const u64 _timeout) {
+	auto& queue_timeline = timeline(_queue);
+	if (_value <= queue_timeline.completed_value) return {};
+
+	const auto result = device.waitSemaphores({
+		.semaphoreCount = 1,
+		.pSemaphores = &queue_timeline.semaphore,
+		.pValues = &_value,
+	}, _timeout);
+	if (result == vk::Result::eTimeout) {
+		return Err::make(std::fmt("Timeline wait for %llu timed out" CODE_LOC, _value), result);
+	}
 	if (failed(result)) {
-		return Err::make(std::fmt("Command buffer end failed with %s" CODE_LOC, to_cstr(result)), result);
+		return Err::make(std::fmt("Timeline wait failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	queue_timeline.completed_value = std::max(queue_timeline.completed_value, _value);
+	return {};
+}
+
+void Device::then(const vk::Queue _queue, const u64 _value, std::function<void()>&& _callback) {
+	if (is_complete(_queue, _value)) {
+		_callback();
+		return;
+	}
+
+	auto& deferred = timeline(_queue).deferred;
+	// Values are handed out in order, so callbacks only need sorting when registered out of order.
+	const auto it = std::ranges::upper_bound(deferred, _value, std::less{}, &std::pair<u64, std::function<void()>>::first);
+	deferred.emplace(it, _value, std::move(_callback));
+}
+
+void Device::retire() {
+	for (auto& timeline_ : timelines) {
+		auto [result, counter] = device.getSemaphoreCounterValue(timeline_.semaphore);
+		WARN_IF(failed(result), std::fmt("Timeline query failed with %s", to_cstr(result)));
+		if (failed(result)) continue;
+		timeline_.completed_value = counter;
+
+		while (!timeline_.deferred.empty() && timeline_.deferred.front().first <= counter) {
+			auto callback = std::move(timeline_.deferred.front().second);
+			timeline_.deferred.pop_front();
+			callback();
+		}
 	}
 
-	return SubmitTask<Buffer>::create(borrow(this), std::move(_staging_buffer), queues.transfer, transfer_cmd_pool, { cmd });
+	staging_ring.reclaim();
+	uploads.retire(timeline(queues.transfer).completed_value);
+}
+
+QueueTimeline& Device::timeline(const vk::Queue _queue) {
+	for (auto& timeline_ : timelines) {
+		if (timeline_.queue == _queue) return timeline_;
+	}
+	ERROR(std::fmt("Queue %p has no timeline", cast<VkQueue>(_queue))) THEN_CRASH(Error::eUnknown);
+	return timelines.front();
+}
+
+QueueOwnershipTransfer Device::ownership_transfer(const vk::Queue _src, const vk::Queue _dst) {
+	return {
+		.src_family = timeline(_src).family,
+		.dst_family = timeline(_dst).family,
+	};
+}
+
+void Device::recycle_after(const vk::Queue _queue, const u64 _value, const vk::Semaphore _semaphore) {
+	then(_queue, _value, [this, _semaphore] {
+		semaphore_pool.release(_semaphore);
+	});
+}
+
+void Device::recycle_after(const vk::Queue _queue, const u64 _value, const vk::Fence _fence) {
+	then(_queue, _value, [this, _fence] {
+		fence_pool.release(_fence);
+	});
+}
+
+Res<SubmitTask<Buffer>> Device::upload_data(const Borrowed<Buffer>& _host_buffer, Buffer&& _staging_buffer) {
+	ERROR_IF(!(_host_buffer->usage & vk::BufferUsageFlagBits::eTransferDst), std::fmt("Buffer %s is not a transfer dst. Use vk::BufferUsageFlagBits::eTransferDst during creation", _host_buffer->name.data()))
+	ELSE_IF_ERROR(!(_staging_buffer.usage & vk::BufferUsageFlagBits::eTransferSrc), std::fmt("Buffer %s is not a transfer src. Use vk::BufferUsageFlagBits::eTransferSrc during creation", _staging_buffer.name.data()))
+	ELSE_IF_WARN(_host_buffer->memory_usage != vma::MemoryUsage::eGpuOnly, std::fmt("Memory %s is not GPU only. Upload not required", _host_buffer->name.data()))
+	ELSE_IF_WARN(_host_buffer->memory_usage != vma::MemoryUsage::eCpuOnly, std::fmt("Memory %s is not CPU only. Staging should ideally be a CPU only buffer", _staging_buffer.name.data()));
+
+	auto cmd = record_upload_copy(_host_buffer->name, _staging_buffer.buffer, 0, _host_buffer->buffer, _staging_buffer.size);
+	if (!cmd) {
+		return Err::make(std::move(cmd.error()));
+	}
+
+	return SubmitTask<Buffer>::create(borrow(this), std::move(_staging_buffer), queues.transfer, { cmd.value() });
 }
 
 Res<SubmitTask<Buffer>> Device::upload_data(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data) {
+	if (_host_buffer->is_host_writable()) {
+		if (auto res = write_direct(_host_buffer, _data, 0); !res) {
+			return Err::make(std::move(res.error()));
+		}
+		// Value 0 is always complete, so waiting on the task returns immediately.
+		return SubmitTask<Buffer>{
+			.device = borrow(this),
+			.queue = queues.transfer,
+		};
+	}
+
 	ERROR_IF(!(_host_buffer->usage & vk::BufferUsageFlagBits::eTransferDst), std::fmt("Buffer %s is not a transfer dst. Use vk::BufferUsageFlagBits::eTransferDst during creation", _host_buffer->name.data()))
 	ELSE_IF_WARN(_host_buffer->memory_usage != vma::MemoryUsage::eGpuOnly, std::fmt("Memory %s is not GPU only. Upload not required", _host_buffer->name.data()));
 
-	if (auto res = Buffer::create("_stage " + _host_buffer->name, borrow(this), _data.size(), vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eCpuOnly)) {
-		return Err::make("Staging buffer creation failed", std::move(res.error()));
-	} else {
-		if (auto result = update_data(borrow(res.value()), _data)) {
-			return upload_data(_host_buffer, std::move(res.value()));
+	// Slices already staged for the open batch must not be fenced by this submission.
+	if (uploads.has_pending()) {
+		if (auto res = flush_uploads(); !res) {
+			return Err::make(std::move(res.error()));
+		}
+	}
+
+	if (_data.size() > staging_ring.capacity) {
+		++staging_ring.stats.fallbacks;
+		VERBOSE(std::fmt("Upload to %s (%llu bytes) exceeds staging ring, using a dedicated buffer", _host_buffer->name.data(), cast<u64>(_data.size())));
+
+		if (auto res = Buffer::create("_stage " + _host_buffer->name, borrow(this), _data.size(), vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eCpuOnly, {}, MemoryCategory::eStaging); !res) {
+			return Err::make("Staging buffer creation failed", std::move(res.error()));
 		} else {
-			return Err::make(std::move(result.error()));
+			if (auto result = update_data(borrow(res.value()), _data)) {
+				return upload_data(_host_buffer, std::move(res.value()));
+			} else {
+				return Err::make(std::move(result.error()));
+			}
 		}
 	}
+
+	auto slice = staging_ring.allocate(_data.size());
+	if (!slice) {
+		return Err::make(std::fmt("Staging slice for %s failed" CODE_LOC, _host_buffer->name.data()), std::move(slice.error()));
+	}
+	memcpy(slice->mapped, _data.data(), _data.size());
+
+	auto cmd = record_upload_copy(_host_buffer->name, slice->buffer, slice->offset, _host_buffer->buffer, slice->size);
+	if (!cmd) {
+		return Err::make(std::move(cmd.error()));
+	}
+
+	auto task = SubmitTask<Buffer>::create(borrow(this), Buffer{}, queues.transfer, { cmd.value() });
+	if (!task) {
+		return Err::make(std::move(task.error()));
+	}
+
+	staging_ring.guard_pending(timeline(queues.transfer).semaphore, task->value);
+
+	return std::move(task.value());
 }
 
-Res<> Device::update_data(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data) const {
+Res<> Device::update_data(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data, const vk::DeviceSize _offset) const {
+	if (_offset + _data.size() > _host_buffer->size) {
+		return Err::make(std::fmt("Update of %llu bytes at %llu overruns %s" CODE_LOC, cast<u64>(_data.size()), _offset, _host_buffer->name.data()));
+	}
+
+	if (_host_buffer->mapped) {
+		memcpy(_host_buffer->mapped + _offset, _data.data(), _data.size());
+		if (!_host_buffer->is_host_coherent()) {
+			allocator.flushAllocation(_host_buffer->allocation, _offset, _data.size());
+		}
+		return {};
+	}
 
 	if (_host_buffer->memory_usage != vma::MemoryUsage::eCpuToGpu &&
 		_host_buffer->memory_usage != vma::MemoryUsage::eCpuOnly) {
@@ -233,12 +601,215 @@ Res<> Device::update_data(const Borrowed<Buffer>& _host_buffer, const std::span<
 	if (failed(result)) {
 		return Err::make(std::fmt("Memory mapping failed with %s" CODE_LOC, to_cstr(result)), result);
 	}
-	memcpy(mapped_memory, _data.data(), _data.size());
+	memcpy(cast<u8*>(mapped_memory) + _offset, _data.data(), _data.size());
+	if (!_host_buffer->is_host_coherent()) {
+		allocator.flushAllocation(_host_buffer->allocation, _offset, _data.size());
+	}
 	allocator.unmapMemory(_host_buffer->allocation);
 
 	return {};
 }
 
+Res<> Device::write_direct(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data, const vk::DeviceSize _offset) {
+	if (auto res = update_data(_host_buffer, _data, _offset); !res) {
+		return Err::make(std::fmt("Direct write to %s failed" CODE_LOC, _host_buffer->name.data()), std::move(res.error()));
+	}
+	++uploads.stats.direct_writes;
+	uploads.stats.direct_bytes += _data.size();
+	return {};
+}
+
+Res<UploadTicket> Device::queue_upload(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data, const vk::DeviceSize _dst_offset, const vk::Queue _consumer) {
+	if (_host_buffer->is_host_writable()) {
+		if (auto res = write_direct(_host_buffer, _data, _dst_offset); !res) {
+			return Err::make(std::move(res.error()));
+		}
+		return UploadTicket{};
+	}
+
+	ERROR_IF(!(_host_buffer->usage & vk::BufferUsageFlagBits::eTransferDst), std::fmt("Buffer %s is not a transfer dst. Use vk::BufferUsageFlagBits::eTransferDst during creation", _host_buffer->name.data()))
+	ELSE_IF_WARN(_host_buffer->memory_usage != vma::MemoryUsage::eGpuOnly, std::fmt("Memory %s is not GPU only. Upload not required", _host_buffer->name.data()));
+
+	auto slice = stage_upload(_host_buffer->name, _data, StagingRing::default_alignment);
+	if (!slice) {
+		return Err::make(std::fmt("Staging upload to %s failed" CODE_LOC, _host_buffer->name.data()), std::move(slice.error()));
+	}
+
+	return uploads.copy_buffer(slice->buffer, _host_buffer->buffer, {
+		.srcOffset = slice->offset,
+		.dstOffset = _dst_offset,
+		.size = slice->size,
+	}, timeline(_consumer ? _consumer : queues.graphics).family);
+}
+
+Res<UploadTicket> Device::queue_upload(const Borrowed<Image>& _image, const std::span<u8>& _data, const vk::ImageLayout _final_layout, const vk::Queue _consumer) {
+	ERROR_IF(!(_image->usage & vk::ImageUsageFlagBits::eTransferDst), std::fmt("Image %s is not a transfer dst. Use vk::ImageUsageFlagBits::eTransferDst during creation", _image->name.data()));
+
+	const auto texel = texel_size(_image->format);
+	if (texel == 0) {
+		return Err::make(std::fmt("Image %s has format %s which can't be staged" CODE_LOC, _image->name.data(), to_cstr(_image->format)));
+	}
+	const auto expected_size = cast<usize>(_image->extent.width) * _image->extent.height * _image->extent.depth * texel * _image->layer_count;
+	if (_data.size() != expected_size) {
+		return Err::make(std::fmt("Image %s upload is %llu bytes, mip 0 needs %llu" CODE_LOC, _image->name.data(), cast<u64>(_data.size()), cast<u64>(expected_size)));
+	}
+
+	// Copy offsets must be a multiple of the texel size, which need not be a power of two.
+	const auto alignment = std::lcm(std::lcm(StagingRing::default_alignment, texel), cast<usize>(std::max<vk::DeviceSize>(physical_device.properties.limits.optimalBufferCopyOffsetAlignment, 1)));
+	auto slice = stage_upload(_image->name, _data, alignment);
+	if (!slice) {
+		return Err::make(std::fmt("Staging upload to %s failed" CODE_LOC, _image->name.data()), std::move(slice.error()));
+	}
+
+	uploads.stats.bytes += slice->size;
+	return uploads.copy_image(slice->buffer, _image->image, {
+		.bufferOffset = slice->offset,
+		.bufferRowLength = 0,
+		.bufferImageHeight = 0,
+		.imageSubresource = {
+			.aspectMask = vk::ImageAspectFlagBits::eColor,
+			.mipLevel = 0,
+			.baseArrayLayer = 0,
+			.layerCount = _image->layer_count,
+		},
+		.imageOffset = { 0, 0, 0 },
+		.imageExtent = _image->extent,
+	}, {
+		.aspectMask = vk::ImageAspectFlagBits::eColor,
+		.baseMipLevel = 0,
+		.levelCount = 1,
+		.baseArrayLayer = 0,
+		.layerCount = _image->layer_count,
+	}, _final_layout, timeline(_consumer ? _consumer : queues.graphics).family);
+}
+
+Res<> Device::flush_uploads() {
+	auto cmd = uploads.close();
+	if (!cmd) {
+		return Err::make("Upload batch flush failed" CODE_LOC, std::move(cmd.error()));
+	}
+
+	if (cmd.value()) {
+		auto value = submit(queues.transfer, { cmd.value() });
+		if (!value) {
+			uploads.discard();
+			return Err::make("Upload batch submit failed" CODE_LOC, std::move(value.error()));
+		}
+		uploads.submitted(value.value());
+		staging_ring.guard_pending(timeline(queues.transfer).semaphore, value.value());
+	}
+
+	retire();
+	return {};
+}
+
+b8 Device::is_upload_complete(const UploadTicket& _ticket) {
+	retire();
+	return uploads.is_complete(_ticket);
+}
+
+Res<> Device::wait_upload(const UploadTicket& _ticket) {
+	if (uploads.is_discarded(_ticket)) {
+		return Err::make(std::fmt("Upload batch %llu was discarded" CODE_LOC, _ticket.batch));
+	}
+	if (uploads.is_complete(_ticket)) return {};
+
+	if (uploads.has_pending()) {
+		if (auto res = flush_uploads(); !res) {
+			return Err::make(std::move(res.error()));
+		}
+	}
+
+	const auto value = uploads.timeline_value(_ticket);
+	if (!value) {
+		if (uploads.is_complete(_ticket)) return {};
+		if (uploads.is_discarded(_ticket)) {
+			return Err::make(std::fmt("Upload batch %llu was discarded" CODE_LOC, _ticket.batch));
+		}
+		return Err::make(std::fmt("Upload batch %llu is unknown" CODE_LOC, _ticket.batch));
+	}
+
+	if (auto res = wait(queues.transfer, value.value()); !res) {
+		return Err::make(std::move(res.error()));
+	}
+
+	retire();
+	return {};
+}
+
+Res<StagingRing::Slice> Device::stage_upload(const std::string& _name, const std::span<u8>& _data, const usize _alignment) {
+	if (_data.size() > staging_ring.capacity) {
+		++staging_ring.stats.fallbacks;
+		VERBOSE(std::fmt("Upload to %s (%llu bytes) exceeds staging ring, using a dedicated buffer", _name.data(), cast<u64>(_data.size())));
+
+		auto staging = Buffer::create("_stage " + _name, borrow(this), _data.size(), vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eCpuOnly, {}, MemoryCategory::eStaging);
+		if (!staging) {
+			return Err::make("Staging buffer creation failed", std::move(staging.error()));
+		}
+		if (auto res = update_data(borrow(staging.value()), _data); !res) {
+			return Err::make(std::move(res.error()));
+		}
+
+		const StagingRing::Slice slice = {
+			.buffer = staging->buffer,
+			.offset = 0,
+			.size = _data.size(),
+		};
+		if (auto res = uploads.keep_alive(std::move(staging.value())); !res) {
+			return Err::make(std::move(res.error()));
+		}
+		return slice;
+	}
+
+	// Everything staged for the open batch is unfenced, so the ring can only make room once the batch goes out.
+	if (staging_ring.needs_guard(_data.size(), _alignment)) {
+		if (auto res = flush_uploads(); !res) {
+			return Err::make(std::move(res.error()));
+		}
+	}
+
+	auto slice = staging_ring.allocate(_data.size(), _alignment);
+	if (!slice) {
+		return Err::make(std::move(slice.error()));
+	}
+	memcpy(slice->mapped, _data.data(), _data.size());
+	return std::move(slice.value());
+}
+
+Res<vk::CommandBuffer> Device::record_upload_copy(const std::string_view& _name, vk::Buffer _src, vk::DeviceSize _src_offset, vk::Buffer _dst, vk::DeviceSize _size) {
+	auto alloc = alloc_temp_command_buffer(queues.transfer);
+	if (!alloc) {
+		return Err::make(std::move(alloc.error()));
+	}
+	auto cmd = alloc.value();
+	set_object_name(cmd, std::fmt("%s transfer command", _name.data()));
+
+	auto result = cmd.begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit, });
+	if (failed(result)) {
+		return Err::make(std::fmt("Command buffer begin failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	cmd.copyBuffer(_src, _dst, {
+		{
+			.srcOffset = _src_offset,
+			.dstOffset = 0,
+			.size = _size,
+		} });
+	// Exclusive buffers must be handed to the graphics family, which consumes every upload_data result.
+	QueueOwnershipTransfer{
+		.src_family = timeline(queues.transfer).family,
+		.dst_family = timeline(queues.graphics).family,
+		.src_stage = vk::PipelineStageFlagBits::eTransfer,
+		.src_access = vk::AccessFlagBits::eTransferWrite,
+	}.release(cmd, _dst, 0, _size);
+	result = cmd.end();
+	if (failed(result)) {
+		return Err::make(std::fmt("Command buffer end failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	return cmd;
+}
+
 void Device::set_name(const std::string_view& _name) {
 	VERBOSE(std::fmt("Device %s -> %s", name.data(), _name.data()));
 	name = _name;
@@ -246,59 +817,68 @@ void Device::set_name(const std::string_view& _name) {
 	set_object_name(device, std::fmt("%s Device", _name.data()));
 }
 
+Res<> Device::dump_memory_report(const std::string_view& _path) const {
+	return memory.dump_report(_path);
+}
+
 QueueFamilyIndices DeviceSelector::PhysicalDeviceInfo::get_queue_families(const Borrowed<Window>& _window, const vk::PhysicalDevice _device) const {
 	QueueFamilyIndices indices;
 
 	auto queue_families_ = _device.getQueueFamilyProperties();
+	const auto family_count = cast<u32>(queue_families_.size());
 
-	u32 i = 0;
-	for (const auto& queueFamily : queue_families_) {
-		u32 this_family_count = 0;
-		VERBOSE(std::fmt("Queue(%i): %s", i, to_string(queueFamily.queueFlags).data()));
-
-		if (queueFamily.queueCount <= 0) {
-			++i;
-			continue; // Skip families with no queues
-		}
+	std::vector<b8> present_support(family_count, false);
+	for (u32 i = 0; i < family_count; ++i) {
+		VERBOSE(std::fmt("Queue(%i): %s x%u", i, to_string(queue_families_[i].queueFlags).data(), queue_families_[i].queueCount));
+		auto [result, is_present_supported] = _device.getSurfaceSupportKHR(i, _window->surface);
+		present_support[i] = !failed(result) && is_present_supported;
+	}
 
-		if (!indices.has_graphics() && (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)) {
-			if (queueFamily.queueCount > this_family_count) {
-				indices.graphics_idx = i;
-				++this_family_count;
-			} else {
-				continue;
-			}
-		}
-
-		if (!indices.has_compute() && (queueFamily.queueFlags & vk::QueueFlagBits::eCompute)) {
-			if (queueFamily.queueCount > this_family_count) {
-				indices.compute_idx = i;
-				++this_family_count;
-			} else {
-				continue;
-			}
+	// First family with all of `_required` and none of `_excluded`.
+	const auto find_family = [&queue_families_, family_count](const vk::QueueFlags _required, const vk::QueueFlags _excluded) {
+		for (u32 i = 0; i < family_count; ++i) {
+			const auto& family_ = queue_families_[i];
+			if (family_.queueCount == 0) continue; // Skip families with no queues
+			if ((family_.queueFlags & _required) != _required || (family_.queueFlags & _excluded)) continue;
+			return i;
 		}
+		return QueueFamilyIndices::invalid_value;
+	};
 
-		if (!indices.has_transfer() && (queueFamily.queueFlags & vk::QueueFlagBits::eTransfer)) {
-			if (queueFamily.queueCount > this_family_count) {
-				indices.transfer_idx = i;
-				++this_family_count;
-			} else {
-				continue;
-			}
+	// Prefer a graphics family that can also present.
+	for (u32 i = 0; i < family_count; ++i) {
+		if (queue_families_[i].queueCount > 0 && (queue_families_[i].queueFlags & vk::QueueFlagBits::eGraphics) && present_support[i]) {
+			indices.graphics_idx = i;
+			break;
 		}
+	}
+	if (!indices.has_graphics()) {
+		indices.graphics_idx = find_family(vk::QueueFlagBits::eGraphics, {});
+	}
 
-		auto [result, is_present_supported] = _device.getSurfaceSupportKHR(i, _window->surface);
-		if (!indices.has_present() && !failed(result) && is_present_supported) {
-			if (queueFamily.queueCount > this_family_count) {
+	if (indices.has_graphics() && present_support[indices.graphics_idx]) {
+		indices.present_idx = indices.graphics_idx;
+	} else {
+		for (u32 i = 0; i < family_count; ++i) {
+			if (queue_families_[i].queueCount > 0 && present_support[i]) {
 				indices.present_idx = i;
-				++this_family_count;
-			} else {
-				continue;
+				break;
 			}
 		}
+	}
+
+	// Dedicated families map to separate hardware queues; fall back to sharing with graphics.
+	indices.compute_idx = find_family(vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics);
+	if (!indices.has_compute()) {
+		indices.compute_idx = indices.has_graphics() && (queue_families_[indices.graphics_idx].queueFlags & vk::QueueFlagBits::eCompute)
+			                      ? indices.graphics_idx
+			                      : find_family(vk::QueueFlagBits::eCompute, {});
+	}
 
-		++i;
+	// Graphics and compute families support transfer implicitly, so they are valid fallbacks.
+	indices.transfer_idx = find_family(vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute);
+	if (!indices.has_transfer()) {
+		indices.transfer_idx = indices.has_async_compute() ? indices.compute_idx : indices.graphics_idx;
 	}
 
 	return indices;
@@ -11,7 +11,17 @@
 #include <core/window.h>
 #include <core/buffer.h>
 #include <core/image.h>
-
+#include <core/staging_ring.h>
+#include <core/uniform_ring.h>
+#include <core/queue_ownership.h>
+#include <core/memory_tracker.h>
+#include <core/upload_batcher.h>
+#include <core/sync_pool.h>
+#include <core/command_allocator.h>
+#include <core/bindless_heap.h>
+
+#include <deque>
+#include <functional>
 #include <span>
 #include <string_view>
 
@@ -44,6 +54,29 @@ struct QueueFamilyIndices {
 	b8 has_transfer() const {
 		return transfer_idx != invalid_value;
 	}
+
+	/**
+	 * Compute runs on a different family than graphics, so the two can overlap.
+	 */
+	[[nodiscard]]
+	b8 has_async_compute() const {
+		return has_compute() && compute_idx != graphics_idx;
+	}
+
+	[[nodiscard]]
+	b8 has_dedicated_transfer() const {
+		return has_transfer() && transfer_idx != graphics_idx && transfer_idx != compute_idx;
+	}
+
+	/**
+	 * Families a resource read by both graphics and async compute every frame is shared between,
+	 * so it needs no ownership transfers. Empty when compute runs on the graphics family.
+	 */
+	[[nodiscard]]
+	std::vector<u32> async_compute_families() const {
+		if (!has_async_compute()) return {};
+		return { graphics_idx, compute_idx };
+	}
 };
 
 struct Queues {
@@ -53,6 +86,41 @@ struct Queues {
 	Option<vk::Queue> compute;
 };
 
+/**
+ * Timeline semaphore signalled by every submission to a queue.
+ * Submissions are numbered in order, so a single counter value retires everything up to it.
+ */
+struct QueueTimeline {
+	vk::Queue queue;
+	u32 family{ QueueFamilyIndices::invalid_value };
+	vk::Semaphore semaphore;
+	u64 next_value{ 1 };
+	u64 completed_value{ 0 };
+	std::deque<std::pair<u64, std::function<void()>>> deferred;
+};
+
+/**
+ * Make a submission wait until `queue` reaches `value` before `stage`.
+ */
+struct TimelineWait {
+	vk::Queue queue;
+	u64 value{};
+	vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eAllCommands;
+};
+
+/**
+ * Optional device extensions. Each is enabled when the physical device supports it.
+ */
+struct OptionalExtensions {
+	b8 memory_budget{ false };
+	b8 pipeline_creation_feedback{ false };
+	// Also needs headers new enough to know VK_EXT_graphics_pipeline_library.
+	b8 graphics_pipeline_library{ false };
+	b8 pipeline_executable_properties{ false };
+	// Core in 1.2, but only some devices have the update-after-bind features the bindless heap needs.
+	b8 descriptor_indexing{ false };
+};
+
 template <typename T>
 struct SubmitTask;
 
@@ -62,27 +130,56 @@ public:
 		vk::PhysicalDevice device;
 		vk::PhysicalDeviceProperties properties;
 		vk::PhysicalDeviceFeatures features;
+		vk::PhysicalDeviceVulkan12Features features12;
+		vk::PhysicalDeviceMemoryProperties memory_properties;
 		QueueFamilyIndices queue_families;
 
 		PhysicalDeviceInfo(const Borrowed<Window>& _window, const vk::PhysicalDevice _device) : device(_device) {
 			properties = device.getProperties();
-			features = device.getFeatures();
+			const auto feature_chain = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+			features = feature_chain.get<vk::PhysicalDeviceFeatures2>().features;
+			features12 = feature_chain.get<vk::PhysicalDeviceVulkan12Features>();
+			features12.pNext = nullptr;
+			memory_properties = device.getMemoryProperties();
 			queue_families = get_queue_families(_window, device);
 		}
 
+		/**
+		 * True when every device local memory type is also host visible, as on integrated GPUs and
+		 * software rasterizers. Device local buffers can then be written in place instead of staged.
+		 */
+		[[nodiscard]]
+		b8 is_unified_memory() const {
+			b8 has_device_local = false;
+			for (u32 i = 0; i < memory_properties.memoryTypeCount; ++i) {
+				const auto flags = memory_properties.memoryTypes[i].propertyFlags;
+				if (!(flags & vk::MemoryPropertyFlagBits::eDeviceLocal)) continue;
+				if (!(flags & vk::MemoryPropertyFlagBits::eHostVisible)) return false;
+				has_device_local = true;
+			}
+			return has_device_local;
+		}
+
 	private:
 		[[nodiscard]] QueueFamilyIndices get_queue_families(const Borrowed<Window>& _window, vk::PhysicalDevice _device) const;
 	};
 
 
-	Device(const std::string_view& _name, const Borrowed<Context>& _parent_context, PhysicalDeviceInfo _physical_device_info, const vk::Device& _device, const Queues& _queues, const vma::Allocator& _allocator, const vk::CommandPool& _transfer_cmd_pool, const vk::CommandPool& _graphics_cmd_pool)
+	Device(const std::string_view& _name, const Borrowed<Context>& _parent_context, PhysicalDeviceInfo _physical_device_info, const vk::Device& _device, const Queues& _queues, const OptionalExtensions& _extensions, const vma::Allocator& _allocator, StagingRing&& _staging_ring, UploadBatcher&& _uploads, UniformRing&& _uniforms, std::vector<QueueTimeline>&& _timelines)
 		: parent_context(_parent_context)
 		, physical_device(std::move(_physical_device_info))
 		, device(_device)
 		, queues(_queues)
+		, extensions(_extensions)
+		, timelines(std::move(_timelines))
 		, allocator(_allocator)
-		, transfer_cmd_pool(_transfer_cmd_pool)
-		, graphics_cmd_pool(_graphics_cmd_pool)
+		, memory(_allocator, _extensions.memory_budget)
+		, commands(_device, CommandAllocator::default_frames_in_flight)
+		, staging_ring(std::move(_staging_ring))
+		, uploads(std::move(_uploads))
+		, uniforms(std::move(_uniforms))
+		, fence_pool(_device)
+		, semaphore_pool(_device)
 		, name(_name) {}
 
 	Device(const Device& _other) = delete;
@@ -90,7 +187,7 @@ public:
 	Device& operator=(const Device& _other) = delete;
 	Device& operator=(Device&& _other) noexcept;
 
-	static Res<Device> create(const std::string_view& _name, Borrowed<Context>&& _context, const PhysicalDeviceInfo& _physical_device_info, const vk::PhysicalDeviceFeatures& _enabled_features);
+	static Res<Device> create(const std::string_view& _name, Borrowed<Context>&& _context, const PhysicalDeviceInfo& _physical_device_info, const vk::PhysicalDeviceFeatures& _enabled_features, const vk::PhysicalDeviceVulkan12Features& _enabled_features12 = {}, usize _staging_ring_capacity = StagingRing::default_capacity, usize _uniform_frame_capacity = UniformRing::default_frame_capacity);
 
 	~Device();
 
@@ -104,42 +201,145 @@ public:
 		WARN_IF(failed(result), "Debug Utils name setting failed with "s + to_string(result));
 	}
 
+	/**
+	 * Fetch a command buffer for `_queue` from the calling thread's pool. It is recycled with its frame, never freed.
+	 */
+	[[nodiscard]]
+	Res<vk::CommandBuffer> alloc_temp_command_buffer(vk::Queue _queue);
+
+	/**
+	 * Close the current frame and recycle the command pools and uniform ring segment of the frame slot being reused.
+	 * Blocks until the last submissions made during that slot retire.
+	 */
+	[[nodiscard]]
+	Res<> begin_frame();
+
+	/**
+	 * Submit `_cmd` to `_queue`, signalling the queue's timeline. Returns the timeline value the work completes at.
+	 * Flushes the uniform ring first so constants pushed this frame are visible.
+	 * `_wait_timelines` orders the work after other queues without extra binary semaphores.
+	 */
+	[[nodiscard]]
+	Res<u64> submit(vk::Queue _queue, const std::vector<vk::CommandBuffer>& _cmd, const std::vector<vk::Semaphore>& _wait_on = {}, const vk::PipelineStageFlags& _wait_stage = vk::PipelineStageFlagBits::eBottomOfPipe, const std::vector<vk::Semaphore>& _signal_to = {}, vk::Fence _fence = {}, const std::vector<TimelineWait>& _wait_timelines = {});
+
+	[[nodiscard]]
+	b8 is_complete(vk::Queue _queue, u64 _value);
+
+	/**
+	 * Wait until `_queue` reaches `_value`. Fails with vk::Result::eTimeout if `_timeout` ns pass first.
+	 */
+	[[nodiscard]]
+	Res<> wait(vk::Queue _queue, u64 _value, u64 _timeout = max_value<u64>);
+
+	/**
+	 * Run `_callback` once `_queue` reaches `_value`. Runs immediately if it already has.
+	 */
+	void then(vk::Queue _queue, u64 _value, std::function<void()>&& _callback);
+
+	/**
+	 * Query every timeline once, run ready callbacks, and reclaim finished upload staging.
+	 */
+	void retire();
+
 	[[nodiscard]]
-	Res<vk::CommandBuffer> alloc_temp_command_buffer(vk::CommandPool _pool) const;
+	QueueTimeline& timeline(vk::Queue _queue);
 
+	/**
+	 * Ownership transfer from the family of `_src` to that of `_dst`. Stages and access masks are left to the caller.
+	 */
+	[[nodiscard]]
+	QueueOwnershipTransfer ownership_transfer(vk::Queue _src, vk::Queue _dst);
+
+	/**
+	 * Return a sync object to its pool once `_queue` reaches `_value`.
+	 */
+	void recycle_after(vk::Queue _queue, u64 _value, vk::Semaphore _semaphore);
+	void recycle_after(vk::Queue _queue, u64 _value, vk::Fence _fence);
+
+	/**
+	 * Copies on the transfer queue. If that is on another family than the graphics queue, ownership is
+	 * released to graphics and the consumer must record the matching acquire from
+	 * `ownership_transfer(queues.transfer, queues.graphics)` after waiting on the task.
+	 */
 	[[nodiscard]] Res<SubmitTask<Buffer>> upload_data(const Borrowed<Buffer>& _host_buffer, Buffer&& _staging_buffer);
+	/**
+	 * Host visible destinations (device local memory on unified memory devices) are written in place,
+	 * and the returned task is already complete. Staged copies are released to graphics as above.
+	 */
 	[[nodiscard]] Res<SubmitTask<Buffer>> upload_data(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data);
-	Res<> update_data(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data) const;
+	Res<> update_data(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data, vk::DeviceSize _offset = 0) const;
+
+	/**
+	 * Stage `_data` and record its copy into the open upload batch. Nothing is submitted until `flush_uploads`.
+	 * `_consumer` defaults to the graphics queue. If it is on another family than the transfer queue, ownership is released to it and the consumer
+	 * must record the matching acquire from `ownership_transfer(queues.transfer, _consumer)` after the upload.
+	 * Host visible buffers are written in place instead. The returned ticket is then empty and always complete,
+	 * and no acquire must be recorded.
+	 */
+	[[nodiscard]] Res<UploadTicket> queue_upload(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data, vk::DeviceSize _dst_offset = 0, vk::Queue _consumer = {});
+	/**
+	 * Uploads mip 0 of every layer. `_data` must hold exactly that many texels and only level 0 is moved to `_final_layout`.
+	 * Further mips stay undefined; the caller fills or generates them.
+	 */
+	[[nodiscard]] Res<UploadTicket> queue_upload(const Borrowed<Image>& _image, const std::span<u8>& _data, vk::ImageLayout _final_layout = vk::ImageLayout::eShaderReadOnlyOptimal, vk::Queue _consumer = {});
+	Res<> flush_uploads();
+	/**
+	 * Tickets of a batch whose submission failed never complete, and waiting on them fails.
+	 */
+	[[nodiscard]] b8 is_upload_complete(const UploadTicket& _ticket);
+	Res<> wait_upload(const UploadTicket& _ticket);
+
+	/**
+	 * Write per-category, per-heap and detailed allocator statistics as JSON.
+	 */
+	[[nodiscard]] Res<> dump_memory_report(const std::string_view& _path = "memory_report.json") const;
 
 	// fields
 	Borrowed<Context> parent_context;
 	PhysicalDeviceInfo physical_device;
 	vk::Device device;
 	Queues queues;
+	OptionalExtensions extensions;
+	std::vector<QueueTimeline> timelines;
 	vma::Allocator allocator;
+	MemoryTracker memory;
+
+	CommandAllocator commands;
+
+	// Uploads up to the ring capacity are staged here; larger ones get a dedicated buffer.
+	StagingRing staging_ring;
+	UploadBatcher uploads;
+
+	// Per-frame constants, bound through dynamic uniform buffer descriptors.
+	UniformRing uniforms;
 
-	vk::CommandPool transfer_cmd_pool;
-	vk::CommandPool graphics_cmd_pool;
+	// Invalid unless the device supports descriptor indexing.
+	BindlessHeap bindless;
+
+	FencePool fence_pool;
+	SemaphorePool semaphore_pool;
 
 	std::string name;
 
 private:
 	void set_name(const std::string_view& _name);
+	[[nodiscard]] Res<> write_direct(const Borrowed<Buffer>& _host_buffer, const std::span<u8>& _data, vk::DeviceSize _offset);
+	[[nodiscard]] Res<StagingRing::Slice> stage_upload(const std::string& _name, const std::span<u8>& _data, usize _alignment);
+	[[nodiscard]] Res<vk::CommandBuffer> record_upload_copy(const std::string_view& _name, vk::Buffer _src, vk::DeviceSize _src_offset, vk::Buffer _dst, vk::DeviceSize _size);
 };
 
 template <typename T = void>
 struct SubmitTask {
-	vk::Fence fence;
 	Borrowed<Device> device{};
+	vk::Queue queue;
+	u64 value{ 0 };
 	T payload;
-	std::vector<vk::CommandBuffer> cmd;
-	vk::CommandPool pool;
 
 	[[nodiscard]]
-	static Res<SubmitTask<T>> create(const Borrowed<Device>& _device, T&& _payload, vk::Queue _queue, vk::CommandPool _pool, const std::vector<vk::CommandBuffer>& _cmd, const std::vector<vk::Semaphore>& _wait_on = {}, const std::vector<vk::Semaphore>& _signal_to = {}) {
+	static Res<SubmitTask<T>> create(const Borrowed<Device>& _device, T&& _payload, vk::Queue _queue, const std::vector<vk::CommandBuffer>& _cmd, const std::vector<vk::Semaphore>& _wait_on = {}, const std::vector<vk::Semaphore>& _signal_to = {}) {
 
 		SubmitTask<T> task;
-		if (auto res = task.submit(_device, std::forward<T>(_payload), _queue, _pool, _cmd, _wait_on, _signal_to)) {
+		if (auto res = task.submit(_device, std::forward<T>(_payload), _queue, _cmd, _wait_on, _signal_to)) {
 			return std::move(task);
 		} else {
 			return Err::make(std::move(res.error()));
@@ -147,68 +347,81 @@ struct SubmitTask {
 	}
 
 	[[nodiscard]]
-	Res<> submit(const Borrowed<Device>& _device, T&& _payload, vk::Queue _queue, vk::CommandPool _pool, std::vector<vk::CommandBuffer> _cmd, std::vector<vk::Semaphore> _wait_on = {}, std::vector<vk::Semaphore> _signal_to = {}) {
+	Res<> submit(const Borrowed<Device>& _device, T&& _payload, vk::Queue _queue, const std::vector<vk::CommandBuffer>& _cmd, const std::vector<vk::Semaphore>& _wait_on = {}, const std::vector<vk::Semaphore>& _signal_to = {}) {
 		device = _device;
-		auto [result, _fence] = device->device.createFence({});
-		if (failed(result)) {
-			return Err::make(std::fmt("Fence creation failed with %s" CODE_LOC, to_cstr(result)), result);
-		}
-		fence = _fence;
+		queue = _queue;
 		payload = std::move(_payload);
-		cmd = _cmd;
-		pool = _pool;
-
-		result = _queue.submit({
-				{
-					.waitSemaphoreCount = cast<u32>(_wait_on.size()),
-					.pWaitSemaphores = _wait_on.data(),
-					.commandBufferCount = cast<u32>(_cmd.size()),
-					.pCommandBuffers = _cmd.data(),
-					.signalSemaphoreCount = cast<u32>(_signal_to.size()),
-					.pSignalSemaphores = _signal_to.data(),
-				}
-			},
-			_fence);
-		if (failed(result)) {
-			return Err::make(std::fmt("Submit failed with %s" CODE_LOC, to_cstr(result)), result);
-		}
 
+		auto res = device->submit(queue, _cmd, _wait_on, vk::PipelineStageFlagBits::eBottomOfPipe, _signal_to);
+		if (!res) {
+			return Err::make(std::move(res.error()));
+		}
+		value = res.value();
 		return {};
 	}
 
+	[[nodiscard]]
+	b8 is_complete() {
+		return device->is_complete(queue, value);
+	}
+
+	[[nodiscard]]
+	Res<> wait(const u64 _timeout = max_value<u64>) {
+		return device->wait(queue, value, _timeout);
+	}
+
+	/**
+	 * Run `_callback` once the submission retires.
+	 */
+	void then(std::function<void()>&& _callback) {
+		device->then(queue, value, std::move(_callback));
+	}
+
 	[[nodiscard]]
 	Res<> wait_and_destroy() {
 		return this->destroy();
 	}
 
+	/**
+	 * Command buffers are recycled with their frame, so this only waits.
+	 */
 	[[nodiscard]]
 	Res<> destroy() {
-		const auto result = device->device.waitForFences({ fence }, true, max_value<u64>);
-		if (failed(result)) return Err::make(std::fmt("Fence wait failed with %s" CODE_LOC, to_cstr(result)), result);
-		device->device.destroyFence(fence);
-		device->device.freeCommandBuffers(pool, cast<u32>(cmd.size()), cmd.data());
-		return {};
+		return wait();
 	}
 };
 
 template <>
 struct SubmitTask<void> {
-	vk::Fence fence;
 	Borrowed<Device> device;
-	std::vector<vk::CommandBuffer> cmd;
-	vk::CommandPool pool;
+	vk::Queue queue;
+	u64 value{ 0 };
 
 	[[nodiscard]]
-	static Res<SubmitTask<>> create(const Borrowed<Device>& _device, vk::Queue _queue, vk::CommandPool _pool, const std::vector<vk::CommandBuffer>& _cmd, const std::vector<vk::Semaphore>& _wait_on = {}, const vk::PipelineStageFlags& _wait_stage = vk::PipelineStageFlagBits::eBottomOfPipe, const std::vector<vk::Semaphore>& _signal_to = {}) {
+	static Res<SubmitTask<>> create(const Borrowed<Device>& _device, vk::Queue _queue, const std::vector<vk::CommandBuffer>& _cmd, const std::vector<vk::Semaphore>& _wait_on = {}, const vk::PipelineStageFlags& _wait_stage = vk::PipelineStageFlagBits::eBottomOfPipe, const std::vector<vk::Semaphore>& _signal_to = {}) {
 
 		SubmitTask<> task;
-		if (auto res = task.submit(_device, _queue, _pool, _cmd, _wait_on, _wait_stage, _signal_to)) {
+		if (auto res = task.submit(_device, _queue, _cmd, _wait_on, _wait_stage, _signal_to)) {
 			return std::move(task);
 		} else {
 			return Err::make(std::move(res.error()));
 		}
 	}
 
+	[[nodiscard]]
+	b8 is_complete() {
+		return device->is_complete(queue, value);
+	}
+
+	[[nodiscard]]
+	Res<> wait(const u64 _timeout = max_value<u64>) {
+		return device->wait(queue, value, _timeout);
+	}
+
+	void then(std::function<void()>&& _callback) {
+		device->then(queue, value, std::move(_callback));
+	}
+
 	[[nodiscard]]
 	Res<> wait_and_destroy() {
 		return this->destroy();
@@ -216,40 +429,21 @@ struct SubmitTask<void> {
 
 	[[nodiscard]]
 	Res<> destroy() {
-		const auto result = device->device.waitForFences({ fence }, true, max_value<u64>);
-		if (failed(result)) return Err::make(std::fmt("Fence wait failed with %s", to_cstr(result)), result);
-		device->device.destroyFence(fence);
-		device->device.freeCommandBuffers(pool, cast<u32>(cmd.size()), cmd.data());
-		return {};
+		return wait();
 	}
 
 private:
 	[[nodiscard]]
-	Res<> submit(const Borrowed<Device>& _device, vk::Queue _queue, vk::CommandPool _pool, std::vector<vk::CommandBuffer> _cmd, std::vector<vk::Semaphore> _wait_on = {},
-	             const vk::PipelineStageFlags& _wait_stage = vk::PipelineStageFlagBits::eBottomOfPipe, std::vector<vk::Semaphore> _signal_to = {}) {
+	Res<> submit(const Borrowed<Device>& _device, vk::Queue _queue, const std::vector<vk::CommandBuffer>& _cmd, const std::vector<vk::Semaphore>& _wait_on = {},
+	             const vk::PipelineStageFlags& _wait_stage = vk::PipelineStageFlagBits::eBottomOfPipe, const std::vector<vk::Semaphore>& _signal_to = {}) {
 		device = _device;
-		auto [result, _fence] = device->device.createFence({});
-		if (failed(result)) {
-			return Err::make(std::fmt("Fence creation failed with %s" CODE_LOC, to_cstr(result)), result);
-		}
-		fence = _fence;
-		cmd = _cmd;
-		pool = _pool;
-		result = _queue.submit({
-				vk::SubmitInfo{
-					.waitSemaphoreCount = cast<u32>(_wait_on.size()),
-					.pWaitSemaphores = _wait_on.data(),
-					.pWaitDstStageMask = &_wait_stage,
-					.commandBufferCount = cast<u32>(_cmd.size()),
-					.pCommandBuffers = _cmd.data(),
-					.signalSemaphoreCount = cast<u32>(_signal_to.size()),
-					.pSignalSemaphores = _signal_to.data(),
-				} },
-			_fence);
-		if (failed(result)) {
-			return Err::make(std::fmt("Submit failed with %s" CODE_LOC, to_cstr(result)), result);
-		}
+		queue = _queue;
 
+		auto res = device->submit(queue, _cmd, _wait_on, _wait_stage, _signal_to);
+		if (!res) {
+			return Err::make(std::move(res.error()));
+		}
+		value = res.value();
 		return {};
 	}
 };
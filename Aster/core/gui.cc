@@ -123,7 +123,8 @@ namespace ImGui {
 		};
 		ImGui_ImplVulkan_Init(&init_info, renderpass);
 
-		auto cmd = device_->alloc_temp_command_buffer(device_->transfer_cmd_pool);
+		// The font upload barriers use graphics stages, which a dedicated transfer family can not execute.
+		auto cmd = device_->alloc_temp_command_buffer(device_->queues.graphics);
 		ERROR_IF(!cmd, std::fmt("Could not allocate temporary command buffer\n|> %s", cmd.error().what())) THEN_CRASH(cmd.error().code());
 		result = cmd->begin(vk::CommandBufferBeginInfo{ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
 
@@ -132,7 +133,7 @@ namespace ImGui {
 		result = cmd->end();
 		ERROR_IF(failed(result), std::fmt("Cmd buffer end failed with %s", to_cstr(result))) THEN_CRASH(result);
 
-		auto task = SubmitTask<void>::create(device_, device_->queues.transfer, device_->transfer_cmd_pool, { cmd.value() });
+		auto task = SubmitTask<void>::create(device_, device_->queues.graphics, { cmd.value() });
 		ERROR_IF(!task, std::fmt("Fonts could not be loaded to GPU with %s", task.error().what())) THEN_CRASH(task.error().code());
 
 		framebuffers.reserve(_swapchain->image_count);
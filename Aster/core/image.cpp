@@ -6,7 +6,75 @@
 #include "image.h"
 #include <core/device.h>
 
-Image::Image(const Borrowed<Device>& _parent_device, const vk::Image& _image, const vma::Allocation& _allocation, const vk::ImageUsageFlags& _usage, vma::MemoryUsage _memory_usage, usize _size, const std::string& _name, vk::ImageType _type, vk::Format _format, const vk::Extent3D& _extent, u32 _layer_count, u32 _mip_count): parent_device(_parent_device)
+usize texel_size(const vk::Format _format) {
+	switch (_format) {
+	case vk::Format::eR8Unorm:
+	case vk::Format::eR8Snorm:
+	case vk::Format::eR8Uint:
+	case vk::Format::eR8Sint:
+	case vk::Format::eR8Srgb:
+		return 1;
+	case vk::Format::eR8G8Unorm:
+	case vk::Format::eR8G8Snorm:
+	case vk::Format::eR8G8Uint:
+	case vk::Format::eR8G8Sint:
+	case vk::Format::eR8G8Srgb:
+	case vk::Format::eR16Unorm:
+	case vk::Format::eR16Snorm:
+	case vk::Format::eR16Uint:
+	case vk::Format::eR16Sint:
+	case vk::Format::eR16Sfloat:
+		return 2;
+	case vk::Format::eR8G8B8Unorm:
+	case vk::Format::eR8G8B8Srgb:
+	case vk::Format::eB8G8R8Unorm:
+	case vk::Format::eB8G8R8Srgb:
+		return 3;
+	case vk::Format::eR8G8B8A8Unorm:
+	case vk::Format::eR8G8B8A8Snorm:
+	case vk::Format::eR8G8B8A8Uint:
+	case vk::Format::eR8G8B8A8Sint:
+	case vk::Format::eR8G8B8A8Srgb:
+	case vk::Format::eB8G8R8A8Unorm:
+	case vk::Format::eB8G8R8A8Srgb:
+	case vk::Format::eA2B10G10R10UnormPack32:
+	case vk::Format::eB10G11R11UfloatPack32:
+	case vk::Format::eE5B9G9R9UfloatPack32:
+	case vk::Format::eR16G16Unorm:
+	case vk::Format::eR16G16Snorm:
+	case vk::Format::eR16G16Uint:
+	case vk::Format::eR16G16Sint:
+	case vk::Format::eR16G16Sfloat:
+	case vk::Format::eR32Uint:
+	case vk::Format::eR32Sint:
+	case vk::Format::eR32Sfloat:
+		return 4;
+	case vk::Format::eR16G16B16Unorm:
+	case vk::Format::eR16G16B16Sfloat:
+		return 6;
+	case vk::Format::eR16G16B16A16Unorm:
+	case vk::Format::eR16G16B16A16Snorm:
+	case vk::Format::eR16G16B16A16Uint:
+	case vk::Format::eR16G16B16A16Sint:
+	case vk::Format::eR16G16B16A16Sfloat:
+	case vk::Format::eR32G32Uint:
+	case vk::Format::eR32G32Sint:
+	case vk::Format::eR32G32Sfloat:
+		return 8;
+	case vk::Format::eR32G32B32Uint:
+	case vk::Format::eR32G32B32Sint:
+	case vk::Format::eR32G32B32Sfloat:
+		return 12;
+	case vk::Format::eR32G32B32A32Uint:
+	case vk::Format::eR32G32B32A32Sint:
+	case vk::Format::eR32G32B32A32Sfloat:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+Image::Image(const Borrowed<Device>& _parent_device, const vk::Image& _image, const vma::Allocation& _allocation, const vk::ImageUsageFlags& _usage, vma::MemoryUsage _memory_usage, usize _size, const std::string& _name, vk::ImageType _type, vk::Format _format, const vk::Extent3D& _extent, u32 _layer_count, u32 _mip_count, MemoryCategory _category): parent_device(_parent_device)
                                                                                                                                                                                                                                                                                                                                    , image(_image)
                                                                                                                                                                                                                                                                                                                                    , allocation(_allocation)
                                                                                                                                                                                                                                                                                                                                    , usage(_usage)
@@ -17,7 +85,8 @@ Image::Image(const Borrowed<Device>& _parent_device, const vk::Image& _image, co
                                                                                                                                                                                                                                                                                                                                    , format(_format)
                                                                                                                                                                                                                                                                                                                                    , extent(_extent)
                                                                                                                                                                                                                                                                                                                                    , layer_count(_layer_count)
-                                                                                                                                                                                                                                                                                                                                   , mip_count(_mip_count) {}
+                                                                                                                                                                                                                                                                                                                                   , mip_count(_mip_count)
+                                                                                                                                                                                                                                                                                                                                   , category(_category) {}
 
 Image::Image(Image&& _other) noexcept: parent_device{ std::move(_other.parent_device) }
                                      , image{ std::exchange(_other.image, nullptr) }
@@ -30,7 +99,8 @@ Image::Image(Image&& _other) noexcept: parent_device{ std::move(_other.parent_de
                                      , format{ _other.format }
                                      , extent{ _other.extent }
                                      , layer_count{ _other.layer_count }
-                                     , mip_count{ _other.mip_count } {}
+                                     , mip_count{ _other.mip_count }
+                                     , category{ _other.category } {}
 
 Image& Image::operator=(Image&& _other) noexcept {
 	if (this == &_other) return *this;
@@ -39,18 +109,22 @@ Image& Image::operator=(Image&& _other) noexcept {
 	std::swap(allocation, _other.allocation);
 	usage = _other.usage;
 	memory_usage = _other.memory_usage;
-	size = _other.size;
+	std::swap(size, _other.size);
 	name = std::move(_other.name);
 	type = _other.type;
 	format = _other.format;
 	extent = _other.extent;
 	layer_count = _other.layer_count;
 	mip_count = _other.mip_count;
+	std::swap(category, _other.category);
 	return *this;
 }
 
-Res<Image> Image::create(const std::string_view& _name, const Borrowed<Device>& _device, vk::ImageType _image_type, vk::Format _format, const vk::Extent3D& _extent, vk::ImageUsageFlags _usage, u32 _mip_count, vma::MemoryUsage _memory_usage, u32 _layer_count) {
+Res<Image> Image::create(const std::string_view& _name, const Borrowed<Device>& _device, vk::ImageType _image_type, vk::Format _format, const vk::Extent3D& _extent, vk::ImageUsageFlags _usage, u32 _mip_count, vma::MemoryUsage _memory_usage, u32 _layer_count, MemoryCategory _category, const std::vector<u32>& _shared_families) {
+
+	auto allocation_name = std::fmt("[%s] %s", to_cstr(_category), _name.data());
 
+	vma::AllocationInfo allocation_info;
 	auto [result, image] = _device->allocator.createImage({
 		.imageType = _image_type,
 		.format = _format,
@@ -60,17 +134,22 @@ Res<Image> Image::create(const std::string_view& _name, const Borrowed<Device>&
 		.samples = vk::SampleCountFlagBits::e1,
 		.tiling = vk::ImageTiling::eOptimal,
 		.usage = _usage,
-		.sharingMode = vk::SharingMode::eExclusive,
+		.sharingMode = _shared_families.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+		.queueFamilyIndexCount = cast<u32>(_shared_families.size()),
+		.pQueueFamilyIndices = _shared_families.data(),
 		.initialLayout = vk::ImageLayout::eUndefined,
 	}, {
+		.flags = vma::AllocationCreateFlagBits::eUserDataCopyString,
 		.usage = _memory_usage,
-	});
+		.pUserData = allocation_name.data(),
+	}, allocation_info);
 
 	if (failed(result)) {
 		return Err::make(std::fmt("Image %s creation failed with %s" CODE_LOC, _name.data(), to_cstr(result)), result);
 	}
 
 	_device->set_object_name(image.first, _name);
+	_device->memory.track(_category, allocation_info.size);
 
 	return Image{
 		_device,
@@ -78,18 +157,20 @@ Res<Image> Image::create(const std::string_view& _name, const Borrowed<Device>&
 		image.second,
 		_usage,
 		_memory_usage,
-		0,
+		allocation_info.size,
 		std::string{ _name },
 		_image_type,
 		_format,
 		_extent,
 		_layer_count,
 		_mip_count,
+		_category,
 	};
 }
 
 Image::~Image() {
 	if (image && allocation) {
 		parent_device->allocator.destroyImage(image, allocation);
+		parent_device->memory.untrack(category, size);
 	}
 }
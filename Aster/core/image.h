@@ -5,9 +5,15 @@
 
 #pragma once
 #include <global.h>
+#include <core/memory_tracker.h>
 
 class Device;
 
+/**
+ * Bytes per texel of uncompressed color formats. Returns 0 for block compressed, depth/stencil and unknown formats.
+ */
+usize texel_size(vk::Format _format);
+
 struct Image {
 	Borrowed<Device> parent_device;
 	vk::Image image;
@@ -23,16 +29,21 @@ struct Image {
 	u32 layer_count{};
 	u32 mip_count{};
 
+	MemoryCategory category = MemoryCategory::eGeneric;
+
 	Image() = default;
 
-	Image(const Borrowed<Device>& _parent_device, const vk::Image& _image, const vma::Allocation& _allocation, const vk::ImageUsageFlags& _usage, vma::MemoryUsage _memory_usage, usize _size, const std::string& _name, vk::ImageType _type, vk::Format _format, const vk::Extent3D& _extent, u32 _layer_count, u32 _mip_count);
+	Image(const Borrowed<Device>& _parent_device, const vk::Image& _image, const vma::Allocation& _allocation, const vk::ImageUsageFlags& _usage, vma::MemoryUsage _memory_usage, usize _size, const std::string& _name, vk::ImageType _type, vk::Format _format, const vk::Extent3D& _extent, u32 _layer_count, u32 _mip_count, MemoryCategory _category = MemoryCategory::eGeneric);
 
 	Image(const Image& _other) = delete;
 	Image(Image&& _other) noexcept;
 	Image& operator=(const Image& _other) = delete;
 	Image& operator=(Image&& _other) noexcept;
 
-	static Res<Image> create(const std::string_view& _name, const Borrowed<Device>& _device, vk::ImageType _image_type, vk::Format _format, const vk::Extent3D& _extent, vk::ImageUsageFlags _usage, u32 _mip_count = 1, vma::MemoryUsage _memory_usage = vma::MemoryUsage::eGpuOnly, u32 _layer_count = 1);
+	/**
+	 * With more than one `_shared_families` the image is concurrent between them, otherwise exclusive.
+	 */
+	static Res<Image> create(const std::string_view& _name, const Borrowed<Device>& _device, vk::ImageType _image_type, vk::Format _format, const vk::Extent3D& _extent, vk::ImageUsageFlags _usage, u32 _mip_count = 1, vma::MemoryUsage _memory_usage = vma::MemoryUsage::eGpuOnly, u32 _layer_count = 1, MemoryCategory _category = MemoryCategory::eGeneric, const std::vector<u32>& _shared_families = {});
 
 	~Image();
 };
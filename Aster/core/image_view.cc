@@ -18,7 +18,9 @@ ImageView::ImageView(ImageView&& _other) noexcept: parent_image{ std::move(_othe
                                                  , format{ _other.format }
                                                  , type{ _other.type }
                                                  , subresource_range{ _other.subresource_range }
-                                                 , name{ std::move(_other.name) } {}
+                                                 , name{ std::move(_other.name) }
+                                                 , sampled_index{ std::exchange(_other.sampled_index, BindlessHeap::invalid_index) }
+                                                 , storage_index{ std::exchange(_other.storage_index, BindlessHeap::invalid_index) } {}
 
 ImageView& ImageView::operator=(ImageView&& _other) noexcept {
 	if (this == &_other) return *this;
@@ -28,6 +30,8 @@ ImageView& ImageView::operator=(ImageView&& _other) noexcept {
 	type = _other.type;
 	subresource_range = _other.subresource_range;
 	name = std::move(_other.name);
+	std::swap(sampled_index, _other.sampled_index);
+	std::swap(storage_index, _other.storage_index);
 	return *this;
 }
 
@@ -57,8 +61,39 @@ Res<ImageView> ImageView::create(const Borrowed<Image>& _image, vk::ImageViewTyp
 	};
 }
 
+Res<u32> ImageView::register_sampled(const vk::ImageLayout _layout) {
+	if (sampled_index != BindlessHeap::invalid_index) return sampled_index;
+	if (!(parent_image->usage & vk::ImageUsageFlagBits::eSampled)) {
+		return Err::make(std::fmt("ImageView '%s' is not sampled. Use vk::ImageUsageFlagBits::eSampled during creation" CODE_LOC, name.c_str()));
+	}
+
+	auto index = parent_image->parent_device->bindless.register_sampled_image(image_view, _layout);
+	if (!index) {
+		return Err::make(std::fmt("ImageView '%s' could not be registered" CODE_LOC, name.c_str()), std::move(index.error()));
+	}
+	sampled_index = index.value();
+	return sampled_index;
+}
+
+Res<u32> ImageView::register_storage() {
+	if (storage_index != BindlessHeap::invalid_index) return storage_index;
+	if (!(parent_image->usage & vk::ImageUsageFlagBits::eStorage)) {
+		return Err::make(std::fmt("ImageView '%s' is not storage. Use vk::ImageUsageFlagBits::eStorage during creation" CODE_LOC, name.c_str()));
+	}
+
+	auto index = parent_image->parent_device->bindless.register_storage_image(image_view);
+	if (!index) {
+		return Err::make(std::fmt("ImageView '%s' could not be registered" CODE_LOC, name.c_str()), std::move(index.error()));
+	}
+	storage_index = index.value();
+	return storage_index;
+}
+
 ImageView::~ImageView() {
 	if (image_view) {
+		auto& bindless = parent_image->parent_device->bindless;
+		bindless.release(BindlessHeap::Kind::eSampledImage, sampled_index);
+		bindless.release(BindlessHeap::Kind::eStorageImage, storage_index);
 		parent_image->parent_device->device.destroyImageView(image_view);
 	}
 }
@@ -6,6 +6,7 @@
 #pragma once
 #include <global.h>
 #include <core/image.h>
+#include <core/bindless_heap.h>
 
 struct ImageView {
 	Borrowed<Image> parent_image;
@@ -14,6 +15,9 @@ struct ImageView {
 	vk::ImageViewType type;
 	vk::ImageSubresourceRange subresource_range;
 	std::string name;
+	// Slots in the device's bindless heap, released with the view.
+	u32 sampled_index{ BindlessHeap::invalid_index };
+	u32 storage_index{ BindlessHeap::invalid_index };
 
 	ImageView() = default;
 
@@ -25,5 +29,14 @@ struct ImageView {
 
 	static Res<ImageView> create(const Borrowed<Image>& _image, vk::ImageViewType _image_type, const vk::ImageSubresourceRange& _subresource_range);
 
+	/**
+	 * Register the view in the bindless heap once and return its index. Later calls return the same index.
+	 * Fails unless the image was created with the matching sampled or storage usage.
+	 */
+	[[nodiscard]]
+	Res<u32> register_sampled(vk::ImageLayout _layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+	[[nodiscard]]
+	Res<u32> register_storage();
+
 	~ImageView();
 };
@@ -0,0 +1,91 @@
+// =============================================
+//  Aster: memory_tracker.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "memory_tracker.h"
+
+#include <util/files.h>
+
+void MemoryTracker::track(const MemoryCategory _category, const usize _bytes) const {
+	if (!categories_) return;
+	auto& category = (*categories_)[cast<usize>(_category)];
+	category.allocations.fetch_add(1, std::memory_order_relaxed);
+	const auto bytes = category.bytes.fetch_add(_bytes, std::memory_order_relaxed) + _bytes;
+	auto peak = category.peak_bytes.load(std::memory_order_relaxed);
+	while (peak < bytes && !category.peak_bytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {}
+}
+
+void MemoryTracker::untrack(const MemoryCategory _category, const usize _bytes) const {
+	if (!categories_) return;
+	auto& category = (*categories_)[cast<usize>(_category)];
+
+	// Clamp at zero so a mismatched untrack can not wrap the totals around.
+	auto allocations = category.allocations.load(std::memory_order_relaxed);
+	while (!category.allocations.compare_exchange_weak(allocations, allocations - std::min(allocations, cast<u64>(1)), std::memory_order_relaxed)) {}
+	auto bytes = category.bytes.load(std::memory_order_relaxed);
+	while (!category.bytes.compare_exchange_weak(bytes, bytes - std::min(bytes, _bytes), std::memory_order_relaxed)) {}
+
+	WARN_IF(allocations == 0 || bytes < _bytes, std::fmt("%s memory untracked more than was tracked", to_cstr(_category)));
+}
+
+MemoryTracker::CategoryUsage MemoryTracker::usage(const MemoryCategory _category) const {
+	if (!categories_) return {};
+	const auto& category = (*categories_)[cast<usize>(_category)];
+	return {
+		.allocations = category.allocations.load(std::memory_order_relaxed),
+		.bytes = category.bytes.load(std::memory_order_relaxed),
+		.peak_bytes = category.peak_bytes.load(std::memory_order_relaxed),
+	};
+}
+
+std::vector<MemoryTracker::HeapUsage> MemoryTracker::heap_usage() const {
+	const vk::PhysicalDeviceMemoryProperties* memory_properties = nullptr;
+	vmaGetMemoryProperties(cast<VmaAllocator>(allocator_), recast<const VkPhysicalDeviceMemoryProperties**>(&memory_properties));
+
+	// vmaGetBudget fills one entry per heap, so the wrapper's single-struct overload can not be used.
+	std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+	vmaGetBudget(cast<VmaAllocator>(allocator_), budgets.data());
+
+	std::vector<HeapUsage> heaps(memory_properties->memoryHeapCount);
+	for (u32 i = 0; i < memory_properties->memoryHeapCount; ++i) {
+		heaps[i] = {
+			.flags = memory_properties->memoryHeaps[i].flags,
+			.size = memory_properties->memoryHeaps[i].size,
+			.usage = budgets[i].usage,
+			.budget = budgets[i].budget,
+			.block_bytes = budgets[i].blockBytes,
+			.allocation_bytes = budgets[i].allocationBytes,
+		};
+	}
+	return heaps;
+}
+
+Res<> MemoryTracker::dump_report(const std::string_view& _path) const {
+	std::string report = "{\n\"Categories\": {";
+	for (usize i = 0; i < memory_category_count; ++i) {
+		const auto category_ = usage(cast<MemoryCategory>(i));
+		report += std::fmt("%s\n\t\"%s\": { \"Allocations\": %llu, \"Bytes\": %llu, \"PeakBytes\": %llu }", i ? "," : "", to_cstr(cast<MemoryCategory>(i)), category_.allocations, cast<u64>(category_.bytes), cast<u64>(category_.peak_bytes));
+	}
+	report += "\n},\n";
+
+	report += std::fmt("\"MemoryBudgetExtension\": %s,\n\"Heaps\": [", has_budget_extension ? "true" : "false");
+	const auto heaps = heap_usage();
+	for (usize i = 0; i < heaps.size(); ++i) {
+		const auto& heap_ = heaps[i];
+		report += std::fmt("%s\n\t{ \"Size\": %llu, \"DeviceLocal\": %s, \"Usage\": %llu, \"Budget\": %llu, \"BlockBytes\": %llu, \"AllocationBytes\": %llu }", i ? "," : "", heap_.size, (heap_.flags & vk::MemoryHeapFlagBits::eDeviceLocal) ? "true" : "false", heap_.usage, heap_.budget, heap_.block_bytes, heap_.allocation_bytes);
+	}
+	report += "\n],\n\"Allocator\": ";
+
+	char* stats_string = nullptr;
+	vmaBuildStatsString(cast<VmaAllocator>(allocator_), &stats_string, VK_TRUE);
+	report += stats_string ? stats_string : "null";
+	vmaFreeStatsString(cast<VmaAllocator>(allocator_), stats_string);
+	report += "\n}\n";
+
+	if (!write_text_file(_path, report)) {
+		return Err::make(std::fmt("Memory report could not be written to '%s'" CODE_LOC, _path.data()));
+	}
+	INFO(std::fmt("Memory report written to '%s'", _path.data()));
+	return {};
+}
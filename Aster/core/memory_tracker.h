@@ -0,0 +1,107 @@
+// =============================================
+//  Aster: memory_tracker.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+enum class MemoryCategory : u8 {
+	eGeneric,
+	eStaging,
+	eUniform,
+	eLut,
+	eRenderTarget,
+	eSwapchain,
+};
+
+constexpr usize memory_category_count = 6;
+
+constexpr const char* to_cstr(const MemoryCategory _category) {
+	switch (_category) {
+	case MemoryCategory::eGeneric: return "Generic";
+	case MemoryCategory::eStaging: return "Staging";
+	case MemoryCategory::eUniform: return "Uniform";
+	case MemoryCategory::eLut: return "LUT";
+	case MemoryCategory::eRenderTarget: return "RenderTarget";
+	case MemoryCategory::eSwapchain: return "Swapchain";
+	}
+	return "Unknown";
+}
+
+/**
+ * @class MemoryTracker
+ *
+ * @brief Per-category byte counts on top of the allocator's per-heap budget.
+ *
+ * Buffers and images report the size VMA allocated for them, not the size they asked for, on creation
+ * and destruction. Heap usage and budget come
+ * from VMA, which uses VK_EXT_memory_budget when it is enabled and falls back to its own block
+ * statistics otherwise. Swapchain images are not allocated by us, so their entry is an estimate.
+ * Tracking is bookkeeping only, so it is allowed through const device borrows. Resources are created
+ * from loading threads too, so the counters are atomic.
+ */
+class MemoryTracker {
+public:
+	struct CategoryUsage {
+		u64 allocations{};
+		usize bytes{};
+		usize peak_bytes{};
+	};
+
+	struct HeapUsage {
+		vk::MemoryHeapFlags flags;
+		vk::DeviceSize size{};
+		vk::DeviceSize usage{};
+		vk::DeviceSize budget{};
+		vk::DeviceSize block_bytes{};
+		vk::DeviceSize allocation_bytes{};
+	};
+
+	b8 has_budget_extension{ false };
+
+	MemoryTracker() = default;
+
+	MemoryTracker(const vma::Allocator& _allocator, const b8 _has_budget_extension)
+		: has_budget_extension(_has_budget_extension)
+		, allocator_(_allocator)
+		, categories_(std::make_unique<std::array<Counters, memory_category_count>>()) {}
+
+	void track(MemoryCategory _category, usize _bytes) const;
+	void untrack(MemoryCategory _category, usize _bytes) const;
+
+	/**
+	 * Snapshot of one category's counters, which creating threads bump concurrently.
+	 */
+	[[nodiscard]]
+	CategoryUsage usage(MemoryCategory _category) const;
+
+	/**
+	 * Query the allocator for the current usage and budget of every heap.
+	 */
+	[[nodiscard]]
+	std::vector<HeapUsage> heap_usage() const;
+
+	/**
+	 * Write the category totals, heap budgets, and VMA's detailed JSON statistics to `_path`.
+	 */
+	[[nodiscard]]
+	Res<> dump_report(const std::string_view& _path) const;
+
+private:
+	vma::Allocator allocator_;
+
+	struct Counters {
+		std::atomic<u64> allocations;
+		std::atomic<usize> bytes;
+		std::atomic<usize> peak_bytes;
+	};
+
+	std::unique_ptr<std::array<Counters, memory_category_count>> categories_;
+};
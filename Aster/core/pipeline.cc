@@ -8,6 +8,9 @@
 #include "pipeline.h"
 #include <util/files.h>
 #include <spirv_reflect/spirv_reflect.h>
+#include <bit>
+#include <deque>
+#include <filesystem>
 #include <map>
 
 constexpr const char* to_cstr(SpvReflectResult _result) {
@@ -41,17 +44,125 @@ inline b8 spv_failed(SpvReflectResult _result) {
 	return _result != SPV_REFLECT_RESULT_SUCCESS;
 }
 
-Res<Shader*> PipelineFactory::create_shader_module(const std::string_view& _name) {
+// spirv-reflect does not cover specialization constants, so they are read off the instruction stream.
+Res<std::vector<SpecializationConstantInfo>> reflect_specialization_constants(const std::vector<u32>& _code) {
+	constexpr usize header_words = 5;
 
-	auto hash_key = hash_any(_name);
-	if (shader_map_.contains(hash_key)) {
-		auto& [count, shader] = shader_map_[hash_key];
-		count++;
-		DEBUG(std::fmt("Using cached shader %s", _name.data()));
-		return &shader;
+	std::unordered_map<u32, std::string> names;
+	std::unordered_map<u32, u32> spec_ids;
+	std::unordered_map<u32, SpecializationType> types;
+	std::unordered_map<u32, u32> constant_types;
+
+	for (usize i_ = header_words; i_ < _code.size();) {
+		const auto opcode = _code[i_] & SpvOpCodeMask;
+		const auto word_count = _code[i_] >> SpvWordCountShift;
+		if (word_count == 0 || i_ + word_count > _code.size()) {
+			return Err::make("Spirv instruction stream is malformed" CODE_LOC);
+		}
+		const auto* operands = &_code[i_ + 1];
+
+		switch (opcode) {
+		case SpvOpName:
+			names[operands[0]] = std::string{ recast<const char*>(&operands[1]) };
+			break;
+		case SpvOpDecorate:
+			if (operands[1] == SpvDecorationSpecId) spec_ids[operands[0]] = operands[2];
+			break;
+		case SpvOpTypeBool:
+			types[operands[0]] = SpecializationType::eBool;
+			break;
+		case SpvOpTypeInt:
+			if (operands[1] == 32) types[operands[0]] = operands[2] ? SpecializationType::eInt : SpecializationType::eUint;
+			break;
+		case SpvOpTypeFloat:
+			if (operands[1] == 32) types[operands[0]] = SpecializationType::eFloat;
+			break;
+		case SpvOpSpecConstantTrue:
+		case SpvOpSpecConstantFalse:
+		case SpvOpSpecConstant:
+			constant_types[operands[1]] = operands[0];
+			break;
+		case SpvOpFunction:
+			// Declarations are done once function bodies start.
+			i_ = _code.size();
+			continue;
+		default:
+			break;
+		}
+		i_ += word_count;
+	}
+
+	std::vector<SpecializationConstantInfo> spec_constants;
+	for (const auto& [target_, id_] : spec_ids) {
+		const auto constant = constant_types.find(target_);
+		if (constant == constant_types.end()) continue;
+
+		const auto name = names.contains(target_) ? names[target_] : std::string{};
+		const auto type = types.find(constant->second);
+		if (type == types.end()) {
+			WARN(std::fmt("Specialization constant %s (id %u) is not a 32-bit scalar or bool, ignored", name.c_str(), id_));
+			continue;
+		}
+		spec_constants.push_back({
+			.name = name,
+			.id = id_,
+			.type = type->second,
+		});
+	}
+	std::ranges::sort(spec_constants, [](const SpecializationConstantInfo& _a, const SpecializationConstantInfo& _b) {
+		return _a.id < _b.id;
+	});
+
+	return std::move(spec_constants);
+}
+
+// Storage behind one stage's vk::SpecializationInfo; must outlive the pipeline creation call.
+struct StageSpecialization {
+	std::vector<vk::SpecializationMapEntry> entries;
+	std::vector<u32> data;
+	vk::SpecializationInfo info;
+};
+
+Res<std::vector<StageSpecialization>> specialize_stages(const std::string& _pipeline_name, const std::vector<Shader*>& _shaders, const std::vector<SpecializationConstant>& _constants) {
+	std::vector<StageSpecialization> stages(_shaders.size());
+
+	for (const auto& constant_ : _constants) {
+		b8 declared = false;
+		for (usize i_ = 0; i_ < _shaders.size(); ++i_) {
+			const auto& spec_constants = _shaders[i_]->info.spec_constants;
+			const auto found = std::ranges::find(spec_constants, constant_.name, &SpecializationConstantInfo::name);
+			if (found == spec_constants.end()) continue;
+
+			if (found->type != constant_.type()) {
+				return Err::make(std::fmt("Pipeline %s specializes %s as %s, but %s declares it %s" CODE_LOC, _pipeline_name.c_str(), found->name.c_str(), to_cstr(constant_.type()), _shaders[i_]->info.name.c_str(), to_cstr(found->type)));
+			}
+
+			auto& stage_ = stages[i_];
+			stage_.entries.push_back({
+				.constantID = found->id,
+				.offset = cast<u32>(stage_.data.size() * sizeof(u32)),
+				.size = sizeof(u32),
+			});
+			stage_.data.push_back(constant_.bits());
+			declared = true;
+		}
+		if (!declared) {
+			return Err::make(std::fmt("Pipeline %s specializes %s, which no shader declares" CODE_LOC, _pipeline_name.c_str(), std::string{ constant_.name }.c_str()));
+		}
 	}
-	DEBUG(std::fmt("Creating new shader %s", _name.data()));
 
+	for (auto& stage_ : stages) {
+		stage_.info = {
+			.mapEntryCount = cast<u32>(stage_.entries.size()),
+			.pMapEntries = stage_.entries.data(),
+			.dataSize = stage_.data.size() * sizeof(u32),
+			.pData = stage_.data.data(),
+		};
+	}
+	return std::move(stages);
+}
+
+Res<Shader> PipelineFactory::load_shader(const std::string_view& _name) {
 	if (!file_exists(_name)) {
 		return Err::make(std::fmt("Shader '%s' not found." CODE_LOC, _name.data()));
 	}
@@ -65,9 +176,19 @@ Res<Shader*> PipelineFactory::create_shader_module(const std::string_view& _name
 	const auto spv_ext = _name.substr(spv_ext_idx);
 	WARN_IF(spv_ext != ".spv"sv, std::fmt("Shader '%s' has extension '%s' instead of '.spv'", _name.data(), spv_ext.data()));
 
-	auto shader_info = get_shader_reflection_info(_name, code);
-	if (!shader_info) {
-		return Err::make(std::fmt("Shader '%s' reflection failed." CODE_LOC, _name.data()), std::move(shader_info.error()));
+	// Keyed by contents, so an edited shader is reflected again instead of reusing the old layout.
+	const auto reflection_key = ShaderReflectionCache::key_of(code);
+	Res<ShaderInfo> shader_info;
+	if (auto cached = reflection_cache.find(reflection_key)) {
+		DEBUG(std::fmt("Using cached reflection for shader %s", _name.data()));
+		cached->name = _name;
+		shader_info = std::move(cached.value());
+	} else {
+		shader_info = get_shader_reflection_info(_name, code);
+		if (!shader_info) {
+			return Err::make(std::fmt("Shader '%s' reflection failed." CODE_LOC, _name.data()), std::move(shader_info.error()));
+		}
+		reflection_cache.insert(reflection_key, shader_info.value());
 	}
 
 	// Module creation
@@ -80,33 +201,68 @@ Res<Shader*> PipelineFactory::create_shader_module(const std::string_view& _name
 	}
 	parent_device->set_object_name(shader, _name);
 
-	auto& val = shader_map_[hash_key] = {
+	return Shader{
+		.stage = {
+			.stage = cast<vk::ShaderStageFlagBits>(shader_info->stage),
+			.shaderModule = shader,
+			.pName = "main",
+		},
+		.info = shader_info.value(),
+		.program_hash = hash_any(_name),
+		.layout_hash = hash_any(shader_info.value()),
+		.code_hash = cast<usize>(reflection_key.hash_lo),
+	};
+}
+
+Res<Shader*> PipelineFactory::create_shader_module(const std::string_view& _name) {
+
+	auto name_key = std::string{ _name };
+	if (shader_map_.contains(name_key)) {
+		auto& [count, shader] = shader_map_[name_key];
+		count++;
+		DEBUG(std::fmt("Using cached shader %s", _name.data()));
+		return &shader;
+	}
+	DEBUG(std::fmt("Creating new shader %s", _name.data()));
+
+	auto shader = load_shader(_name);
+	if (!shader) {
+		return Err::make(std::move(shader.error()));
+	}
+
+	auto& val = shader_map_[name_key] = {
 		1u,
-		Shader{
-			.stage = {
-				.stage = cast<vk::ShaderStageFlagBits>(shader_info->stage),
-				.shaderModule = shader,
-				.pName = "main",
-			},
-			.info = shader_info.value(),
-			.program_hash = hash_key,
-			.layout_hash = hash_any(shader_info.value()),
-		}
+		std::move(shader.value()),
 	};
 
 	return &val.second;
 }
 
 void PipelineFactory::destroy_shader_module(Shader* _shader) noexcept {
-	const auto hash_key = hash_any(_shader->info.name);
-	const auto found = shader_map_.contains(hash_key);
-	ERROR_IF(!found, std::fmt("Destroy called on unexisting shader %s", _shader->info.name.c_str()));
+	auto* entry = find_shader_entry(_shader);
+	ERROR_IF(!entry, std::fmt("Destroy called on unexisting shader %s", _shader->info.name.c_str()));
 
-	if (found && 0 == --shader_map_[hash_key].first) {
+	if (entry && 0 == --entry->first) {
 		DEBUG(std::fmt("Deleting cached shader %s", _shader->info.name.data()));
 		parent_device->device.destroyShaderModule(_shader->stage.shaderModule);
-		shader_map_.erase(hash_key);
+		if (const auto found = shader_map_.find(_shader->info.name); found != shader_map_.end() && &found->second.second == _shader) {
+			shader_map_.erase(found);
+		} else {
+			std::erase_if(superseded_shaders_, [_shader](const auto& _node) {
+				return &_node.mapped().second == _shader;
+			});
+		}
+	}
+}
+
+std::pair<u32, Shader>* PipelineFactory::find_shader_entry(const Shader* _shader) {
+	if (const auto found = shader_map_.find(_shader->info.name); found != shader_map_.end() && &found->second.second == _shader) {
+		return &found->second;
 	}
+	for (auto& node_ : superseded_shaders_) {
+		if (&node_.mapped().second == _shader) return &node_.mapped();
+	}
+	return nullptr;
 }
 
 Res<std::vector<Shader*>> PipelineFactory::create_shaders(const std::vector<std::string_view>& _names) {
@@ -135,7 +291,7 @@ Res<std::vector<Shader*>> PipelineFactory::create_shaders(const std::vector<std:
 
 	// Check if given shader combos are supported
 	constexpr auto supported = [](const vk::ShaderStageFlags& _flags) {
-		if (_flags & (vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)) {
+		if (_flags & (vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute)) {
 			return true;
 		}
 		return false;
@@ -171,27 +327,35 @@ Res<std::vector<Shader*>> PipelineFactory::create_shaders(const std::vector<std:
 			}
 		}
 	} else if (vertex_shader != nullptr || fragment_shader != nullptr) {
-		// TODO: Add compute shader logic
 		cleanup_shaders();
 		return Err::make("Vertex shader and Fragment shader must both exist" CODE_LOC);
+	} else if ((used_stages & vk::ShaderStageFlagBits::eCompute) && shaders.size() != 1) {
+		cleanup_shaders();
+		return Err::make("A compute pipeline takes exactly one compute shader" CODE_LOC);
 	}
 
 	return std::move(shaders);
 }
 
 void PipelineFactory::destroy_pipeline_layout(Layout* _layout) noexcept {
-	const auto hash_key = _layout->hash;
-	const auto found = layout_map_.contains(hash_key);
-	ERROR_IF(!found, std::fmt("Destroy called on unexisting layout %s", _layout->layout_info.name.c_str()));
+	const auto found = layout_map_.find(_layout->key);
+	ERROR_IF(found == layout_map_.end(), std::fmt("Destroy called on unexisting layout %s", _layout->layout_info.name.c_str()));
 
 	try {
-		if (found && 0 == --layout_map_[hash_key].first) {
+		if (found != layout_map_.end() && 0 == --found->second.first) {
 			DEBUG(std::fmt("Deleting cached layout %s", _layout->layout_info.name.data()));
-			parent_device->device.destroyPipelineLayout(_layout->layout);
+			for (auto& template_ : _layout->update_templates) {
+				parent_device->device.destroyDescriptorUpdateTemplate(template_);
+			}
+			if (pipeline_layouts_.release(_layout->layout)) {
+				parent_device->device.destroyPipelineLayout(_layout->layout);
+			}
 			for (auto& dsl_ : _layout->descriptor_set_layouts) {
-				parent_device->device.destroyDescriptorSetLayout(dsl_);
+				if (set_layouts_.release(dsl_)) {
+					parent_device->device.destroyDescriptorSetLayout(dsl_);
+				}
 			}
-			layout_map_.erase(hash_key);
+			layout_map_.erase(found);
 		}
 	} catch (std::exception& e) {
 		ERROR(e.what());
@@ -199,19 +363,32 @@ void PipelineFactory::destroy_pipeline_layout(Layout* _layout) noexcept {
 }
 
 void PipelineFactory::destroy_pipeline(Pipeline* _pipeline) noexcept {
-	const auto hash_key = _pipeline->hash;
-	const auto& found = pipeline_map_.contains(hash_key);
-	ERROR_IF(!found, std::fmt("Destroy called on unexisting pipeline %s", _pipeline->name.c_str()));
+	auto& shard = pipeline_shard(_pipeline->key);
+
+	// The last reference takes the entry out of its shard, so the rest is torn down without the shard lock.
+	decltype(shard.pipelines)::node_type node;
+	{
+		std::unique_lock lock{ shard.mutex, std::defer_lock };
+		lock_counted(lock, contention_.shard_waits);
+
+		const auto found = shard.pipelines.find(_pipeline->key);
+		ERROR_IF(found == shard.pipelines.end(), std::fmt("Destroy called on unexisting pipeline %s", _pipeline->name.c_str()));
+		if (found == shard.pipelines.end() || found->second.count.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		node = shard.pipelines.extract(found);
+	}
+
+	const auto lock = lock_factory();
+	release_pipeline_resources(node.mapped().pipeline);
+}
+
+void PipelineFactory::release_pipeline_resources(Pipeline& _pipeline) noexcept {
 	try {
-		if (found && 0 >= --pipeline_map_[hash_key].first) {
-			DEBUG(std::fmt("Deleting cached pipeline %s", _pipeline->name.data()));
-			for (auto& shader_ : _pipeline->shaders) {
-				this->destroy_shader_module(shader_);
-			}
-			this->destroy_pipeline_layout(_pipeline->layout);
-			parent_device->device.destroyPipeline(_pipeline->pipeline);
-			layout_map_.erase(hash_key);
+		DEBUG(std::fmt("Deleting cached pipeline %s", _pipeline.name.data()));
+		for (auto& shader_ : _pipeline.shaders) {
+			this->destroy_shader_module(shader_);
 		}
+		this->destroy_pipeline_layout(_pipeline.layout);
+		destroy_pipeline_handle(_pipeline.pipeline);
 	} catch (std::exception& e) {
 		ERROR(e.what());
 	}
@@ -229,7 +406,7 @@ Res<ShaderInfo> PipelineFactory::get_shader_reflection_info(const std::string_vi
 		return Err::make(std::fmt("Spirv reflection descriptor set enumeration failed with %s" CODE_LOC, to_cstr(result)));
 	}
 
-	std::map<std::string, u32> descriptor_names;
+	DescriptorNameMap descriptor_names;
 	std::vector<DescriptorInfo> descriptors;
 	if (set_count > 0) {
 		std::vector<SpvReflectDescriptorSet*> sets(set_count, nullptr);
@@ -281,6 +458,12 @@ Res<ShaderInfo> PipelineFactory::get_shader_reflection_info(const std::string_vi
 
 	auto shader_stage = cast<vk::ShaderStageFlagBits>(reflector.GetShaderStage());
 
+	std::array<u32, 3> local_size = { 1, 1, 1 };
+	if (shader_stage == vk::ShaderStageFlagBits::eCompute && reflector.GetShaderModule().entry_point_count > 0) {
+		const auto& entry_local_size = reflector.GetShaderModule().entry_points[0].local_size;
+		local_size = { entry_local_size.x, entry_local_size.y, entry_local_size.z };
+	}
+
 	std::vector<InterfaceVariableInfo> input_variables;
 	u32 input_variable_count;
 	reflector.EnumerateInputVariables(&input_variable_count, nullptr);
@@ -339,6 +522,11 @@ Res<ShaderInfo> PipelineFactory::get_shader_reflection_info(const std::string_vi
 		return _a.name > _b.name;
 	});
 
+	auto spec_constants = reflect_specialization_constants(_code);
+	if (!spec_constants) {
+		return Err::make(std::fmt("Spirv specialization constant reflection of %s failed" CODE_LOC, _name.data()), std::move(spec_constants.error()));
+	}
+
 	std::vector<vk::PushConstantRange> push_constant_ranges;
 	u32 push_constant_count = 0;
 	reflector.EnumeratePushConstantBlocks(&push_constant_count, nullptr);
@@ -371,62 +559,79 @@ Res<ShaderInfo> PipelineFactory::get_shader_reflection_info(const std::string_vi
 		.descriptor_names = move(descriptor_names),
 		.descriptors = move(descriptors),
 		.push_ranges = move(push_constant_ranges),
+		.local_size = local_size,
+		.spec_constants = std::move(spec_constants.value()),
 	};
 }
 
-Res<std::vector<vk::DescriptorSetLayout>> PipelineFactory::create_descriptor_layouts(const ShaderInfo& _shader_info) {
-	std::vector<vk::DescriptorSetLayout> descriptor_set_layout;
-	const auto cleanup_descriptor_set_layout = [this, &descriptor_set_layout] {
-		for (auto& dsl_ : descriptor_set_layout) {
-			parent_device->device.destroyDescriptorSetLayout(dsl_);
+Res<std::vector<vk::DescriptorSetLayout>> PipelineFactory::acquire_set_layouts(const ShaderInfo& _shader_info) {
+	std::vector<vk::DescriptorSetLayout> set_layouts;
+	const auto release_set_layouts = [this, &set_layouts] {
+		for (auto& dsl_ : set_layouts) {
+			if (set_layouts_.release(dsl_)) {
+				parent_device->device.destroyDescriptorSetLayout(dsl_);
+			}
 		}
 	};
 
 	if (_shader_info.descriptors.empty()) {
-		return std::move(descriptor_set_layout);
+		return std::move(set_layouts);
 	}
 
+	// Sets are indexed by number when allocating, so an unused set in between gets an empty layout.
+	const auto set_count = std::ranges::max(_shader_info.descriptors, {}, &DescriptorInfo::set).set + 1;
 	std::vector<vk::DescriptorSetLayoutBinding> bindings;
-	auto current_set = _shader_info.descriptors.front().set;
-
-	for (const auto& dsi_ : _shader_info.descriptors) {
-		bindings.push_back({
-			.binding = dsi_.binding,
-			.descriptorType = dsi_.type,
-			.descriptorCount = dsi_.array_length,
-			.stageFlags = dsi_.stages,
-		});
+	for (u32 set_ = 0; set_ < set_count; ++set_) {
+		// The heap's layout belongs to the device; the shared layouts never see it, so it is never released here.
+		if (set_ == BindlessHeap::set_index && parent_device->bindless.valid()) {
+			// Indices into a shader declaring the set differently from bindless.hlsli would address the wrong arrays.
+			for (const auto& dsi_ : _shader_info.descriptors) {
+				if (dsi_.set != set_) continue;
+				if (dsi_.binding >= BindlessHeap::kind_count || dsi_.type != BindlessHeap::kind_types[dsi_.binding]) {
+					release_set_layouts();
+					return Err::make(std::fmt("Shader %s declares '%s' at (%u, %u) as %s, which does not match the bindless heap" CODE_LOC, _shader_info.name.c_str(), dsi_.name.c_str(), dsi_.set, dsi_.binding, to_string(dsi_.type).c_str()));
+				}
+			}
+			set_layouts.push_back(parent_device->bindless.set_layout);
+			continue;
+		}
 
-		if (current_set != dsi_.set) {
-			vk::Result result;
-			tie(result, descriptor_set_layout.emplace_back()) = parent_device->device.createDescriptorSetLayout({
-				.bindingCount = cast<u32>(bindings.size()),
-				.pBindings = bindings.data(),
+		bindings.clear();
+		for (const auto& dsi_ : _shader_info.descriptors) {
+			if (dsi_.set != set_) continue;
+			bindings.push_back({
+				.binding = dsi_.binding,
+				.descriptorType = dsi_.type,
+				.descriptorCount = dsi_.array_length,
+				.stageFlags = dsi_.stages,
 			});
-			bindings.clear();
-			if (failed(result)) {
-				cleanup_descriptor_set_layout();
-				descriptor_set_layout.clear();
-				return Err::make(std::fmt("Set %d creation failed with %s" CODE_LOC, current_set, to_cstr(result)), result);
-			}
 		}
-		current_set = dsi_.set;
-	}
 
-	if (!bindings.empty()) {
-		vk::Result result;
-		tie(result, descriptor_set_layout.emplace_back()) = parent_device->device.createDescriptorSetLayout({
+		CacheKeyWriter key;
+		key.write(cast<u64>(bindings.size()));
+		for (const auto& binding_ : bindings) {
+			key.write(binding_.binding).write(binding_.descriptorType).write(binding_.descriptorCount).write(binding_.stageFlags);
+		}
+		auto set_key = std::move(key).finish();
+
+		if (const auto cached = set_layouts_.acquire(set_key)) {
+			set_layouts.push_back(cached.value());
+			continue;
+		}
+
+		auto [result, set_layout] = parent_device->device.createDescriptorSetLayout({
 			.bindingCount = cast<u32>(bindings.size()),
 			.pBindings = bindings.data(),
 		});
-		bindings.clear();
 		if (failed(result)) {
-			cleanup_descriptor_set_layout();
-			return Err::make(std::fmt("Set %d creation failed with %s" CODE_LOC, current_set, to_cstr(result)), result);
+			release_set_layouts();
+			return Err::make(std::fmt("Set %d creation failed with %s" CODE_LOC, set_, to_cstr(result)), result);
 		}
+		set_layouts_.insert(std::move(set_key), set_layout);
+		set_layouts.push_back(set_layout);
 	}
 
-	return std::move(descriptor_set_layout);
+	return std::move(set_layouts);
 }
 
 Res<> merge_acc_descriptor(DescriptorInfo* _acc, DescriptorInfo& _info) {
@@ -442,13 +647,20 @@ Res<> merge_acc_descriptor(DescriptorInfo* _acc, DescriptorInfo& _info) {
 	return {};
 }
 
-Res<Layout*> PipelineFactory::create_pipeline_layout(const std::vector<Shader*>& _shaders) {
-	usize layout_key = 0;
+Res<Layout*> PipelineFactory::create_pipeline_layout(const std::vector<Shader*>& _shaders, const std::vector<std::string_view>& _dynamic_buffers) {
+	// Shaders are unique by name and may not change their layout on reload, so the names are the key.
+	CacheKeyWriter key_writer;
+	key_writer.write(cast<u64>(_shaders.size()));
 	for (const auto& shader_ : _shaders) {
-		layout_key = hash_combine(layout_key, shader_->layout_hash);
+		key_writer.write(std::string_view{ shader_->info.name });
 	}
-	if (layout_map_.contains(layout_key)) {
-		auto& [ref_count_, layout_] = layout_map_[layout_key];
+	key_writer.write(cast<u64>(_dynamic_buffers.size()));
+	for (const auto& dynamic_name_ : _dynamic_buffers) {
+		key_writer.write(dynamic_name_);
+	}
+	auto layout_key = std::move(key_writer).finish();
+	if (const auto found = layout_map_.find(layout_key); found != layout_map_.end()) {
+		auto& [ref_count_, layout_] = found->second;
 		++ref_count_;
 		return &layout_;
 	}
@@ -468,22 +680,39 @@ Res<Layout*> PipelineFactory::create_pipeline_layout(const std::vector<Shader*>&
 		return _a.set != _b.set ? _a.set < _b.set : _a.binding < _b.binding;
 	};
 
+	// Kept sorted, so equal layouts come out with the same bindings in the same order.
 	std::vector<DescriptorInfo> descriptors;
 	for (const auto& shader_ : _shaders) {
 		for (auto& descriptor_ : shader_->info.descriptors) {
 			auto find_d = std::ranges::lower_bound(descriptors, descriptor_, descriptor_info_lt);
-			if (find_d != descriptors.end()) {
+			if (find_d != descriptors.end() && !descriptor_info_lt(descriptor_, *find_d)) {
 				if (auto res = merge_acc_descriptor(&*find_d, descriptor_); !res) {
 					return Err::make(CODE_LOC, std::move(res.error()));
 				}
 			} else {
-				descriptors.push_back(descriptor_);
+				descriptors.insert(find_d, descriptor_);
 			}
 		}
 	}
-	std::ranges::sort(descriptors, descriptor_info_lt);
 
-	std::map<std::string, u32> descriptor_names;
+	for (const auto& dynamic_name_ : _dynamic_buffers) {
+		auto found = std::ranges::find_if(descriptors, [&dynamic_name_](const DescriptorInfo& _d) {
+			return _d.name == dynamic_name_;
+		});
+		if (found == descriptors.end()) {
+			WARN(std::fmt("Dynamic buffer '%s' is not used by any shader", std::string(dynamic_name_).c_str()));
+			continue;
+		}
+		if (found->type == vk::DescriptorType::eUniformBuffer) {
+			found->type = vk::DescriptorType::eUniformBufferDynamic;
+		} else if (found->type == vk::DescriptorType::eStorageBuffer) {
+			found->type = vk::DescriptorType::eStorageBufferDynamic;
+		} else {
+			return Err::make(std::fmt("Descriptor '%s' of type %s can not be dynamic" CODE_LOC, found->name.c_str(), to_string(found->type).c_str()));
+		}
+	}
+
+	DescriptorNameMap descriptor_names;
 	u32 i_ = 0;
 	for (auto& di_ : descriptors) {
 		descriptor_names[di_.name] = i_++;
@@ -524,72 +753,292 @@ Res<Layout*> PipelineFactory::create_pipeline_layout(const std::vector<Shader*>&
 		.push_ranges = move(push_ranges),
 	};
 
-	auto descriptor_layouts = create_descriptor_layouts(pipeline_info);
+	auto descriptor_layouts = acquire_set_layouts(pipeline_info);
 	if (!descriptor_layouts) {
 		return Err::make(std::fmt("Descriptor layouts creation for %s failed" CODE_LOC, pipeline_info.name.c_str()), std::move(descriptor_layouts.error()));
 	}
 
-	auto [result, layout] = parent_device->device.createPipelineLayout({
-		.setLayoutCount = cast<u32>(descriptor_layouts->size()),
-		.pSetLayouts = descriptor_layouts->data(),
-		.pushConstantRangeCount = cast<u32>(pipeline_info.push_ranges.size()),
-		.pPushConstantRanges = pipeline_info.push_ranges.data(),
-	});
-	if (failed(result)) {
-		return Err::make(std::fmt("Pipeline layout creation for %s failed with %s" CODE_LOC, pipeline_info.name.c_str(), to_cstr(result)), result);
+	// Set layouts are shared, so their handles identify the binding content.
+	CacheKeyWriter handle_key_writer;
+	handle_key_writer.write(cast<u64>(descriptor_layouts->size()));
+	for (const auto& dsl_ : descriptor_layouts.value()) {
+		handle_key_writer.write(cast<VkDescriptorSetLayout>(dsl_));
 	}
+	handle_key_writer.write(cast<u64>(pipeline_info.push_ranges.size()));
+	for (const auto& range_ : pipeline_info.push_ranges) {
+		handle_key_writer.write(range_.stageFlags).write(range_.offset).write(range_.size);
+	}
+	auto handle_key = std::move(handle_key_writer).finish();
 
-	parent_device->set_object_name(layout, pipeline_info.name);
+	vk::PipelineLayout layout;
+	if (const auto cached = pipeline_layouts_.acquire(handle_key)) {
+		DEBUG(std::fmt("Sharing a compatible pipeline layout for %s", _shaders.front()->info.name.c_str()));
+		layout = cached.value();
+	} else {
+		vk::Result result;
+		tie(result, layout) = parent_device->device.createPipelineLayout({
+			.setLayoutCount = cast<u32>(descriptor_layouts->size()),
+			.pSetLayouts = descriptor_layouts->data(),
+			.pushConstantRangeCount = cast<u32>(pipeline_info.push_ranges.size()),
+			.pPushConstantRanges = pipeline_info.push_ranges.data(),
+		});
+		if (failed(result)) {
+			for (auto& dsl_ : descriptor_layouts.value()) {
+				if (set_layouts_.release(dsl_)) {
+					parent_device->device.destroyDescriptorSetLayout(dsl_);
+				}
+			}
+			return Err::make(std::fmt("Pipeline layout creation for %s failed with %s" CODE_LOC, pipeline_info.name.c_str(), to_cstr(result)), result);
+		}
+		parent_device->set_object_name(layout, pipeline_info.name);
+		pipeline_layouts_.insert(std::move(handle_key), layout);
+	}
 
 	auto& [key_, layout_] = layout_map_[layout_key] = {
 		1u,
 		{
-			.hash = layout_key,
+			.key = layout_key,
 			.layout_info = pipeline_info,
 			.layout = layout,
 			.descriptor_set_layouts = move(descriptor_layouts.value()),
 		}
 	};
+	create_update_templates(layout_);
 
 	return &layout_;
 }
 
+void PipelineFactory::create_update_templates(Layout& _layout) {
+	const auto& descriptors = _layout.layout_info.descriptors;
+	const auto set_count = cast<u32>(_layout.descriptor_set_layouts.size());
+
+	// Descriptors are sorted by set, so each set's slots are contiguous.
+	_layout.descriptor_slots.resize(descriptors.size());
+	_layout.set_slots.assign(set_count + 1, 0);
+	u32 slot_count = 0;
+	for (usize i_ = 0; i_ < descriptors.size(); ++i_) {
+		_layout.descriptor_slots[i_] = slot_count;
+		slot_count += descriptors[i_].array_length;
+		_layout.set_slots[descriptors[i_].set + 1] = slot_count;
+	}
+	for (u32 set_ = 1; set_ <= set_count; ++set_) {
+		_layout.set_slots[set_] = std::max(_layout.set_slots[set_], _layout.set_slots[set_ - 1]);
+	}
+
+	_layout.update_templates.assign(set_count, {});
+	std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+	for (u32 set_ = 0; set_ < set_count; ++set_) {
+		if (_layout.descriptor_set_layouts[set_] == parent_device->bindless.set_layout) continue;
+
+		entries.clear();
+		for (usize i_ = 0; i_ < descriptors.size(); ++i_) {
+			if (descriptors[i_].set != set_) continue;
+			entries.push_back({
+				.dstBinding = descriptors[i_].binding,
+				.dstArrayElement = 0,
+				.descriptorCount = descriptors[i_].array_length,
+				.descriptorType = descriptors[i_].type,
+				.offset = (_layout.descriptor_slots[i_] - _layout.set_slots[set_]) * sizeof(DescriptorSlot),
+				.stride = sizeof(DescriptorSlot),
+			});
+		}
+		if (entries.empty()) continue;
+
+		auto [result, update_template] = parent_device->device.createDescriptorUpdateTemplate({
+			.descriptorUpdateEntryCount = cast<u32>(entries.size()),
+			.pDescriptorUpdateEntries = entries.data(),
+			.templateType = vk::DescriptorUpdateTemplateType::eDescriptorSet,
+			.descriptorSetLayout = _layout.descriptor_set_layouts[set_],
+		});
+		// ResourceSet falls back to plain writes for a set without a template.
+		if (failed(result)) {
+			WARN(std::fmt("Update template for set %u of %s failed with %s", set_, _layout.layout_info.name.c_str(), to_cstr(result)));
+			continue;
+		}
+		_layout.update_templates[set_] = update_template;
+	}
+}
+
 Res<Pipeline*> PipelineFactory::create_pipeline(const PipelineCreateInfo& _create_info) {
+	return find_or_build(_create_info.name, make_cache_key(_create_info), _create_info.shader_files, _create_info.dynamic_buffers, [&_create_info] {
+		return make_rebuild(_create_info);
+	});
+}
 
-	usize pipeline_key = hash_any(_create_info);
-	if (pipeline_map_.contains(pipeline_key)) {
-		auto& [count_, pipeline_] = pipeline_map_[pipeline_key];
-		++count_;
-		return &pipeline_;
+Res<Pipeline*> PipelineFactory::create_compute_pipeline(const ComputePipelineCreateInfo& _create_info) {
+	return find_or_build(_create_info.name, make_cache_key(_create_info), { _create_info.shader_file }, _create_info.dynamic_buffers, [&_create_info] {
+		return make_rebuild(_create_info);
+	});
+}
+
+Res<Pipeline*> PipelineFactory::find_or_build(const std::string& _name, CacheKey&& _key, const std::vector<std::string_view>& _shader_files, const std::vector<std::string_view>& _dynamic_buffers, const std::function<Rebuild()>& _make_rebuild) {
+	auto& shard = pipeline_shard(_key);
+	{
+		std::shared_lock lock{ shard.mutex, std::defer_lock };
+		lock_counted(lock, contention_.shard_waits);
+		if (const auto found = shard.pipelines.find(_key); found != shard.pipelines.end()) {
+			found->second.count.fetch_add(1, std::memory_order_relaxed);
+			contention_.cache_hits.fetch_add(1, std::memory_order_relaxed);
+			return &found->second.pipeline;
+		}
 	}
 
+	std::shared_ptr<InFlight> in_flight;
+	std::shared_future<Res<Pipeline*>> other_compile;
+	{
+		std::unique_lock lock{ shard.mutex, std::defer_lock };
+		lock_counted(lock, contention_.shard_waits);
+		// Checked again, it may have been committed between the two locks.
+		if (const auto found = shard.pipelines.find(_key); found != shard.pipelines.end()) {
+			found->second.count.fetch_add(1, std::memory_order_relaxed);
+			contention_.cache_hits.fetch_add(1, std::memory_order_relaxed);
+			return &found->second.pipeline;
+		}
+		if (const auto found = shard.in_flight.find(_key); found != shard.in_flight.end()) {
+			// The reference is added by the compiling thread when it commits.
+			++found->second->waiters;
+			other_compile = found->second->result;
+		} else {
+			in_flight = std::make_shared<InFlight>();
+			shard.in_flight.emplace(_key, in_flight);
+		}
+	}
+
+	if (!in_flight) {
+		contention_.deduplicated.fetch_add(1, std::memory_order_relaxed);
+		auto result = other_compile.get();
+		if (!result) {
+			return Err::make(std::fmt("Pipeline %s failed on another thread" CODE_LOC "\n|> %s", _name.c_str(), result.error().what()), Err{ result.error() });
+		}
+		return result.value();
+	}
+
+	contention_.compiles.fetch_add(1, std::memory_order_relaxed);
+	const auto abandon = [&] {
+		// Waiters see the failure too; the next request tries again.
+		std::unique_lock lock{ shard.mutex, std::defer_lock };
+		lock_counted(lock, contention_.shard_waits);
+		shard.in_flight.erase(_key);
+	};
+
+	Res<Pipeline*> result;
+	try {
+		result = [&]() -> Res<Pipeline*> {
+			auto prepared = prepare_pipeline(_name, CacheKey{ _key }, _shader_files, _dynamic_buffers);
+			if (!prepared) {
+				return Err::make(std::move(prepared.error()));
+			}
+
+			// The driver compile is the expensive part, and is done without holding any lock.
+			auto rebuild = _make_rebuild();
+			auto pipeline = rebuild(*this, prepared.value());
+			if (!pipeline) {
+				const auto lock = lock_factory();
+				release_prepared(prepared.value());
+				return Err::make(std::move(pipeline.error()));
+			}
+
+			return commit_pipeline(_name, std::move(prepared.value()), pipeline.value(), std::move(rebuild));
+		}();
+	} catch (...) {
+		// Without this every waiter on the key, and every later lookup of it, would block forever.
+		abandon();
+		in_flight->promise.set_exception(std::current_exception());
+		throw;
+	}
+
+	if (!result) {
+		abandon();
+	}
+	in_flight->promise.set_value(result);
+	return result;
+}
+
+Res<std::vector<Pipeline*>> PipelineFactory::create_pipelines(const std::span<const PipelineCreateInfo>& _create_infos) {
+	std::vector<std::future<Res<Pipeline*>>> pending;
+	pending.reserve(_create_infos.size());
+	for (const auto& create_info_ : _create_infos) {
+		pending.push_back(workers_->submit([this, &create_info_] {
+			return create_pipeline(create_info_);
+		}));
+	}
+
+	std::vector<Pipeline*> pipelines;
+	pipelines.reserve(_create_infos.size());
+	Option<Err> error;
+	for (auto& pending_ : pending) {
+		if (auto res = pending_.get()) {
+			pipelines.push_back(res.value());
+		} else if (!error) {
+			error = std::move(res.error());
+		}
+	}
+
+	if (error) {
+		for (auto* pipeline_ : pipelines) {
+			destroy_pipeline(pipeline_);
+		}
+		return Err::make("Batch pipeline creation failed" CODE_LOC, std::move(error.value()));
+	}
+	return std::move(pipelines);
+}
+
+std::future<Res<Pipeline*>> PipelineFactory::create_pipeline_async(PipelineCreateInfo&& _create_info) {
+	return workers_->submit([this, create_info = std::move(_create_info)] {
+		return create_pipeline(create_info);
+	});
+}
+
+Res<PipelineFactory::PreparedPipeline> PipelineFactory::prepare_pipeline(const std::string& _name, CacheKey&& _key, const std::vector<std::string_view>& _shader_files, const std::vector<std::string_view>& _dynamic_buffers) {
+	const auto lock = lock_factory();
+
 	std::vector<Shader*> shaders;
 	auto cleanup_shaders = [this, &shaders] {
 		for (auto* p_ : shaders) {
 			this->destroy_shader_module(p_);
 		}
 	};
-	if (auto res = create_shaders(_create_info.shader_files)) {
+	if (auto res = create_shaders(_shader_files)) {
 		shaders = std::move(res.value());
 	} else {
 		return Err::make(std::fmt("Shader creation failed with %s" CODE_LOC "\n|> %s", to_cstr(res.error().code()), res.error().what()), std::move(res.error()));
 	}
 
 	Layout* pipeline_layout;
-	auto cleanup_layout = [this, &pipeline_layout] {
-		this->destroy_pipeline_layout(pipeline_layout);
-	};
-	if (auto res = create_pipeline_layout(shaders)) {
+	if (auto res = create_pipeline_layout(shaders, _dynamic_buffers)) {
 		pipeline_layout = res.value();
 	} else {
 		cleanup_shaders();
-		return Err::make(std::fmt("Pipeline layout creation for %s failed with %s " CODE_LOC "\n|> %s", _create_info.name.c_str(), to_cstr(res.error().code()), res.error().what()), std::move(res.error()));
+		return Err::make(std::fmt("Pipeline layout creation for %s failed with %s " CODE_LOC "\n|> %s", _name.c_str(), to_cstr(res.error().code()), res.error().what()), std::move(res.error()));
 	}
 
-	std::vector<ShaderStage> shader_stages(shaders.size());
-	std::ranges::transform(shaders, shader_stages.begin(), [](Shader* _s) {
-		return _s->stage;
-	});
+	return PreparedPipeline{
+		.key = std::move(_key),
+		.shaders = std::move(shaders),
+		.layout = pipeline_layout,
+	};
+}
+
+// Create infos of one graphics pipeline, split into library parts by `link_pipeline`.
+struct GraphicsPipelineState {
+	const vk::PipelineVertexInputStateCreateInfo* vertex_input;
+	const vk::PipelineInputAssemblyStateCreateInfo* input_assembly;
+	const vk::PipelineViewportStateCreateInfo* viewport;
+	const vk::PipelineRasterizationStateCreateInfo* raster;
+	const vk::PipelineMultisampleStateCreateInfo* multisample;
+	const vk::PipelineColorBlendStateCreateInfo* color_blend;
+	const vk::PipelineDynamicStateCreateInfo* dynamic;
+	std::span<const ShaderStage> stages;
+	std::span<const StageSpecialization> specialization;
+};
+
+Res<vk::Pipeline> PipelineFactory::compile_pipeline(const PipelineCreateInfo& _create_info, const PreparedPipeline& _prepared) {
+	const auto& shaders = _prepared.shaders;
+	const auto* pipeline_layout = _prepared.layout;
+
+	if (shaders.front()->stage.stage == vk::ShaderStageFlagBits::eCompute) {
+		return Err::make(std::fmt("Pipeline %s has a compute shader, use create_compute_pipeline" CODE_LOC, _create_info.name.c_str()));
+	}
 
 	std::vector<vk::VertexInputAttributeDescription> input_attributes(pipeline_layout->layout_info.input_vars.size());
 	for (auto& ivs : pipeline_layout->layout_info.input_vars) {
@@ -599,16 +1048,10 @@ Res<Pipeline*> PipelineFactory::create_pipeline(const PipelineCreateInfo& _creat
 		});
 
 		if (match_iv == in_attr.end()) {
-			auto err_str = std::fmt("Attribute %s required by shader, not found" CODE_LOC, ivs.name.c_str());
-			cleanup_shaders();
-			cleanup_layout();
-			return Err::make(err_str);
+			return Err::make(std::fmt("Attribute %s required by shader, not found" CODE_LOC, ivs.name.c_str()));
 		}
 		if (match_iv->format != ivs.format) {
-			auto err_str = std::fmt("Attribute %s has mismatching formats (exp: %s, found: %s)" CODE_LOC, ivs.name.c_str(), to_cstr(ivs.format), to_cstr(match_iv->format));
-			cleanup_shaders();
-			cleanup_layout();
-			return Err::make(err_str);
+			return Err::make(std::fmt("Attribute %s has mismatching formats (exp: %s, found: %s)" CODE_LOC, ivs.name.c_str(), to_cstr(ivs.format), to_cstr(match_iv->format)));
 		}
 
 		input_attributes[ivs.location] = {
@@ -619,6 +1062,21 @@ Res<Pipeline*> PipelineFactory::create_pipeline(const PipelineCreateInfo& _creat
 		};
 	}
 
+	std::vector<ShaderStage> shader_stages(shaders.size());
+	std::ranges::transform(shaders, shader_stages.begin(), [](Shader* _s) {
+		return _s->stage;
+	});
+
+	auto specialization = specialize_stages(_create_info.name, shaders, _create_info.specialization);
+	if (!specialization) {
+		return Err::make(std::move(specialization.error()));
+	}
+	for (usize i_ = 0; i_ < shader_stages.size(); ++i_) {
+		if (!specialization.value()[i_].entries.empty()) {
+			shader_stages[i_].pSpecializationInfo = &specialization.value()[i_].info;
+		}
+	}
+
 	vk::PipelineVertexInputStateCreateInfo visci = {
 		.vertexBindingDescriptionCount = cast<u32>(_create_info.vertex_input.bindings.size()),
 		.pVertexBindingDescriptions = _create_info.vertex_input.bindings.data(),
@@ -677,7 +1135,34 @@ Res<Pipeline*> PipelineFactory::create_pipeline(const PipelineCreateInfo& _creat
 		.pDynamicStates = _create_info.dynamic_states.data(),
 	};
 
-	auto [result, pipeline] = parent_device->device.createGraphicsPipeline({ /*Cache*/ }, {
+#if defined(VK_EXT_graphics_pipeline_library)
+	if (use_pipeline_libraries && parent_device->extensions.graphics_pipeline_library) {
+		return link_pipeline(_create_info, _prepared, {
+			.vertex_input = &visci,
+			.input_assembly = &iasci,
+			.viewport = &vsci,
+			.raster = &rsci,
+			.multisample = &msci,
+			.color_blend = &cbsci,
+			.dynamic = &dsci,
+			.stages = shader_stages,
+			.specialization = specialization.value(),
+		});
+	}
+#endif
+
+	vk::PipelineCreationFeedbackEXT pipeline_feedback = {};
+	std::vector<vk::PipelineCreationFeedbackEXT> stage_feedback(ssci.size());
+	vk::PipelineCreationFeedbackCreateInfoEXT feedback_info = {
+		.pPipelineCreationFeedback = &pipeline_feedback,
+		.pipelineStageCreationFeedbackCount = cast<u32>(stage_feedback.size()),
+		.pPipelineStageCreationFeedbacks = stage_feedback.data(),
+	};
+
+	const auto creation_start = glfwGetTime();
+	auto [result, pipeline] = parent_device->device.createGraphicsPipeline(pipeline_cache.cache, {
+		.pNext = parent_device->extensions.pipeline_creation_feedback ? &feedback_info : nullptr,
+		.flags = statistics_flags(),
 		.stageCount = cast<u32>(ssci.size()),
 		.pStages = recast<const vk::PipelineShaderStageCreateInfo*>(ssci.data()),
 		.pVertexInputState = &visci,
@@ -694,23 +1179,669 @@ Res<Pipeline*> PipelineFactory::create_pipeline(const PipelineCreateInfo& _creat
 	if (failed(result)) {
 		return Err::make(std::fmt("Pipeline %s creation failed with %s" CODE_LOC, _create_info.name.c_str(), to_cstr(result)), result);
 	}
+	record_creation(_create_info.name, creation_start, pipeline_feedback, stage_feedback);
 
-	parent_device->set_object_name(pipeline, _create_info.name);
+	return pipeline;
+}
 
-	auto& [key_, pipeline_] = pipeline_map_[pipeline_key] = {
-		1u,
-		Pipeline{
-			.shaders = std::move(shaders),
-			.layout = pipeline_layout,
-			.pipeline = pipeline,
-			.name = _create_info.name,
-			.hash = pipeline_key,
-			.parent_factory = this,
+Res<vk::Pipeline> PipelineFactory::compile_compute_pipeline(const ComputePipelineCreateInfo& _create_info, const PreparedPipeline& _prepared) {
+	if (_prepared.shaders.front()->stage.stage != vk::ShaderStageFlagBits::eCompute) {
+		return Err::make(std::fmt("Compute pipeline %s needs a compute shader" CODE_LOC, _create_info.name.c_str()));
+	}
+
+	auto specialization = specialize_stages(_create_info.name, _prepared.shaders, _create_info.specialization);
+	if (!specialization) {
+		return Err::make(std::move(specialization.error()));
+	}
+	auto stage = _prepared.shaders.front()->stage;
+	if (!specialization->front().entries.empty()) {
+		stage.pSpecializationInfo = &specialization->front().info;
+	}
+
+	vk::PipelineCreationFeedbackEXT pipeline_feedback = {};
+	vk::PipelineCreationFeedbackEXT stage_feedback = {};
+	vk::PipelineCreationFeedbackCreateInfoEXT feedback_info = {
+		.pPipelineCreationFeedback = &pipeline_feedback,
+		.pipelineStageCreationFeedbackCount = 1,
+		.pPipelineStageCreationFeedbacks = &stage_feedback,
+	};
+
+	const auto creation_start = glfwGetTime();
+	auto [result, pipeline] = parent_device->device.createComputePipeline(pipeline_cache.cache, {
+		.pNext = parent_device->extensions.pipeline_creation_feedback ? &feedback_info : nullptr,
+		.flags = statistics_flags(),
+		.stage = *recast<const vk::PipelineShaderStageCreateInfo*>(&stage),
+		.layout = _prepared.layout->layout,
+	});
+
+	if (failed(result)) {
+		return Err::make(std::fmt("Compute pipeline %s creation failed with %s" CODE_LOC, _create_info.name.c_str(), to_cstr(result)), result);
+	}
+	record_creation(_create_info.name, creation_start, pipeline_feedback, { &stage_feedback, 1 });
+
+	return pipeline;
+}
+
+#if defined(VK_EXT_graphics_pipeline_library)
+namespace {
+	void write_stage(CacheKeyWriter& _key, const ShaderStage& _stage, const Shader& _shader, const StageSpecialization& _specialization) {
+		_key.write(_stage.stage).write(std::string_view{ _shader.info.name }).write(_shader.code_hash).write(std::string_view{ _stage.pName });
+		_key.write(cast<u64>(_specialization.entries.size()));
+		for (const auto& entry_ : _specialization.entries) {
+			_key.write(entry_.constantID).write(entry_.offset).write(cast<u64>(entry_.size));
 		}
+		_key.write(cast<u64>(_specialization.data.size()));
+		for (const auto word_ : _specialization.data) {
+			_key.write(word_);
+		}
+	}
+
+	void write_dynamic_state(CacheKeyWriter& _key, const vk::PipelineDynamicStateCreateInfo& _dynamic) {
+		_key.write(_dynamic.dynamicStateCount);
+		for (u32 i_ = 0; i_ < _dynamic.dynamicStateCount; ++i_) {
+			_key.write(_dynamic.pDynamicStates[i_]);
+		}
+	}
+}
+
+Res<vk::Pipeline> PipelineFactory::link_pipeline(const PipelineCreateInfo& _create_info, const PreparedPipeline& _prepared, const GraphicsPipelineState& _state) {
+	const auto& shaders = _prepared.shaders;
+	const auto layout = _prepared.layout->layout;
+	const auto renderpass = _create_info.renderpass->renderpass;
+
+	std::array<CacheKeyWriter, library_part_count> writers;
+	auto& vertex_input_key = writers[cast<usize>(LibraryPart::eVertexInput)];
+	auto& pre_raster_key = writers[cast<usize>(LibraryPart::ePreRasterization)];
+	auto& fragment_key = writers[cast<usize>(LibraryPart::eFragmentShader)];
+	auto& fragment_output_key = writers[cast<usize>(LibraryPart::eFragmentOutput)];
+	const auto capture_flags = statistics_flags();
+	for (usize i_ = 0; i_ < library_part_count; ++i_) {
+		writers[i_].write(cast<LibraryPart>(i_)).write(cast<VkPipelineCreateFlags>(capture_flags));
+		write_dynamic_state(writers[i_], *_state.dynamic);
+	}
+	// Parts other than vertex input only match pipelines of the same layout and render pass.
+	for (auto* key_ : { &pre_raster_key, &fragment_key, &fragment_output_key }) {
+		key_->write(cast<VkRenderPass>(renderpass));
+	}
+	pre_raster_key.write(cast<VkPipelineLayout>(layout));
+	fragment_key.write(cast<VkPipelineLayout>(layout));
+	for (auto* key_ : { &fragment_key, &fragment_output_key }) {
+		key_->write(_state.multisample->rasterizationSamples).write(_state.multisample->sampleShadingEnable);
+	}
+
+	std::vector<vk::PipelineShaderStageCreateInfo> pre_raster_stages;
+	std::vector<vk::PipelineShaderStageCreateInfo> fragment_stages;
+	for (usize i_ = 0; i_ < _state.stages.size(); ++i_) {
+		const auto& stage_ = *recast<const vk::PipelineShaderStageCreateInfo*>(&_state.stages[i_]);
+		const b8 is_fragment = stage_.stage == vk::ShaderStageFlagBits::eFragment;
+		(is_fragment ? fragment_stages : pre_raster_stages).push_back(stage_);
+		write_stage(is_fragment ? fragment_key : pre_raster_key, _state.stages[i_], *shaders[i_], _state.specialization[i_]);
+	}
+
+	vertex_input_key.write(_state.input_assembly->topology).write(_state.input_assembly->primitiveRestartEnable);
+	vertex_input_key.write(_state.vertex_input->vertexBindingDescriptionCount);
+	for (u32 i_ = 0; i_ < _state.vertex_input->vertexBindingDescriptionCount; ++i_) {
+		const auto& binding_ = _state.vertex_input->pVertexBindingDescriptions[i_];
+		vertex_input_key.write(binding_.binding).write(binding_.stride).write(binding_.inputRate);
+	}
+	vertex_input_key.write(_state.vertex_input->vertexAttributeDescriptionCount);
+	for (u32 i_ = 0; i_ < _state.vertex_input->vertexAttributeDescriptionCount; ++i_) {
+		const auto& attribute_ = _state.vertex_input->pVertexAttributeDescriptions[i_];
+		vertex_input_key.write(attribute_.location).write(attribute_.binding).write(attribute_.format).write(attribute_.offset);
+	}
+
+	const auto& viewport = *_state.viewport;
+	pre_raster_key.write(viewport.viewportCount).write(viewport.scissorCount);
+	for (u32 i_ = 0; viewport.pViewports && i_ < viewport.viewportCount; ++i_) {
+		const auto& viewport_ = viewport.pViewports[i_];
+		pre_raster_key.write(viewport_.x).write(viewport_.y).write(viewport_.width).write(viewport_.height).write(viewport_.minDepth).write(viewport_.maxDepth);
+	}
+	for (u32 i_ = 0; viewport.pScissors && i_ < viewport.scissorCount; ++i_) {
+		const auto& scissor_ = viewport.pScissors[i_];
+		pre_raster_key.write(scissor_.offset.x).write(scissor_.offset.y).write(scissor_.extent.width).write(scissor_.extent.height);
+	}
+	const auto& raster = *_state.raster;
+	pre_raster_key.write(raster.depthClampEnable).write(raster.rasterizerDiscardEnable).write(raster.polygonMode).write(raster.cullMode).write(raster.frontFace);
+	pre_raster_key.write(raster.depthBiasEnable).write(raster.depthBiasConstantFactor).write(raster.depthBiasClamp).write(raster.depthBiasSlopeFactor).write(raster.lineWidth);
+
+	const auto& color_blend = *_state.color_blend;
+	fragment_output_key.write(color_blend.logicOpEnable).write(color_blend.logicOp).write(color_blend.attachmentCount);
+	for (u32 i_ = 0; i_ < color_blend.attachmentCount; ++i_) {
+		const auto& attachment_ = color_blend.pAttachments[i_];
+		fragment_output_key.write(attachment_.blendEnable).write(attachment_.colorWriteMask);
+		fragment_output_key.write(attachment_.srcColorBlendFactor).write(attachment_.dstColorBlendFactor).write(attachment_.colorBlendOp);
+		fragment_output_key.write(attachment_.srcAlphaBlendFactor).write(attachment_.dstAlphaBlendFactor).write(attachment_.alphaBlendOp);
+	}
+	for (const auto constant_ : color_blend.blendConstants) {
+		fragment_output_key.write(constant_);
+	}
+
+	LibraryKeys keys;
+	for (usize i_ = 0; i_ < library_part_count; ++i_) {
+		keys[i_] = std::move(writers[i_]).finish();
+	}
+
+	auto create_part = [this, &_create_info, capture_flags](const vk::GraphicsPipelineLibraryFlagsEXT _part, vk::GraphicsPipelineCreateInfo _info) -> Res<vk::Pipeline> {
+		vk::GraphicsPipelineLibraryCreateInfoEXT library_info = {
+			.flags = _part,
+		};
+		_info.pNext = &library_info;
+		_info.flags = vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT | capture_flags;
+
+		auto [result, library] = parent_device->device.createGraphicsPipeline(pipeline_cache.cache, _info);
+		if (failed(result)) {
+			return Err::make(std::fmt("Pipeline library part for %s failed with %s" CODE_LOC, _create_info.name.c_str(), to_cstr(result)), result);
+		}
+		return library;
 	};
 
-	return &pipeline_;
-};
+	const std::array<std::function<Res<vk::Pipeline>()>, library_part_count> part_creators = {
+		[&] {
+			return create_part(vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface, {
+				.pVertexInputState = _state.vertex_input,
+				.pInputAssemblyState = _state.input_assembly,
+				.pDynamicState = _state.dynamic,
+			});
+		},
+		[&] {
+			return create_part(vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders, {
+				.stageCount = cast<u32>(pre_raster_stages.size()),
+				.pStages = pre_raster_stages.data(),
+				.pViewportState = _state.viewport,
+				.pRasterizationState = _state.raster,
+				.pDynamicState = _state.dynamic,
+				.layout = layout,
+				.renderPass = renderpass,
+			});
+		},
+		[&] {
+			return create_part(vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader, {
+				.stageCount = cast<u32>(fragment_stages.size()),
+				.pStages = fragment_stages.data(),
+				.pMultisampleState = _state.multisample,
+				.pDynamicState = _state.dynamic,
+				.layout = layout,
+				.renderPass = renderpass,
+			});
+		},
+		[&] {
+			return create_part(vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface, {
+				.pMultisampleState = _state.multisample,
+				.pColorBlendState = _state.color_blend,
+				.pDynamicState = _state.dynamic,
+				.renderPass = renderpass,
+			});
+		},
+	};
+
+	std::array<vk::Pipeline, library_part_count> libraries;
+	for (usize i_ = 0; i_ < library_part_count; ++i_) {
+		if (auto res = acquire_library(keys[i_], part_creators[i_])) {
+			libraries[i_] = res.value();
+		} else {
+			const auto lock = lock_factory();
+			release_libraries(std::span<const CacheKey>{ keys }.first(i_));
+			return Err::make(std::move(res.error()));
+		}
+	}
+
+	auto link = [device = parent_device->device, cache = pipeline_cache.cache, layout, libraries, capture_flags](const vk::PipelineCreateFlags _flags) {
+		const vk::PipelineLibraryCreateInfoKHR library_info = {
+			.libraryCount = cast<u32>(libraries.size()),
+			.pLibraries = libraries.data(),
+		};
+		return device.createGraphicsPipeline(cache, {
+			.pNext = &library_info,
+			.flags = _flags | capture_flags,
+			.layout = layout,
+		});
+	};
+
+	const auto creation_start = glfwGetTime();
+	auto [result, pipeline] = link({});
+	if (failed(result)) {
+		const auto lock = lock_factory();
+		release_libraries(keys);
+		return Err::make(std::fmt("Pipeline %s link failed with %s" CODE_LOC, _create_info.name.c_str(), to_cstr(result)), result);
+	}
+	record_creation(_create_info.name, creation_start, {}, {});
+
+	const auto lock = lock_factory();
+	linked_libraries_[pipeline] = keys;
+	if (!optimize_linked_pipelines) return pipeline;
+
+	// The relink holds its own references, since the fast pipeline may be gone before it finishes.
+	for (const auto& key_ : keys) {
+		++library_map_[key_].first;
+	}
+	auto* pipeline_layout = _prepared.layout;
+	++layout_map_[pipeline_layout->key].first;
+
+	(void)workers_->submit([this, link, keys, pipeline_layout, key = _prepared.key, replaces = pipeline, name = _create_info.name] {
+		auto [link_result, optimized] = link(vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT);
+
+		const auto relink_lock = lock_factory();
+		destroy_pipeline_layout(pipeline_layout);
+		if (failed(link_result)) {
+			WARN(std::fmt("Optimized link of %s failed with %s, keeping the fast link", name.c_str(), to_cstr(link_result)));
+			release_libraries(keys);
+			return;
+		}
+		parent_device->set_object_name(optimized, name);
+		linked_libraries_[optimized] = keys;
+		pending_swaps_.push_back({
+			.key = key,
+			.pipeline = optimized,
+			.replaces = replaces,
+		});
+	});
+
+	return pipeline;
+}
+#endif
+
+Res<vk::Pipeline> PipelineFactory::acquire_library(const CacheKey& _key, const std::function<Res<vk::Pipeline>()>& _create) {
+	{
+		const auto lock = lock_factory();
+		if (const auto found = library_map_.find(_key); found != library_map_.end()) {
+			++found->second.first;
+			return found->second.second;
+		}
+	}
+
+	auto library = _create();
+	if (!library) {
+		return Err::make(std::move(library.error()));
+	}
+
+	const auto lock = lock_factory();
+	if (const auto found = library_map_.find(_key); found != library_map_.end()) {
+		parent_device->device.destroyPipeline(library.value());
+		++found->second.first;
+		return found->second.second;
+	}
+	library_map_[_key] = { 1u, library.value() };
+	return library.value();
+}
+
+void PipelineFactory::release_libraries(const std::span<const CacheKey>& _keys) noexcept {
+	for (const auto& key_ : _keys) {
+		const auto found = library_map_.find(key_);
+		ERROR_IF(found == library_map_.end(), "Release called on unexisting pipeline library");
+		if (found != library_map_.end() && 0 == --found->second.first) {
+			parent_device->device.destroyPipeline(found->second.second);
+			library_map_.erase(found);
+		}
+	}
+}
+
+void PipelineFactory::destroy_pipeline_handle(const vk::Pipeline _pipeline) noexcept {
+	if (const auto found = linked_libraries_.find(_pipeline); found != linked_libraries_.end()) {
+		release_libraries(found->second);
+		linked_libraries_.erase(found);
+	}
+	parent_device->device.destroyPipeline(_pipeline);
+}
+
+vk::PipelineCreateFlags PipelineFactory::statistics_flags() const {
+	if (!capture_statistics || !parent_device->extensions.pipeline_executable_properties) return {};
+	return vk::PipelineCreateFlagBits::eCaptureStatisticsKHR;
+}
+
+std::vector<PipelineExecutable> PipelineFactory::query_executables(const vk::Pipeline _pipeline, const std::string& _name) const {
+	std::vector<PipelineExecutable> executables;
+	if (!statistics_flags()) return executables;
+
+	auto [result, properties] = parent_device->device.getPipelineExecutablePropertiesKHR({ .pipeline = _pipeline });
+	if (failed(result)) {
+		WARN(std::fmt("Pipeline %s executable query failed with %s", _name.c_str(), to_cstr(result)));
+		return executables;
+	}
+
+	for (u32 i_ = 0; i_ < properties.size(); ++i_) {
+		auto& executable = executables.emplace_back(PipelineExecutable{
+			.name = properties[i_].name.data(),
+			.stages = properties[i_].stages,
+			.subgroup_size = properties[i_].subgroupSize,
+		});
+
+		auto [stat_result, statistics] = parent_device->device.getPipelineExecutableStatisticsKHR({
+			.pipeline = _pipeline,
+			.executableIndex = i_,
+		});
+		if (failed(stat_result)) {
+			WARN(std::fmt("Pipeline %s statistics query for %s failed with %s", _name.c_str(), executable.name.c_str(), to_cstr(stat_result)));
+			continue;
+		}
+
+		for (const auto& statistic_ : statistics) {
+			f64 value = 0.0;
+			switch (statistic_.format) {
+				case vk::PipelineExecutableStatisticFormatKHR::eBool32:
+					value = statistic_.value.b32 ? 1.0 : 0.0;
+					break;
+				case vk::PipelineExecutableStatisticFormatKHR::eInt64:
+					value = cast<f64>(statistic_.value.i64);
+					break;
+				case vk::PipelineExecutableStatisticFormatKHR::eUint64:
+					value = cast<f64>(statistic_.value.u64);
+					break;
+				case vk::PipelineExecutableStatisticFormatKHR::eFloat64:
+					value = statistic_.value.f64;
+					break;
+			}
+			executable.statistics.push_back({
+				.name = statistic_.name.data(),
+				.value = value,
+				.format = statistic_.format,
+			});
+		}
+	}
+	return executables;
+}
+
+std::vector<PipelineStatisticsSnapshot> PipelineFactory::live_pipelines() {
+	std::vector<PipelineStatisticsSnapshot> pipelines;
+	for (auto& shard_ : pipeline_shards_) {
+		std::shared_lock lock{ shard_.mutex, std::defer_lock };
+		lock_counted(lock, contention_.shard_waits);
+		for (const auto& [key_, entry_] : shard_.pipelines) {
+			pipelines.push_back({
+				.name = entry_.pipeline.name,
+				.key = entry_.pipeline.key,
+				.executables = entry_.pipeline.executables,
+			});
+		}
+	}
+	std::ranges::sort(pipelines, {}, &PipelineStatisticsSnapshot::name);
+	return pipelines;
+}
+
+Res<> PipelineFactory::dump_statistics_report(const std::string_view& _path) {
+	const auto pipelines = live_pipelines();
+
+	std::string report = "{\n\"Pipelines\": [";
+	for (usize i_ = 0; i_ < pipelines.size(); ++i_) {
+		const auto& pipeline_ = pipelines[i_];
+		report += std::fmt("%s\n\t{ \"Name\": \"%s\", \"Executables\": [", i_ ? "," : "", pipeline_.name.c_str());
+		for (usize j_ = 0; j_ < pipeline_.executables.size(); ++j_) {
+			const auto& executable_ = pipeline_.executables[j_];
+			report += std::fmt("%s\n\t\t{ \"Name\": \"%s\", \"Stages\": \"%s\", \"SubgroupSize\": %u, \"Statistics\": {", j_ ? "," : "", executable_.name.c_str(), to_string(executable_.stages).c_str(), executable_.subgroup_size);
+			for (usize k_ = 0; k_ < executable_.statistics.size(); ++k_) {
+				const auto& statistic_ = executable_.statistics[k_];
+				report += std::fmt("%s \"%s\": %g", k_ ? "," : "", statistic_.name.c_str(), statistic_.value);
+			}
+			report += " } }";
+		}
+		report += "\n\t] }";
+	}
+	report += "\n]\n}\n";
+
+	if (!write_text_file(_path, report)) {
+		return Err::make(std::fmt("Pipeline statistics report could not be written to '%s'" CODE_LOC, _path.data()));
+	}
+	INFO(std::fmt("Pipeline statistics report written to '%s'", _path.data()));
+	return {};
+}
+
+void PipelineFactory::record_creation(const std::string& _name, const f64 _start_time, const vk::PipelineCreationFeedbackEXT& _pipeline_feedback, const std::span<const vk::PipelineCreationFeedbackEXT>& _stage_feedback) {
+	const auto elapsed_ms = (glfwGetTime() - _start_time) * 1000.0;
+
+	const auto lock = lock_factory();
+	pipeline_cache.record(_name, elapsed_ms, _pipeline_feedback, _stage_feedback);
+}
+
+Res<Pipeline*> PipelineFactory::commit_pipeline(const std::string& _name, PreparedPipeline&& _prepared, const vk::Pipeline _pipeline, Rebuild&& _rebuild) {
+	parent_device->set_object_name(_pipeline, _name);
+
+	const auto* compute_shader = _prepared.shaders.front()->stage.stage == vk::ShaderStageFlagBits::eCompute ? _prepared.shaders.front() : nullptr;
+	auto executables = query_executables(_pipeline, _name);
+
+	auto& shard = pipeline_shard(_prepared.key);
+	std::unique_lock lock{ shard.mutex, std::defer_lock };
+	lock_counted(lock, contention_.shard_waits);
+
+	// The compiling thread and every thread that waited on it each hold a reference.
+	u32 references = 1;
+	if (const auto found = shard.in_flight.find(_prepared.key); found != shard.in_flight.end()) {
+		references += found->second->waiters;
+		shard.in_flight.erase(found);
+	}
+
+	auto [entry, inserted] = shard.pipelines.try_emplace(_prepared.key, references, Pipeline{
+		.shaders = std::move(_prepared.shaders),
+		.layout = _prepared.layout,
+		.pipeline = _pipeline,
+		.name = _name,
+		.key = _prepared.key,
+		.bind_point = compute_shader ? vk::PipelineBindPoint::eCompute : vk::PipelineBindPoint::eGraphics,
+		.local_size = compute_shader ? compute_shader->info.local_size : std::array<u32, 3>{ 1, 1, 1 },
+		.executables = std::move(executables),
+		.parent_factory = this,
+	}, std::move(_rebuild));
+	ERROR_IF(!inserted, std::fmt("Pipeline %s was committed twice", _name.c_str()));
+
+	return &entry->second.pipeline;
+}
+
+namespace {
+	// Create infos only hold views; a rebuild long after creation needs the strings to itself.
+	template <typename TCreateInfo>
+	struct RetainedCreateInfo {
+		TCreateInfo info;
+		std::deque<std::string> strings;
+
+		explicit RetainedCreateInfo(const TCreateInfo& _info) : info(_info) {}
+
+		void retain(std::string_view& _view) {
+			_view = strings.emplace_back(_view);
+		}
+	};
+}
+
+PipelineFactory::Rebuild PipelineFactory::make_rebuild(const PipelineCreateInfo& _create_info) {
+	auto retained = std::make_shared<RetainedCreateInfo<PipelineCreateInfo>>(_create_info);
+	for (auto& attribute_ : retained->info.vertex_input.attributes) {
+		retained->retain(attribute_.attr_name);
+	}
+	for (auto& shader_file_ : retained->info.shader_files) {
+		retained->retain(shader_file_);
+	}
+	for (auto& dynamic_name_ : retained->info.dynamic_buffers) {
+		retained->retain(dynamic_name_);
+	}
+	for (auto& constant_ : retained->info.specialization) {
+		retained->retain(constant_.name);
+	}
+
+	return [retained](PipelineFactory& _factory, const PreparedPipeline& _prepared) {
+		return _factory.compile_pipeline(retained->info, _prepared);
+	};
+}
+
+PipelineFactory::Rebuild PipelineFactory::make_rebuild(const ComputePipelineCreateInfo& _create_info) {
+	auto retained = std::make_shared<RetainedCreateInfo<ComputePipelineCreateInfo>>(_create_info);
+	retained->retain(retained->info.shader_file);
+	for (auto& dynamic_name_ : retained->info.dynamic_buffers) {
+		retained->retain(dynamic_name_);
+	}
+	for (auto& constant_ : retained->info.specialization) {
+		retained->retain(constant_.name);
+	}
+
+	return [retained](PipelineFactory& _factory, const PreparedPipeline& _prepared) {
+		return _factory.compile_compute_pipeline(retained->info, _prepared);
+	};
+}
+
+void PipelineFactory::enable_hot_reload(const std::string_view& _directory) {
+	shader_watcher_ = Owned<FileWatcher>{ new FileWatcher{ _directory, ".spv", [this](const std::string& _path) {
+		// Reloads queue behind any pipeline compiles already on the workers.
+		(void)workers_->submit([this, _path] {
+			reload_shader(_path);
+		});
+	} } };
+}
+
+void PipelineFactory::reload_shader(const std::string& _path) {
+	const auto changed = std::filesystem::path{ _path }.lexically_normal();
+
+	std::string shader_name;
+	std::vector<std::pair<PreparedPipeline, Rebuild>> affected;
+	{
+		const auto lock = lock_factory();
+
+		const auto is_changed = [&changed](const Shader& _shader) {
+			return std::filesystem::path{ _shader.info.name }.lexically_normal() == changed;
+		};
+		const Shader* current = nullptr;
+		const auto current_entry = std::ranges::find_if(shader_map_, [&is_changed](const auto& _entry) {
+			return is_changed(_entry.second.second);
+		});
+		if (current_entry != shader_map_.end()) {
+			current = &current_entry->second.second;
+		} else {
+			// A reload whose rebuilds all failed leaves pipelines on an older version only.
+			for (const auto& node_ : superseded_shaders_) {
+				if (is_changed(node_.mapped().second)) current = &node_.mapped().second;
+			}
+		}
+		if (current == nullptr) return;
+
+		auto shader = load_shader(current->info.name);
+		if (!shader) {
+			WARN(std::fmt("Shader %s reload failed, keeping the old one\n|> %s", current->info.name.c_str(), shader.error().what()));
+			return;
+		}
+		// Resource sets are allocated against the layout, so it can not change underneath them.
+		// Rebuilds also keep the layout's vertex attributes, which come from the interface variables.
+		if (shader->stage.stage != current->stage.stage || shader->layout_hash != current->layout_hash || shader->info.input_vars != current->info.input_vars || shader->info.output_vars != current->info.output_vars) {
+			WARN(std::fmt("Shader %s changed its stage, resource layout or interface, restart to apply it", current->info.name.c_str()));
+			parent_device->device.destroyShaderModule(shader->stage.shaderModule);
+			return;
+		}
+
+		// Pipelines and compiles in flight read the old version unlocked, so it is set aside untouched
+		// and the new one takes its name. Pipelines move over as their swaps are applied.
+		shader_name = current->info.name;
+		if (current_entry != shader_map_.end()) {
+			superseded_shaders_.push_back(shader_map_.extract(current_entry));
+		}
+		auto& replacement = shader_map_[shader_name] = {
+			0u,
+			std::move(shader.value()),
+		};
+
+		for (auto& shard_ : pipeline_shards_) {
+			std::shared_lock shard_lock{ shard_.mutex, std::defer_lock };
+			lock_counted(shard_lock, contention_.shard_waits);
+			for (auto& [key_, entry_] : shard_.pipelines) {
+				// Matched by name, a pipeline may still be on a version whose swap is pending.
+				auto shaders = entry_.pipeline.shaders;
+				b8 uses_shader = false;
+				for (auto& shader_ : shaders) {
+					if (shader_->info.name != shader_name) continue;
+					shader_ = &replacement.second;
+					uses_shader = true;
+				}
+				if (!uses_shader) continue;
+
+				// The rebuild runs unlocked, and the pipeline may be destroyed meanwhile.
+				for (auto* shader_ : shaders) {
+					++find_shader_entry(shader_)->first;
+				}
+				++layout_map_[entry_.pipeline.layout->key].first;
+				affected.emplace_back(PreparedPipeline{
+					.key = key_,
+					.shaders = std::move(shaders),
+					.layout = entry_.pipeline.layout,
+				}, entry_.rebuild);
+			}
+		}
+
+		if (replacement.first == 0) {
+			// Nothing to rebuild. The next pipeline to ask for the shader loads it from disk again.
+			parent_device->device.destroyShaderModule(replacement.second.stage.shaderModule);
+			shader_map_.erase(shader_name);
+		}
+	}
+
+	std::vector<PipelineSwap> swaps;
+	for (auto& [prepared_, rebuild_] : affected) {
+		if (auto res = rebuild_(*this, prepared_)) {
+			// The swap takes over the shader references.
+			swaps.push_back({
+				.key = prepared_.key,
+				.pipeline = res.value(),
+				.shaders = std::exchange(prepared_.shaders, {}),
+			});
+		} else {
+			WARN(std::fmt("Pipeline rebuild for %s failed, keeping the old one\n|> %s", shader_name.c_str(), res.error().what()));
+		}
+	}
+
+	INFO(std::fmt("Shader %s reloaded, %llu pipelines rebuilt", shader_name.c_str(), cast<u64>(swaps.size())));
+
+	const auto lock = lock_factory();
+	for (const auto& [prepared_, rebuild_] : affected) {
+		release_prepared(prepared_);
+	}
+	pending_swaps_.insert(pending_swaps_.end(), std::make_move_iterator(swaps.begin()), std::make_move_iterator(swaps.end()));
+}
+
+std::vector<Pipeline*> PipelineFactory::apply_pipeline_swaps() {
+	const auto lock = lock_factory();
+	if (pending_swaps_.empty()) return {};
+
+	// The old handles may still be used by frames in flight.
+	WARN_IF(failed(parent_device->device.waitIdle()), "Device wait idle failed");
+
+	// Rebuilds go first, so an optimized relink of a rebuild that finished early still finds its handle.
+	std::ranges::stable_partition(pending_swaps_, [](const PipelineSwap& _swap) {
+		return !_swap.replaces;
+	});
+
+	std::vector<Pipeline*> swapped;
+	for (auto& swap_ : pending_swaps_) {
+		auto& shard = pipeline_shard(swap_.key);
+		std::unique_lock shard_lock{ shard.mutex, std::defer_lock };
+		lock_counted(shard_lock, contention_.shard_waits);
+
+		const auto found = shard.pipelines.find(swap_.key);
+		if (found == shard.pipelines.end() || (swap_.replaces && found->second.pipeline.pipeline != swap_.replaces)) {
+			destroy_pipeline_handle(swap_.pipeline);
+			for (auto* shader_ : swap_.shaders) {
+				destroy_shader_module(shader_);
+			}
+			continue;
+		}
+
+		auto& pipeline_ = found->second.pipeline;
+		destroy_pipeline_handle(pipeline_.pipeline);
+		pipeline_.pipeline = swap_.pipeline;
+		if (!swap_.shaders.empty()) {
+			// Moving to the reloaded shaders drops the references on the versions the old handle was built from.
+			for (auto* shader_ : std::exchange(pipeline_.shaders, std::move(swap_.shaders))) {
+				destroy_shader_module(shader_);
+			}
+		}
+		pipeline_.executables = query_executables(swap_.pipeline, pipeline_.name);
+		parent_device->set_object_name(swap_.pipeline, pipeline_.name);
+		if (std::ranges::find(swapped, &pipeline_) == swapped.end()) {
+			swapped.push_back(&pipeline_);
+		}
+	}
+	pending_swaps_.clear();
+
+	return swapped;
+}
+
+void PipelineFactory::release_prepared(const PreparedPipeline& _prepared) noexcept {
+	for (auto* shader_ : _prepared.shaders) {
+		destroy_shader_module(shader_);
+	}
+	destroy_pipeline_layout(_prepared.layout);
+}
 
 usize std::hash<ShaderInfo>::operator()(const ShaderInfo& _val) const noexcept {
 	usize hash_ = 0;
@@ -735,116 +1866,183 @@ usize std::hash<DescriptorInfo>::operator()(const DescriptorInfo& _val) const no
 	return hash_;
 }
 
-usize std::hash<PipelineCreateInfo>::operator()(const PipelineCreateInfo& _value) const noexcept {
-	auto hash_val = hash_any(_value.renderpass->attachment_format);
+namespace {
+	void write_specialization(CacheKeyWriter& _key, const std::vector<SpecializationConstant>& _constants) {
+		_key.write(cast<u64>(_constants.size()));
+		for (const auto& constant_ : _constants) {
+			_key.write(constant_.name).write(constant_.type()).write(constant_.bits());
+		}
+	}
+
+	void write_names(CacheKeyWriter& _key, const std::vector<std::string_view>& _names) {
+		_key.write(cast<u64>(_names.size()));
+		for (const auto& name_ : _names) {
+			_key.write(name_);
+		}
+	}
+}
+
+CacheKey make_cache_key(const PipelineCreateInfo& _value) {
+	CacheKeyWriter key;
+	key.write(vk::PipelineBindPoint::eGraphics);
+	// The pass itself, not just its format hash; a pipeline is only handed out for the pass it was built against.
+	key.write(cast<VkRenderPass>(_value.renderpass->renderpass)).write(_value.renderpass->attachment_format);
 	{
 		// vertex input
+		key.write(cast<u64>(_value.vertex_input.bindings.size()));
 		for (const auto& binding_ : _value.vertex_input.bindings) {
-			hash_val = hash_combine(hash_val, hash_any(binding_.binding));
-			hash_val = hash_combine(hash_val, hash_any(binding_.inputRate));
+			key.write(binding_.binding).write(binding_.stride).write(binding_.inputRate);
 		}
+		key.write(cast<u64>(_value.vertex_input.attributes.size()));
 		for (const auto& attr_ : _value.vertex_input.attributes) {
-			hash_val = hash_combine(hash_val, hash_any(attr_.binding));
-			hash_val = hash_combine(hash_val, hash_any(attr_.attr_name));
-			hash_val = hash_combine(hash_val, hash_any(attr_.format));
-			hash_val = hash_combine(hash_val, hash_any(attr_.offset));
+			key.write(attr_.attr_name).write(attr_.binding).write(attr_.offset).write(attr_.format);
 		}
 	}
 	{
 		// input assembly
-		hash_val = hash_combine(hash_val, hash_any(_value.input_assembly.topology));
-		hash_val = hash_combine(hash_val, hash_any(_value.input_assembly.primitive_restart_enable));
+		key.write(_value.input_assembly.topology).write(_value.input_assembly.primitive_restart_enable);
 	}
 	{
-		// viewport state
-		hash_val = hash_combine(hash_val, hash_any(_value.viewport_state.enable_dynamic));
-		for (const auto& viewport_ : _value.viewport_state.viewports) {
-			hash_val = hash_combine(hash_val, hash_any(viewport_.x));
-			hash_val = hash_combine(hash_val, hash_any(viewport_.y));
-			hash_val = hash_combine(hash_val, hash_any(viewport_.width));
-			hash_val = hash_combine(hash_val, hash_any(viewport_.height));
-			hash_val = hash_combine(hash_val, hash_any(viewport_.minDepth));
-			hash_val = hash_combine(hash_val, hash_any(viewport_.maxDepth));
-		}
-		for (const auto& scissor_ : _value.viewport_state.scissors) {
-			hash_val = hash_combine(hash_val, hash_any(scissor_.extent.width));
-			hash_val = hash_combine(hash_val, hash_any(scissor_.extent.height));
-			hash_val = hash_combine(hash_val, hash_any(scissor_.offset.x));
-			hash_val = hash_combine(hash_val, hash_any(scissor_.offset.y));
+		// viewport state; dynamic viewports only contribute their count
+		const auto& viewport_state = _value.viewport_state;
+		key.write(viewport_state.enable_dynamic);
+		key.write(cast<u64>(viewport_state.viewports.size())).write(cast<u64>(viewport_state.scissors.size()));
+		if (!viewport_state.enable_dynamic) {
+			for (const auto& viewport_ : viewport_state.viewports) {
+				key.write(viewport_.x).write(viewport_.y).write(viewport_.width).write(viewport_.height).write(viewport_.minDepth).write(viewport_.maxDepth);
+			}
+			for (const auto& scissor_ : viewport_state.scissors) {
+				key.write(scissor_.offset.x).write(scissor_.offset.y).write(scissor_.extent.width).write(scissor_.extent.height);
+			}
 		}
 	}
 	{
 		// raster state
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.raster_discard_enabled));
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.polygon_mode));
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.cull_mode));
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.front_face));
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.depth_clamp_enabled));
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.depth_clamp));
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.depth_bias.enable));
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.depth_bias.constant_factor));
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.depth_bias.slope_factor));
-		hash_val = hash_combine(hash_val, hash_any(_value.raster_state.line_width));
+		const auto& raster_state = _value.raster_state;
+		key.write(raster_state.raster_discard_enabled).write(raster_state.polygon_mode).write(raster_state.cull_mode).write(raster_state.front_face);
+		key.write(raster_state.depth_clamp_enabled).write(raster_state.depth_clamp);
+		key.write(raster_state.depth_bias.enable).write(raster_state.depth_bias.constant_factor).write(raster_state.depth_bias.slope_factor);
+		key.write(raster_state.line_width);
 	}
 	{
 		// multisample
-		hash_val = hash_combine(hash_val, hash_any(_value.multisample_state.sample_count));
+		key.write(_value.multisample_state.sample_count);
 	}
 	{
 		// shaders
-		for (const auto& shader_name_ : _value.shader_files) {
-			hash_val = hash_combine(hash_val, hash_any(shader_name_));
-		}
+		write_names(key, _value.shader_files);
+		write_names(key, _value.dynamic_buffers);
+		write_specialization(key, _value.specialization);
 	}
 	{
 		// color blend info
-		for (const auto& attachment_ : _value.color_blend.attachments) {
-			hash_val = hash_combine(hash_val, hash_any(attachment_.alphaBlendOp));
-			hash_val = hash_combine(hash_val, hash_any(attachment_.blendEnable));
-			hash_val = hash_combine(hash_val, hash_any(attachment_.colorBlendOp));
-			hash_val = hash_combine(hash_val, hash_any(attachment_.colorWriteMask));
-			hash_val = hash_combine(hash_val, hash_any(attachment_.dstAlphaBlendFactor));
-			hash_val = hash_combine(hash_val, hash_any(attachment_.dstColorBlendFactor));
-			hash_val = hash_combine(hash_val, hash_any(attachment_.srcAlphaBlendFactor));
-			hash_val = hash_combine(hash_val, hash_any(attachment_.srcColorBlendFactor));
-		}
-		hash_val = hash_combine(hash_val, hash_any(_value.color_blend.logic_op_enable));
-		hash_val = hash_combine(hash_val, hash_any(_value.color_blend.logic_op));
-		hash_val = hash_combine(hash_val, hash_any(_value.color_blend.blend_constants[0]));
-		hash_val = hash_combine(hash_val, hash_any(_value.color_blend.blend_constants[1]));
-		hash_val = hash_combine(hash_val, hash_any(_value.color_blend.blend_constants[2]));
-		hash_val = hash_combine(hash_val, hash_any(_value.color_blend.blend_constants[3]));
+		const auto& color_blend = _value.color_blend;
+		key.write(cast<u64>(color_blend.attachments.size()));
+		for (const auto& attachment_ : color_blend.attachments) {
+			key.write(attachment_.blendEnable).write(attachment_.colorWriteMask);
+			key.write(attachment_.srcColorBlendFactor).write(attachment_.dstColorBlendFactor).write(attachment_.colorBlendOp);
+			key.write(attachment_.srcAlphaBlendFactor).write(attachment_.dstAlphaBlendFactor).write(attachment_.alphaBlendOp);
+		}
+		key.write(color_blend.logic_op_enable).write(color_blend.logic_op);
+		key.write(color_blend.blend_constants.x).write(color_blend.blend_constants.y).write(color_blend.blend_constants.z).write(color_blend.blend_constants.w);
 	}
 	{
 		// dynamic states
+		key.write(cast<u64>(_value.dynamic_states.size()));
 		for (const auto& dyn_state_ : _value.dynamic_states) {
-			hash_val = hash_combine(hash_val, hash_any(dyn_state_));
+			key.write(dyn_state_);
 		}
 	}
+	return std::move(key).finish();
+}
+
+CacheKey make_cache_key(const ComputePipelineCreateInfo& _value) {
+	CacheKeyWriter key;
+	// Keeps compute keys apart from graphics keys in the shared pipeline map.
+	key.write(vk::PipelineBindPoint::eCompute);
+	key.write(_value.shader_file);
+	write_names(key, _value.dynamic_buffers);
+	write_specialization(key, _value.specialization);
+	return std::move(key).finish();
+}
+
+usize std::hash<SpecializationConstant>::operator()(const SpecializationConstant& _value) const noexcept {
+	auto hash_val = hash_any(_value.name);
+	hash_val = hash_combine(hash_val, hash_any(_value.type()));
+	hash_val = hash_combine(hash_val, hash_any(_value.bits()));
 	return hash_val;
 }
 
+u32 SpecializationConstant::bits() const {
+	return std::visit([](const auto _value) -> u32 {
+		if constexpr (std::is_same_v<decltype(_value), const b8>) {
+			return _value ? VK_TRUE : VK_FALSE;
+		} else {
+			return std::bit_cast<u32>(_value);
+		}
+	}, value);
+}
+
+vk::Extent3D Pipeline::group_count(const vk::Extent3D& _extent) const {
+	return {
+		.width = (_extent.width + local_size[0] - 1) / local_size[0],
+		.height = (_extent.height + local_size[1] - 1) / local_size[1],
+		.depth = (_extent.depth + local_size[2] - 1) / local_size[2],
+	};
+}
+
+void Pipeline::dispatch(const vk::CommandBuffer _cmd, const vk::Extent3D& _extent) const {
+	const auto groups = group_count(_extent);
+	_cmd.dispatch(groups.width, groups.height, groups.depth);
+}
+
 void Pipeline::destroy() {
 	parent_factory->destroy_pipeline(this);
 }
 
-PipelineFactory::PipelineFactory(PipelineFactory&& _other) noexcept: parent_device{ std::move(_other.parent_device) }
-                                                                   , shader_map_{ std::move(_other.shader_map_) }
-                                                                   , layout_map_{ std::move(_other.layout_map_) }
-                                                                   , pipeline_map_{ std::move(_other.pipeline_map_) } {}
+PipelineFactory::PipelineFactory(Borrowed<Device>&& _device, const std::string_view& _cache_path)
+	: parent_device{ std::move(_device) }
+	, reflection_cache{ ShaderReflectionCache::load() }
+	, workers_{ new ThreadPool{} } {
+	// Pipelines still work without a cache, just slower.
+	if (auto res = PipelineCache::create(parent_device, _cache_path)) {
+		pipeline_cache = std::move(res.value());
+	} else {
+		WARN(std::fmt("Pipeline cache unavailable\n|> %s", res.error().what()));
+	}
+}
+
+PipelineFactory::ContentionStats PipelineFactory::contention_stats() const {
+	return {
+		.cache_hits = contention_.cache_hits.load(std::memory_order_relaxed),
+		.compiles = contention_.compiles.load(std::memory_order_relaxed),
+		.deduplicated = contention_.deduplicated.load(std::memory_order_relaxed),
+		.shard_waits = contention_.shard_waits.load(std::memory_order_relaxed),
+		.factory_waits = contention_.factory_waits.load(std::memory_order_relaxed),
+	};
+}
 
-PipelineFactory& PipelineFactory::operator=(PipelineFactory&& _other) noexcept {
-	if (this == &_other) return *this;
-	parent_device = _other.parent_device;
-	shader_map_ = std::move(_other.shader_map_);
-	layout_map_ = std::move(_other.layout_map_);
-	pipeline_map_ = std::move(_other.pipeline_map_);
-	return *this;
+std::unique_lock<std::mutex> PipelineFactory::lock_factory() {
+	std::unique_lock lock{ mutex_, std::defer_lock };
+	lock_counted(lock, contention_.factory_waits);
+	return lock;
 }
 
 PipelineFactory::~PipelineFactory() {
-	for (auto& [k, v] : pipeline_map_) {
-		destroy_pipeline(&v.second);
+	// Stop producing reloads and relinks, then let in-flight compiles land in the maps before tearing them down.
+	shader_watcher_ = Owned<FileWatcher>{};
+	{
+		const auto lock = lock_factory();
+		optimize_linked_pipelines = false;
+	}
+	workers_ = Owned<ThreadPool>{};
+	(void)apply_pipeline_swaps();
+
+	for (auto& shard_ : pipeline_shards_) {
+		for (auto& [key_, entry_] : shard_.pipelines) {
+			release_pipeline_resources(entry_.pipeline);
+		}
+		shard_.pipelines.clear();
 	}
 	for (auto& [k, v] : layout_map_) {
 		WARN(std::fmt("Pipeline layout %s not released by pipeline!", v.second.layout_info.name.c_str()));
@@ -854,4 +2052,37 @@ PipelineFactory::~PipelineFactory() {
 		WARN(std::fmt("Shader Module %s not released by pipeline!", v.second.info.name.c_str()));
 		destroy_shader_module(&v.second);
 	}
+	for (auto& node_ : superseded_shaders_) {
+		WARN(std::fmt("Superseded Shader Module %s not released by pipeline!", node_.mapped().second.info.name.c_str()));
+		parent_device->device.destroyShaderModule(node_.mapped().second.stage.shaderModule);
+	}
+	superseded_shaders_.clear();
+	// Anything left here belongs to layouts that were leaked above.
+	for (auto& [k, v] : pipeline_layouts_.entries) {
+		parent_device->device.destroyPipelineLayout(v.second);
+	}
+	for (auto& [k, v] : set_layouts_.entries) {
+		parent_device->device.destroyDescriptorSetLayout(v.second);
+	}
+	pipeline_layouts_ = {};
+	set_layouts_ = {};
+	WARN_IF(!library_map_.empty(), std::fmt("%llu pipeline libraries not released by pipelines!", cast<u64>(library_map_.size())));
+	for (auto& [k, v] : library_map_) {
+		parent_device->device.destroyPipeline(v.second);
+	}
+	library_map_.clear();
+	linked_libraries_.clear();
+
+	pipeline_cache.log_stats();
+	if (auto res = pipeline_cache.save(); !res) {
+		WARN(std::fmt("Pipeline cache save failed\n|> %s", res.error().what()));
+	}
+	pipeline_cache.destroy();
+
+	const auto contention = contention_stats();
+	VERBOSE(std::fmt("Pipeline factory: %llu hits, %llu compiles, %llu deduplicated, %llu shard waits, %llu factory waits", contention.cache_hits, contention.compiles, contention.deduplicated, contention.shard_waits, contention.factory_waits));
+	INFO_IF(reflection_cache.stats.hits + reflection_cache.stats.misses > 0, std::fmt("Shader reflection: %llu cached, %llu reflected", reflection_cache.stats.hits, reflection_cache.stats.misses));
+	if (auto res = reflection_cache.save(); !res) {
+		WARN(std::fmt("Shader reflection cache save failed\n|> %s", res.error().what()));
+	}
 }
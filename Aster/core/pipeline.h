@@ -8,10 +8,23 @@
 #include <global.h>
 #include <core/device.h>
 #include <core/renderpass.h>
-
+#include <core/pipeline_cache.h>
+#include <core/shader_reflection_cache.h>
+#include <util/thread_pool.h>
+#include <util/file_watcher.h>
+#include <util/cache_key.h>
+
+#include <array>
+#include <atomic>
 #include <vector>
 #include <map>
 #include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <variant>
 
 // Replacing the vulkan PipelineShaderStageCreateInfo due to keyword module incompatibility;
 struct ShaderStage {
@@ -134,14 +147,44 @@ namespace std {
 	};
 }
 
+enum class SpecializationType : u8 {
+	eBool,
+	eInt,
+	eUint,
+	eFloat,
+};
+
+constexpr const char* to_cstr(const SpecializationType _type) {
+	switch (_type) {
+	case SpecializationType::eBool: return "bool";
+	case SpecializationType::eInt: return "int";
+	case SpecializationType::eUint: return "uint";
+	case SpecializationType::eFloat: return "float";
+	}
+	return "unknown";
+}
+
+// A `[[vk::constant_id]]` constant as declared by the shader. Only 32-bit scalars and bools are reflected.
+struct SpecializationConstantInfo {
+	std::string name;
+	u32 id{};
+	SpecializationType type{};
+};
+
+// Transparent comparison, so a `std::string_view` finds a descriptor without building a string.
+using DescriptorNameMap = std::map<std::string, u32, std::less<>>;
+
 struct ShaderInfo {
 	std::string name;
 	vk::ShaderStageFlagBits stage;
 	std::vector<InterfaceVariableInfo> input_vars;
 	std::vector<InterfaceVariableInfo> output_vars;
-	std::map<std::string, u32> descriptor_names;
+	DescriptorNameMap descriptor_names;
 	std::vector<DescriptorInfo> descriptors;
 	std::vector<vk::PushConstantRange> push_ranges;
+	// Workgroup size from the compute entry point's LocalSize.
+	std::array<u32, 3> local_size{ 1, 1, 1 };
+	std::vector<SpecializationConstantInfo> spec_constants;
 };
 
 namespace std {
@@ -157,6 +200,32 @@ struct Shader {
 	ShaderInfo info;
 	usize program_hash{};
 	usize layout_hash{};
+	// Hash of the SPIR-V itself, which changes on reload while the name does not.
+	usize code_hash{};
+};
+
+/**
+ * Value for a specialization constant, matched by name against every stage that declares it.
+ * The alternative must match the declared type, so `3000` specializes an `int` and `3000u` a `uint`.
+ */
+struct SpecializationConstant {
+	std::string_view name;
+	std::variant<b8, i32, u32, f32> value;
+
+	[[nodiscard]]
+	SpecializationType type() const {
+		return cast<SpecializationType>(value.index());
+	}
+
+	// The four bytes handed to Vulkan; bools widen to VkBool32.
+	[[nodiscard]]
+	u32 bits() const;
+};
+
+template <>
+struct std::hash<SpecializationConstant> {
+	[[nodiscard]]
+	usize operator()(const SpecializationConstant& _value) const noexcept;
 };
 
 struct PipelineCreateInfo {
@@ -209,6 +278,13 @@ struct PipelineCreateInfo {
 
 	std::vector<std::string_view> shader_files;
 
+	// Uniform and storage buffers bound with dynamic offsets.
+	// Offsets are passed to `bindDescriptorSets` in set, then binding order.
+	std::vector<std::string_view> dynamic_buffers;
+
+	// Part of the pipeline key; each distinct set of values is its own pipeline.
+	std::vector<SpecializationConstant> specialization;
+
 	struct {
 		std::vector<vk::PipelineColorBlendAttachmentState> attachments{
 			{
@@ -225,17 +301,65 @@ struct PipelineCreateInfo {
 	std::string name;
 };
 
-template <>
-struct std::hash<PipelineCreateInfo> {
-	[[nodiscard]]
-	usize operator()(const PipelineCreateInfo& _value) const noexcept;
+/**
+ * Canonical serialization of everything that changes the compiled pipeline; the name is left out.
+ */
+[[nodiscard]]
+CacheKey make_cache_key(const PipelineCreateInfo& _value);
+
+struct ComputePipelineCreateInfo {
+	std::string_view shader_file;
+
+	// Uniform and storage buffers bound with dynamic offsets.
+	std::vector<std::string_view> dynamic_buffers;
+
+	std::vector<SpecializationConstant> specialization;
+
+	std::string name;
+};
+
+[[nodiscard]]
+CacheKey make_cache_key(const ComputePipelineCreateInfo& _value);
+
+// One array element of a descriptor, packed so a whole set can be written from a flat array.
+union DescriptorSlot {
+	VkDescriptorImageInfo image;
+	VkDescriptorBufferInfo buffer;
 };
 
 struct Layout {
-	usize hash{};
+	CacheKey key;
 	ShaderInfo layout_info;
+	// Shared with every layout of the same bindings and push ranges, so their descriptor sets are interchangeable.
 	vk::PipelineLayout layout;
 	std::vector<vk::DescriptorSetLayout> descriptor_set_layouts;
+	// First DescriptorSlot of each descriptor in `layout_info`, and of each set with the total at the end.
+	std::vector<u32> descriptor_slots;
+	std::vector<u32> set_slots;
+	// Writes a whole set from its slots. Null for empty sets, or if creation failed.
+	std::vector<vk::DescriptorUpdateTemplate> update_templates;
+};
+
+struct PipelineStatistic {
+	std::string name;
+	// Every driver format widened to f64; booleans are 0 or 1.
+	f64 value{};
+	vk::PipelineExecutableStatisticFormatKHR format{};
+};
+
+// One compiled program inside a pipeline, as reported by VK_KHR_pipeline_executable_properties.
+struct PipelineExecutable {
+	std::string name;
+	vk::ShaderStageFlags stages;
+	u32 subgroup_size{};
+	std::vector<PipelineStatistic> statistics;
+};
+
+// Copied out of a live pipeline, so it stays readable after the pipeline is destroyed or swapped.
+struct PipelineStatisticsSnapshot {
+	std::string name;
+	CacheKey key;
+	std::vector<PipelineExecutable> executables;
 };
 
 struct Pipeline {
@@ -243,44 +367,271 @@ struct Pipeline {
 	Layout* layout{};
 	vk::Pipeline pipeline;
 	std::string name;
-	usize hash{};
+	CacheKey key;
+	vk::PipelineBindPoint bind_point{ vk::PipelineBindPoint::eGraphics };
+	std::array<u32, 3> local_size{ 1, 1, 1 };
+	// Empty unless the factory captures statistics; refreshed when the handle is swapped.
+	std::vector<PipelineExecutable> executables;
 
 	PipelineFactory* parent_factory{};
 
+	/**
+	 * Workgroups needed to cover `_extent` with this compute pipeline's local size.
+	 */
+	[[nodiscard]]
+	vk::Extent3D group_count(const vk::Extent3D& _extent) const;
+
+	void dispatch(vk::CommandBuffer _cmd, const vk::Extent3D& _extent) const;
+
 	void destroy();
 };
 
+struct GraphicsPipelineState;
+
 class PipelineFactory {
 public:
 	Borrowed<Device> parent_device;
 
-	explicit PipelineFactory(Borrowed<Device>&& _device) : parent_device{ std::move(_device) } {}
+	// Loaded on construction and written back on destruction.
+	PipelineCache pipeline_cache;
+	ShaderReflectionCache reflection_cache;
+
+	// Link graphics pipelines from cached VK_EXT_graphics_pipeline_library parts when the device has it.
+	b8 use_pipeline_libraries{ true };
+	// Relink those with link time optimization on a worker; the result lands through `apply_pipeline_swaps`.
+	b8 optimize_linked_pipelines{ true };
+	// Capture driver statistics (registers, instructions, spills) for every new pipeline, when the device can.
+	b8 capture_statistics{ false };
+
+	struct ContentionStats {
+		u64 cache_hits{};
+		u64 compiles{};
+		// Requests that waited for another thread compiling the same pipeline.
+		u64 deduplicated{};
+		// Lock acquisitions that found the lock already taken.
+		u64 shard_waits{};
+		u64 factory_waits{};
+	};
+
+	explicit PipelineFactory(Borrowed<Device>&& _device, const std::string_view& _cache_path = PipelineCache::default_path);
 
+	// Workers and the shader watcher hold `this`, and the locks can not move, so the factory stays put.
 	PipelineFactory(const PipelineFactory& _other) = delete;
-	PipelineFactory(PipelineFactory&& _other) noexcept;
+	PipelineFactory(PipelineFactory&& _other) = delete;
 	PipelineFactory& operator=(const PipelineFactory& _other) = delete;
-	PipelineFactory& operator=(PipelineFactory&& _other) noexcept;
+	PipelineFactory& operator=(PipelineFactory&& _other) = delete;
 
 	~PipelineFactory();
 
+	/**
+	 * Create or reuse a pipeline. Safe to call from several threads. A pipeline already being compiled by
+	 * another thread is waited on, not compiled twice.
+	 */
 	Res<Pipeline*> create_pipeline(const PipelineCreateInfo& _create_info);
 
+	/**
+	 * Compile every pipeline of `_create_infos` on the factory's workers. On failure, the ones that succeeded
+	 * are released and the first error is returned.
+	 */
+	Res<std::vector<Pipeline*>> create_pipelines(const std::span<const PipelineCreateInfo>& _create_infos);
+
+	/**
+	 * Compile on a worker. The render pass must outlive the future.
+	 */
+	[[nodiscard]]
+	std::future<Res<Pipeline*>> create_pipeline_async(PipelineCreateInfo&& _create_info);
+
+	/**
+	 * Create or reuse a compute pipeline. Shares the shader, layout and pipeline caches with graphics pipelines.
+	 */
+	Res<Pipeline*> create_compute_pipeline(const ComputePipelineCreateInfo& _create_info);
+
+	/**
+	 * Watch `_directory` for rebuilt `.spv` files. A changed shader is reloaded, and the pipelines using it
+	 * are recompiled on the factory's workers. Nothing changes for the renderer until `apply_pipeline_swaps`.
+	 * Render passes of the affected pipelines must still be alive when they are recompiled.
+	 */
+	void enable_hot_reload(const std::string_view& _directory);
+
+	/**
+	 * Swap in the pipelines rebuilt by shader reloads, or relinked with optimization, since the last call.
+	 * Call at a frame boundary, outside any command recording; waits for the device to idle when there is
+	 * something to swap.
+	 * @return The pipelines whose handle changed.
+	 */
+	std::vector<Pipeline*> apply_pipeline_swaps();
+
+	[[nodiscard]]
+	ContentionStats contention_stats() const;
+
+	/**
+	 * Statistics of every live pipeline, copied under the shard locks.
+	 */
+	[[nodiscard]]
+	std::vector<PipelineStatisticsSnapshot> live_pipelines();
+
+	/**
+	 * Write the captured executable statistics of every live pipeline as JSON.
+	 */
+	[[nodiscard]]
+	Res<> dump_statistics_report(const std::string_view& _path = "pipeline_statistics.json");
+
 private:
+	struct PreparedPipeline {
+		CacheKey key;
+		std::vector<Shader*> shaders;
+		Layout* layout{};
+	};
+
+	// Recompiles a pipeline from its own copy of the create info.
+	using Rebuild = std::function<Res<vk::Pipeline>(PipelineFactory&, const PreparedPipeline&)>;
+
+	struct PipelineEntry {
+		// Atomic so cache hits can take references side by side under a shared shard lock.
+		std::atomic<u32> count;
+		Pipeline pipeline;
+		Rebuild rebuild;
+	};
+
+	// A compile other threads wait on instead of starting their own.
+	struct InFlight {
+		std::promise<Res<Pipeline*>> promise;
+		std::shared_future<Res<Pipeline*>> result{ promise.get_future().share() };
+		u32 waiters{};
+	};
+
+	// Pipelines are striped over shards by key, so cache hits do not queue behind shader loads or each other.
+	struct PipelineShard {
+		std::shared_mutex mutex;
+		std::unordered_map<CacheKey, PipelineEntry> pipelines;
+		std::unordered_map<CacheKey, std::shared_ptr<InFlight>> in_flight;
+	};
+	static constexpr usize pipeline_shard_count = 16;
+
+	// Refcounted Vulkan handles shared by every user with the same canonical content.
+	template <typename THandle>
+	struct SharedHandles {
+		std::unordered_map<CacheKey, std::pair<u32, THandle>> entries;
+		std::unordered_map<typename THandle::CType, CacheKey> keys;
+
+		Option<THandle> acquire(const CacheKey& _key) {
+			const auto found = entries.find(_key);
+			if (found == entries.end()) return std::nullopt;
+			++found->second.first;
+			return found->second.second;
+		}
+
+		void insert(CacheKey&& _key, THandle _handle) {
+			keys.emplace(_handle, _key);
+			entries.emplace(std::move(_key), std::pair{ 1u, _handle });
+		}
+
+		// True when that was the last reference, and the caller destroys the handle.
+		b8 release(THandle _handle) {
+			const auto found = keys.find(_handle);
+			if (found == keys.end()) return false;
+			const auto entry = entries.find(found->second);
+			if (--entry->second.first > 0) return false;
+			entries.erase(entry);
+			keys.erase(found);
+			return true;
+		}
+	};
+
+	struct AtomicContentionStats {
+		std::atomic<u64> cache_hits;
+		std::atomic<u64> compiles;
+		std::atomic<u64> deduplicated;
+		std::atomic<u64> shard_waits;
+		std::atomic<u64> factory_waits;
+	};
+
+	struct PipelineSwap {
+		CacheKey key;
+		vk::Pipeline pipeline;
+		// Only swapped while the pipeline still uses this handle; null swaps unconditionally.
+		vk::Pipeline replaces;
+		// Shaders a reload rebuilt against, each holding a reference. Empty for relinks.
+		std::vector<Shader*> shaders;
+	};
+
+	enum class LibraryPart : u8 {
+		eVertexInput,
+		ePreRasterization,
+		eFragmentShader,
+		eFragmentOutput,
+	};
+	static constexpr usize library_part_count = 4;
+	using LibraryKeys = std::array<CacheKey, library_part_count>;
+
+	Res<Pipeline*> find_or_build(const std::string& _name, CacheKey&& _key, const std::vector<std::string_view>& _shader_files, const std::vector<std::string_view>& _dynamic_buffers, const std::function<Rebuild()>& _make_rebuild);
+	Res<PreparedPipeline> prepare_pipeline(const std::string& _name, CacheKey&& _key, const std::vector<std::string_view>& _shader_files, const std::vector<std::string_view>& _dynamic_buffers);
+	Res<vk::Pipeline> compile_pipeline(const PipelineCreateInfo& _create_info, const PreparedPipeline& _prepared);
+	Res<vk::Pipeline> compile_compute_pipeline(const ComputePipelineCreateInfo& _create_info, const PreparedPipeline& _prepared);
+	Res<vk::Pipeline> link_pipeline(const PipelineCreateInfo& _create_info, const PreparedPipeline& _prepared, const GraphicsPipelineState& _state);
+	Res<vk::Pipeline> acquire_library(const CacheKey& _key, const std::function<Res<vk::Pipeline>()>& _create);
+	void release_libraries(const std::span<const CacheKey>& _keys) noexcept;
+	void destroy_pipeline_handle(vk::Pipeline _pipeline) noexcept;
+	Res<Pipeline*> commit_pipeline(const std::string& _name, PreparedPipeline&& _prepared, vk::Pipeline _pipeline, Rebuild&& _rebuild);
+	static Rebuild make_rebuild(const PipelineCreateInfo& _create_info);
+	static Rebuild make_rebuild(const ComputePipelineCreateInfo& _create_info);
+	[[nodiscard]]
+	vk::PipelineCreateFlags statistics_flags() const;
+	std::vector<PipelineExecutable> query_executables(vk::Pipeline _pipeline, const std::string& _name) const;
+	void record_creation(const std::string& _name, f64 _start_time, const vk::PipelineCreationFeedbackEXT& _pipeline_feedback, const std::span<const vk::PipelineCreationFeedbackEXT>& _stage_feedback);
+	void release_prepared(const PreparedPipeline& _prepared) noexcept;
+
 	void destroy_pipeline(Pipeline* _pipeline) noexcept;
+	void release_pipeline_resources(Pipeline& _pipeline) noexcept;
+
+	PipelineShard& pipeline_shard(const CacheKey& _key) {
+		return pipeline_shards_[_key.hash % pipeline_shard_count];
+	}
+
+	template <typename TLock>
+	void lock_counted(TLock& _lock, std::atomic<u64>& _waits) {
+		if (!_lock.try_lock()) {
+			_waits.fetch_add(1, std::memory_order_relaxed);
+			_lock.lock();
+		}
+	}
+
+	std::unique_lock<std::mutex> lock_factory();
 
 	Res<ShaderInfo> get_shader_reflection_info(const std::string_view& _name, const std::vector<u32>& _code) const;
+	Res<Shader> load_shader(const std::string_view& _name);
 	Res<Shader*> create_shader_module(const std::string_view& _name);
+	void reload_shader(const std::string& _path);
 	Res<std::vector<Shader*>> create_shaders(const std::vector<std::string_view>& _names);
 	void destroy_shader_module(Shader* _shader) noexcept;
+	// Current entry for the shader's name, or the superseded one it still points at.
+	std::pair<u32, Shader>* find_shader_entry(const Shader* _shader);
 
-	Res<std::vector<vk::DescriptorSetLayout>> create_descriptor_layouts(const ShaderInfo& _shader_info);
-	Res<Layout*> create_pipeline_layout(const std::vector<Shader*>& _shaders);
+	Res<std::vector<vk::DescriptorSetLayout>> acquire_set_layouts(const ShaderInfo& _shader_info);
+	Res<Layout*> create_pipeline_layout(const std::vector<Shader*>& _shaders, const std::vector<std::string_view>& _dynamic_buffers);
 	void destroy_pipeline_layout(Layout* _layout) noexcept;
+	void create_update_templates(Layout& _layout);
 
 	// Fields
-	std::unordered_map<usize, std::pair<u32, Shader>> shader_map_;
-	std::unordered_map<usize, std::pair<u32, Layout>> layout_map_;
-	std::unordered_map<usize, std::pair<u32, Pipeline>> pipeline_map_;
+	// Keyed by the file name itself, two names must never share an entry.
+	std::unordered_map<std::string, std::pair<u32, Shader>> shader_map_;
+	std::unordered_map<CacheKey, std::pair<u32, Layout>> layout_map_;
+	SharedHandles<vk::DescriptorSetLayout> set_layouts_;
+	SharedHandles<vk::PipelineLayout> pipeline_layouts_;
+	std::array<PipelineShard, pipeline_shard_count> pipeline_shards_;
+	std::vector<PipelineSwap> pending_swaps_;
+	// Versions replaced by a reload. Kept as they were until the last pipeline or compile using them lets go.
+	std::vector<decltype(shader_map_)::node_type> superseded_shaders_;
+
+	std::unordered_map<CacheKey, std::pair<u32, vk::Pipeline>> library_map_;
+	// Libraries each linked pipeline handle holds a reference on.
+	std::unordered_map<VkPipeline, LibraryKeys> linked_libraries_;
+
+	// Guards everything but the pipeline shards. Taken before a shard lock, never while holding one.
+	std::mutex mutex_;
+	AtomicContentionStats contention_;
+	Owned<ThreadPool> workers_;
+	Owned<FileWatcher> shader_watcher_;
 
 	friend Pipeline;
 };
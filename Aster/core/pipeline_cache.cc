@@ -0,0 +1,155 @@
+// =============================================
+//  Aster: pipeline_cache.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "pipeline_cache.h"
+
+#include <core/device.h>
+#include <util/files.h>
+
+PipelineCache::PipelineCache(PipelineCache&& _other) noexcept: cache{ std::exchange(_other.cache, nullptr) }
+                                                             , path{ std::move(_other.path) }
+                                                             , stats{ _other.stats }
+                                                             , device_{ std::exchange(_other.device_, nullptr) }
+                                                             , properties_{ _other.properties_ } {}
+
+PipelineCache& PipelineCache::operator=(PipelineCache&& _other) noexcept {
+	if (this == &_other) return *this;
+	std::swap(cache, _other.cache);
+	std::swap(path, _other.path);
+	std::swap(stats, _other.stats);
+	std::swap(device_, _other.device_);
+	std::swap(properties_, _other.properties_);
+	return *this;
+}
+
+Res<PipelineCache> PipelineCache::create(const Borrowed<Device>& _device, const std::string_view& _path) {
+	const auto& properties = _device->physical_device.properties;
+
+	std::vector<u8> file_data;
+	std::span<const u8> initial_data;
+	if (file_exists(_path)) {
+		file_data = load_binary_file(_path);
+
+		const auto* header = recast<const FileHeader*>(file_data.data());
+		const auto payload = file_data.size() >= sizeof(FileHeader) ? std::span<const u8>{ file_data }.subspan(sizeof(FileHeader)) : std::span<const u8>{};
+		if (file_data.size() < sizeof(FileHeader) || header->magic != file_magic || header->version != file_version) {
+			WARN(std::fmt("Pipeline cache '%s' is not a cache file, starting cold", _path.data()));
+		} else if (!is_compatible(*header, properties)) {
+			INFO(std::fmt("Pipeline cache '%s' was written by another device or driver, starting cold", _path.data()));
+		} else if (header->data_size != payload.size() || header->data_hash != hash_any(std::string_view{ recast<const char*>(payload.data()), payload.size() })) {
+			WARN(std::fmt("Pipeline cache '%s' is corrupt, starting cold", _path.data()));
+		} else {
+			initial_data = payload;
+		}
+	}
+
+	vk::Result result;
+	vk::PipelineCache cache;
+	tie(result, cache) = _device->device.createPipelineCache({
+		.initialDataSize = initial_data.size(),
+		.pInitialData = initial_data.data(),
+	});
+	if (failed(result) && !initial_data.empty()) {
+		// Drivers may still reject data that passed our checks; a cold cache is always acceptable.
+		WARN(std::fmt("Pipeline cache '%s' rejected by the driver with %s, starting cold", _path.data(), to_cstr(result)));
+		initial_data = {};
+		tie(result, cache) = _device->device.createPipelineCache({});
+	}
+	if (failed(result)) {
+		return Err::make(std::fmt("Pipeline cache creation failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+	_device->set_object_name(cache, "Pipeline cache");
+
+	INFO_IF(!initial_data.empty(), std::fmt("Pipeline cache loaded %llu bytes from '%s'", cast<u64>(initial_data.size()), _path.data()));
+
+	return PipelineCache{
+		_device->device,
+		properties,
+		cache,
+		_path,
+		initial_data.size(),
+	};
+}
+
+Res<> PipelineCache::save() const {
+	if (!cache) return {};
+
+	auto [result, data] = device_.getPipelineCacheData(cache);
+	if (failed(result)) {
+		return Err::make(std::fmt("Pipeline cache data query failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	// Zeroed as a whole, padding included, so no stack bytes end up in the file.
+	FileHeader header{};
+	memset(&header, 0, sizeof(FileHeader));
+	header.magic = file_magic;
+	header.version = file_version;
+	header.vendor_id = properties_.vendorID;
+	header.device_id = properties_.deviceID;
+	header.driver_version = properties_.driverVersion;
+	header.data_size = data.size();
+	header.data_hash = hash_any(std::string_view{ recast<const char*>(data.data()), data.size() });
+	memcpy(header.cache_uuid, properties_.pipelineCacheUUID.data(), VK_UUID_SIZE);
+
+	std::vector<u8> file_data(sizeof(FileHeader) + data.size());
+	memcpy(file_data.data(), &header, sizeof(FileHeader));
+	memcpy(file_data.data() + sizeof(FileHeader), data.data(), data.size());
+
+	if (!write_binary_file_atomic(path, file_data)) {
+		return Err::make(std::fmt("Pipeline cache could not be written to '%s'" CODE_LOC, path.c_str()));
+	}
+	VERBOSE(std::fmt("Pipeline cache saved %llu bytes to '%s'", cast<u64>(data.size()), path.c_str()));
+	return {};
+}
+
+void PipelineCache::record(const std::string_view& _name, const f64 _ms, const vk::PipelineCreationFeedbackEXT& _pipeline_feedback, const std::span<const vk::PipelineCreationFeedbackEXT>& _stage_feedback) {
+	++stats.pipelines;
+	stats.creation_ms += _ms;
+
+	if (!(_pipeline_feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eValid)) {
+		++stats.feedback_missing;
+		VERBOSE(std::fmt("Pipeline %s created in %.3f ms", _name.data(), _ms));
+		return;
+	}
+
+	const b8 hit = cast<b8>(_pipeline_feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit);
+	stats.cache_hits += hit;
+
+	std::string stage_times;
+	for (const auto& stage_ : _stage_feedback) {
+		if (!(stage_.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eValid)) continue;
+		stage_times += std::fmt(" %.3f%s", cast<f64>(stage_.duration) * 1e-6, (stage_.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit) ? "(hit)" : "");
+	}
+	VERBOSE(std::fmt("Pipeline %s created in %.3f ms (driver %.3f ms, cache %s), stages ms:%s", _name.data(), _ms, cast<f64>(_pipeline_feedback.duration) * 1e-6, hit ? "hit" : "miss", stage_times.c_str()));
+}
+
+void PipelineCache::log_stats() const {
+	if (!cache || stats.pipelines == 0) return;
+
+	const auto* start = stats.warm ? "Warm" : "Cold";
+	if (stats.feedback_missing == stats.pipelines) {
+		INFO(std::fmt("%s start: %llu pipelines created in %.3f ms", start, stats.pipelines, stats.creation_ms));
+	} else {
+		INFO(std::fmt("%s start: %llu pipelines created in %.3f ms, %llu cache hits", start, stats.pipelines, stats.creation_ms, stats.cache_hits));
+	}
+}
+
+b8 PipelineCache::is_compatible(const FileHeader& _header, const vk::PhysicalDeviceProperties& _properties) {
+	return _header.vendor_id == _properties.vendorID &&
+		_header.device_id == _properties.deviceID &&
+		_header.driver_version == _properties.driverVersion &&
+		memcmp(_header.cache_uuid, _properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::destroy() {
+	if (!cache) return;
+
+	device_.destroyPipelineCache(cache);
+	cache = nullptr;
+}
+
+PipelineCache::~PipelineCache() {
+	destroy();
+}
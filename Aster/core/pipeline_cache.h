@@ -0,0 +1,98 @@
+// =============================================
+//  Aster: pipeline_cache.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <span>
+
+class Device;
+
+/**
+ * @class PipelineCache
+ *
+ * @brief vk::PipelineCache persisted to disk between runs.
+ *
+ * The file starts with our own header, which records the vendor, device, driver version and cache UUID it
+ * was written with. Data from any other driver is dropped and the cache starts cold. The file is replaced
+ * atomically on save, so an interrupted run can not corrupt it.
+ * Also collects creation timings and VK_EXT_pipeline_creation_feedback results, split by whether the
+ * run started warm.
+ */
+struct PipelineCache {
+	static constexpr const char* default_path = "pipeline_cache.bin";
+
+	struct Stats {
+		b8 warm{ false };
+		usize loaded_bytes{};
+		u64 pipelines{};
+		u64 cache_hits{};
+		u64 feedback_missing{};
+		f64 creation_ms{};
+	};
+
+	vk::PipelineCache cache;
+	std::string path;
+	Stats stats;
+
+	PipelineCache() = default;
+
+	PipelineCache(const vk::Device& _device, const vk::PhysicalDeviceProperties& _properties, const vk::PipelineCache& _cache, const std::string_view& _path, usize _loaded_bytes)
+		: cache(_cache)
+		, path(_path)
+		, stats{ .warm = _loaded_bytes > 0, .loaded_bytes = _loaded_bytes }
+		, device_(_device)
+		, properties_(_properties) {}
+
+	PipelineCache(const PipelineCache& _other) = delete;
+	PipelineCache(PipelineCache&& _other) noexcept;
+	PipelineCache& operator=(const PipelineCache& _other) = delete;
+	PipelineCache& operator=(PipelineCache&& _other) noexcept;
+
+	/**
+	 * Load `_path` if it exists and matches the device. Missing or stale files are not an error.
+	 */
+	static Res<PipelineCache> create(const Borrowed<Device>& _device, const std::string_view& _path = default_path);
+
+	/**
+	 * Serialize the cache back to `path`.
+	 */
+	[[nodiscard]]
+	Res<> save() const;
+
+	/**
+	 * Account for one pipeline creation of `_ms` milliseconds. The feedback spans are empty when
+	 * the creation feedback extension is unavailable.
+	 */
+	void record(const std::string_view& _name, f64 _ms, const vk::PipelineCreationFeedbackEXT& _pipeline_feedback, const std::span<const vk::PipelineCreationFeedbackEXT>& _stage_feedback);
+
+	void log_stats() const;
+
+	void destroy();
+
+	~PipelineCache();
+
+private:
+	struct FileHeader {
+		u32 magic;
+		u32 version;
+		u32 vendor_id;
+		u32 device_id;
+		u32 driver_version;
+		u8 cache_uuid[VK_UUID_SIZE];
+		u64 data_size;
+		u64 data_hash;
+	};
+
+	static constexpr u32 file_magic = 0x43505341; // "ASPC"
+	static constexpr u32 file_version = 1;
+
+	[[nodiscard]]
+	static b8 is_compatible(const FileHeader& _header, const vk::PhysicalDeviceProperties& _properties);
+
+	vk::Device device_;
+	vk::PhysicalDeviceProperties properties_;
+};
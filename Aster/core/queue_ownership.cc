@@ -0,0 +1,70 @@
+// =============================================
+//  Aster: queue_ownership.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "queue_ownership.h"
+
+void QueueOwnershipTransfer::release(const vk::CommandBuffer _cmd, const vk::Buffer _buffer, const vk::DeviceSize _offset, const vk::DeviceSize _size) const {
+	if (!is_required()) return;
+
+	// Destination access is ignored on release; visibility is handled by the acquire.
+	_cmd.pipelineBarrier(src_stage, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {
+		{
+			.srcAccessMask = src_access,
+			.dstAccessMask = {},
+			.srcQueueFamilyIndex = src_family,
+			.dstQueueFamilyIndex = dst_family,
+			.buffer = _buffer,
+			.offset = _offset,
+			.size = _size,
+		} }, {});
+}
+
+void QueueOwnershipTransfer::release(const vk::CommandBuffer _cmd, const vk::Image _image, const vk::ImageSubresourceRange& _range, const vk::ImageLayout _old_layout, const vk::ImageLayout _new_layout) const {
+	if (!is_required()) return;
+
+	_cmd.pipelineBarrier(src_stage, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, {
+		{
+			.srcAccessMask = src_access,
+			.dstAccessMask = {},
+			.oldLayout = _old_layout,
+			.newLayout = _new_layout,
+			.srcQueueFamilyIndex = src_family,
+			.dstQueueFamilyIndex = dst_family,
+			.image = _image,
+			.subresourceRange = _range,
+		} });
+}
+
+void QueueOwnershipTransfer::acquire(const vk::CommandBuffer _cmd, const vk::Buffer _buffer, const vk::DeviceSize _offset, const vk::DeviceSize _size) const {
+	const auto required = is_required();
+
+	// Source access is ignored on acquire; availability was handled by the release.
+	_cmd.pipelineBarrier(required ? vk::PipelineStageFlagBits::eTopOfPipe : src_stage, dst_stage, {}, {}, {
+		{
+			.srcAccessMask = required ? vk::AccessFlags{} : src_access,
+			.dstAccessMask = dst_access,
+			.srcQueueFamilyIndex = required ? src_family : VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = required ? dst_family : VK_QUEUE_FAMILY_IGNORED,
+			.buffer = _buffer,
+			.offset = _offset,
+			.size = _size,
+		} }, {});
+}
+
+void QueueOwnershipTransfer::acquire(const vk::CommandBuffer _cmd, const vk::Image _image, const vk::ImageSubresourceRange& _range, const vk::ImageLayout _old_layout, const vk::ImageLayout _new_layout) const {
+	const auto required = is_required();
+
+	_cmd.pipelineBarrier(required ? vk::PipelineStageFlagBits::eTopOfPipe : src_stage, dst_stage, {}, {}, {}, {
+		{
+			.srcAccessMask = required ? vk::AccessFlags{} : src_access,
+			.dstAccessMask = dst_access,
+			.oldLayout = _old_layout,
+			.newLayout = _new_layout,
+			.srcQueueFamilyIndex = required ? src_family : VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = required ? dst_family : VK_QUEUE_FAMILY_IGNORED,
+			.image = _image,
+			.subresourceRange = _range,
+		} });
+}
@@ -0,0 +1,38 @@
+// =============================================
+//  Aster: queue_ownership.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+/**
+ * @class QueueOwnershipTransfer
+ *
+ * @brief Moves an exclusive resource from one queue family to another.
+ *
+ * `release` is recorded on the source queue and `acquire` on the destination queue, with the
+ * acquiring submission waiting on the releasing one. Both sides must pass the same layouts.
+ * When the families match no transfer is needed; `release` records nothing and `acquire` records
+ * an ordinary barrier, so callers do not have to special-case aliased queues.
+ */
+struct QueueOwnershipTransfer {
+	u32 src_family{ VK_QUEUE_FAMILY_IGNORED };
+	u32 dst_family{ VK_QUEUE_FAMILY_IGNORED };
+	vk::PipelineStageFlags src_stage = vk::PipelineStageFlagBits::eAllCommands;
+	vk::AccessFlags src_access = {};
+	vk::PipelineStageFlags dst_stage = vk::PipelineStageFlagBits::eAllCommands;
+	vk::AccessFlags dst_access = {};
+
+	[[nodiscard]]
+	b8 is_required() const {
+		return src_family != dst_family && src_family != VK_QUEUE_FAMILY_IGNORED && dst_family != VK_QUEUE_FAMILY_IGNORED;
+	}
+
+	void release(vk::CommandBuffer _cmd, vk::Buffer _buffer, vk::DeviceSize _offset = 0, vk::DeviceSize _size = VK_WHOLE_SIZE) const;
+	void release(vk::CommandBuffer _cmd, vk::Image _image, const vk::ImageSubresourceRange& _range, vk::ImageLayout _old_layout, vk::ImageLayout _new_layout) const;
+
+	void acquire(vk::CommandBuffer _cmd, vk::Buffer _buffer, vk::DeviceSize _offset = 0, vk::DeviceSize _size = VK_WHOLE_SIZE) const;
+	void acquire(vk::CommandBuffer _cmd, vk::Image _image, const vk::ImageSubresourceRange& _range, vk::ImageLayout _old_layout, vk::ImageLayout _new_layout) const;
+};
@@ -5,147 +5,391 @@
 
 #include "resource_pool.h"
 
-void ResourceSet::set_buffer(const std::string_view& _name, vk::DescriptorBufferInfo&& _buffer_info) {
-	auto& descriptor_info = shader_info->descriptors[shader_info->descriptor_names.find(std::string(_name))->second];
+namespace {
+	b8 is_image_descriptor(const vk::DescriptorType _type) {
+		switch (_type) {
+			case vk::DescriptorType::eSampler:
+			case vk::DescriptorType::eCombinedImageSampler:
+			case vk::DescriptorType::eSampledImage:
+			case vk::DescriptorType::eStorageImage:
+			case vk::DescriptorType::eInputAttachment:
+				return true;
+			default:
+				return false;
+		}
+	}
+}
 
-	buffer_info_storage_.push_back(std::move(_buffer_info));
+ResourceSet::ResourceSet(const Borrowed<ResourcePool>& _pool, const Borrowed<ShaderInfo>& _shader_info, std::vector<vk::DescriptorSet>&& _sets)
+	: parent_pool(_pool)
+	, shader_info(_shader_info)
+	, sets(std::move(_sets))
+	, slots_(_pool->layout->set_slots.back())
+	, written_(_pool->layout->set_slots.back(), false) {
+	ERROR_IF(sets.size() > 32, std::fmt("Layout %s has %llu sets, only 32 are tracked for updates", shader_info->name.c_str(), cast<u64>(sets.size())));
+}
 
-	writes_.push_back({
-		.dstSet = sets[descriptor_info.set],
-		.dstBinding = descriptor_info.binding,
-		.dstArrayElement = 0,
-		.descriptorCount = 1,
-		.descriptorType = descriptor_info.type,
-		.pBufferInfo = &buffer_info_storage_.back(),
-	});
+Res<BindingHandle> ResourceSet::resolve(const std::string_view& _name) const {
+	const auto found = shader_info->descriptor_names.find(_name);
+	if (found == shader_info->descriptor_names.end()) {
+		return Err::make(std::fmt("Descriptor '%s' is not in layout %s" CODE_LOC, std::string(_name).c_str(), shader_info->name.c_str()));
+	}
+
+	const auto& descriptor_info = shader_info->descriptors[found->second];
+	return BindingHandle{
+		.set = descriptor_info.set,
+		.binding = descriptor_info.binding,
+		.type = descriptor_info.type,
+		.index = found->second,
+		.array_length = descriptor_info.array_length,
+	};
 }
 
-void ResourceSet::set_buffer_array_index(const std::string_view& _name, vk::DescriptorBufferInfo&& _buffer_info, const u32 _index) {
-	auto& descriptor_info = shader_info->descriptors[shader_info->descriptor_names.find(std::string(_name))->second];
+b8 ResourceSet::check_write(const BindingHandle& _binding, const b8 _is_image, const u32 _first, const u32 _count) const {
+	if (!_binding.valid() || _binding.set >= sets.size() || _binding.index >= shader_info->descriptors.size()) {
+		ERROR(std::fmt("Binding (%u, %u) does not belong to layout %s", _binding.set, _binding.binding, shader_info->name.c_str()));
+		return false;
+	}
+	if (is_image_descriptor(_binding.type) != _is_image) {
+		ERROR(std::fmt("Binding (%u, %u) of type %s can not take %s info", _binding.set, _binding.binding, to_string(_binding.type).c_str(), _is_image ? "image" : "buffer"));
+		return false;
+	}
+	if (sets[_binding.set] == parent_pool->parent_device->bindless.set) {
+		ERROR(std::fmt("Binding (%u, %u) is in the bindless heap, register the resource instead", _binding.set, _binding.binding));
+		return false;
+	}
+	if (_first + _count > _binding.array_length) {
+		ERROR(std::fmt("Binding (%u, %u) writes elements [%u, %u) past its length %u", _binding.set, _binding.binding, _first, _first + _count, _binding.array_length));
+		return false;
+	}
+	return true;
+}
 
-	buffer_info_storage_.push_back(std::move(_buffer_info));
+void ResourceSet::set_buffer(const std::string_view& _name, vk::DescriptorBufferInfo&& _buffer_info) {
+	if (const auto binding = resolve(_name)) {
+		set_buffer(binding.value(), std::move(_buffer_info));
+	} else {
+		ERROR(binding.error().what());
+	}
+}
 
-	writes_.push_back({
-		.dstSet = sets[descriptor_info.set],
-		.dstBinding = descriptor_info.binding,
-		.dstArrayElement = _index,
-		.descriptorCount = 1,
-		.descriptorType = descriptor_info.type,
-		.pBufferInfo = &buffer_info_storage_.back(),
-	});
+void ResourceSet::set_buffer_array_index(const std::string_view& _name, vk::DescriptorBufferInfo&& _buffer_info, const u32 _index) {
+	if (const auto binding = resolve(_name)) {
+		set_buffer_array_index(binding.value(), std::move(_buffer_info), _index);
+	} else {
+		ERROR(binding.error().what());
+	}
 }
 
 void ResourceSet::set_buffer_array(const std::string_view& _name, const std::vector<vk::DescriptorBufferInfo>& _buffer_info, const u32 _offset) {
-	auto& descriptor_info = shader_info->descriptors[shader_info->descriptor_names.find(std::string(_name))->second];
+	if (const auto binding = resolve(_name)) {
+		set_buffer_array(binding.value(), _buffer_info, _offset);
+	} else {
+		ERROR(binding.error().what());
+	}
+}
+
+void ResourceSet::set_texture(const std::string_view& _name, vk::DescriptorImageInfo&& _image_info) {
+	if (const auto binding = resolve(_name)) {
+		set_texture(binding.value(), std::move(_image_info));
+	} else {
+		ERROR(binding.error().what());
+	}
+}
 
-	const auto head = buffer_info_storage_.insert(buffer_info_storage_.end(), _buffer_info.begin(), _buffer_info.end());
+void ResourceSet::set_texture_array_index(const std::string_view& _name, vk::DescriptorImageInfo&& _image_info, const u32 _index) {
+	if (const auto binding = resolve(_name)) {
+		set_texture_array_index(binding.value(), std::move(_image_info), _index);
+	} else {
+		ERROR(binding.error().what());
+	}
+}
 
-	writes_.push_back({
-		.dstSet = sets[descriptor_info.set],
-		.dstBinding = descriptor_info.binding,
-		.dstArrayElement = _offset,
-		.descriptorCount = cast<u32>(_buffer_info.size()),
-		.descriptorType = descriptor_info.type,
-		.pBufferInfo = &*head,
-	});
+void ResourceSet::set_texture_array(const std::string_view& _name, const std::vector<vk::DescriptorImageInfo>& _image_info, const u32 _offset) {
+	if (const auto binding = resolve(_name)) {
+		set_texture_array(binding.value(), _image_info, _offset);
+	} else {
+		ERROR(binding.error().what());
+	}
 }
 
-void ResourceSet::set_texture(const std::string_view& _name, vk::DescriptorImageInfo&& _image_info) {
-	auto& descriptor_info = shader_info->descriptors[shader_info->descriptor_names.find(std::string(_name))->second];
+void ResourceSet::set_buffer(const BindingHandle& _binding, vk::DescriptorBufferInfo&& _buffer_info) {
+	set_buffer_array_index(_binding, std::move(_buffer_info), 0);
+}
 
-	image_info_storage_.push_back(std::move(_image_info));
+void ResourceSet::set_buffer_array_index(const BindingHandle& _binding, vk::DescriptorBufferInfo&& _buffer_info, const u32 _index) {
+	if (!check_write(_binding, false, _index, 1)) return;
+	slot(_binding, _index)->buffer = _buffer_info;
+}
 
-	writes_.push_back({
-		.dstSet = sets[descriptor_info.set],
-		.dstBinding = descriptor_info.binding,
-		.dstArrayElement = 0,
-		.descriptorCount = 1,
-		.descriptorType = descriptor_info.type,
-		.pImageInfo = &image_info_storage_.back(),
-	});
+void ResourceSet::set_buffer_array(const BindingHandle& _binding, const std::vector<vk::DescriptorBufferInfo>& _buffer_info, const u32 _offset) {
+	if (!check_write(_binding, false, _offset, cast<u32>(_buffer_info.size()))) return;
+	for (u32 i_ = 0; i_ < _buffer_info.size(); ++i_) {
+		slot(_binding, _offset + i_)->buffer = _buffer_info[i_];
+	}
 }
 
-void ResourceSet::set_texture_array_index(const std::string_view& _name, vk::DescriptorImageInfo&& _image_info, const u32 _index) {
-	auto& descriptor_info = shader_info->descriptors[shader_info->descriptor_names.find(std::string(_name))->second];
+void ResourceSet::set_texture(const BindingHandle& _binding, vk::DescriptorImageInfo&& _image_info) {
+	set_texture_array_index(_binding, std::move(_image_info), 0);
+}
 
-	image_info_storage_.push_back(std::move(_image_info));
+void ResourceSet::set_texture_array_index(const BindingHandle& _binding, vk::DescriptorImageInfo&& _image_info, const u32 _index) {
+	if (!check_write(_binding, true, _index, 1)) return;
+	slot(_binding, _index)->image = _image_info;
+}
 
-	writes_.push_back({
-		.dstSet = sets[descriptor_info.set],
-		.dstBinding = descriptor_info.binding,
-		.dstArrayElement = _index,
-		.descriptorCount = 1,
-		.descriptorType = descriptor_info.type,
-		.pImageInfo = &image_info_storage_.back(),
-	});
+void ResourceSet::set_texture_array(const BindingHandle& _binding, const std::vector<vk::DescriptorImageInfo>& _image_info, const u32 _offset) {
+	if (!check_write(_binding, true, _offset, cast<u32>(_image_info.size()))) return;
+	for (u32 i_ = 0; i_ < _image_info.size(); ++i_) {
+		slot(_binding, _offset + i_)->image = _image_info[i_];
+	}
 }
 
-void ResourceSet::set_texture_array(const std::string_view& _name, const std::vector<vk::DescriptorImageInfo>& _image_info, u32 _offset) {
-	auto& descriptor_info = shader_info->descriptors[shader_info->descriptor_names.find(std::string(_name))->second];
+DescriptorSlot* ResourceSet::slot(const BindingHandle& _binding, const u32 _element) {
+	const auto index = parent_pool->layout->descriptor_slots[_binding.index] + _element;
+	written_[index] = true;
+	dirty_sets_ |= 1u << _binding.set;
+	return &slots_[index];
+}
 
-	const auto head = image_info_storage_.insert(image_info_storage_.end(), _image_info.begin(), _image_info.end());
+void ResourceSet::append_writes(const u32 _set, std::vector<vk::WriteDescriptorSet>& _writes) const {
+	const auto& layout = *parent_pool->layout;
+	const auto& descriptors = layout.layout_info.descriptors;
 
-	writes_.push_back({
-		.dstSet = sets[descriptor_info.set],
-		.dstBinding = descriptor_info.binding,
-		.dstArrayElement = _offset,
-		.descriptorCount = cast<u32>(_image_info.size()),
-		.descriptorType = descriptor_info.type,
-		.pImageInfo = &*head,
-	});
+	for (usize i_ = 0; i_ < descriptors.size(); ++i_) {
+		const auto& descriptor_ = descriptors[i_];
+		if (descriptor_.set != _set) continue;
+
+		// One write per run of written elements; the rest keep whatever was flushed before.
+		const auto first_slot = layout.descriptor_slots[i_];
+		u32 element = 0;
+		while (element < descriptor_.array_length) {
+			if (!written_[first_slot + element]) {
+				++element;
+				continue;
+			}
+			u32 count = 1;
+			while (element + count < descriptor_.array_length && written_[first_slot + element + count]) {
+				++count;
+			}
+
+			const auto& head = slots_[first_slot + element];
+			const auto is_image = is_image_descriptor(descriptor_.type);
+			_writes.push_back({
+				.dstSet = sets[_set],
+				.dstBinding = descriptor_.binding,
+				.dstArrayElement = element,
+				.descriptorCount = count,
+				.descriptorType = descriptor_.type,
+				.pImageInfo = is_image ? recast<const vk::DescriptorImageInfo*>(&head.image) : nullptr,
+				.pBufferInfo = is_image ? nullptr : recast<const vk::DescriptorBufferInfo*>(&head.buffer),
+			});
+			element += count;
+		}
+	}
 }
 
 void ResourceSet::update() {
-	parent_pool->parent_device->device.updateDescriptorSets(writes_, {});
+	if (!dirty_sets_) return;
+
+	const auto& layout = *parent_pool->layout;
+	const auto& device = parent_pool->parent_device->device;
+
+	std::vector<vk::WriteDescriptorSet> writes;
+	for (u32 set_ = 0; set_ < sets.size(); ++set_) {
+		if (!(dirty_sets_ & 1u << set_)) continue;
+
+		const auto first = written_.begin() + layout.set_slots[set_];
+		const auto last = written_.begin() + layout.set_slots[set_ + 1];
+		if (layout.update_templates[set_] && std::all_of(first, last, [](const b8 _written) { return _written; })) {
+			device.updateDescriptorSetWithTemplate(sets[set_], layout.update_templates[set_], slots_.data() + layout.set_slots[set_]);
+		} else {
+			append_writes(set_, writes);
+		}
+	}
+	if (!writes.empty()) {
+		device.updateDescriptorSets(writes, {});
+	}
+	dirty_sets_ = 0;
+}
 
-	writes_.clear();
-	buffer_info_storage_.clear();
-	image_info_storage_.clear();
+void ResourceSet::update_all(const std::span<ResourceSet* const> _sets) {
+	std::vector<vk::WriteDescriptorSet> writes;
+	const vk::Device* device = nullptr;
+	for (auto* resource_set_ : _sets) {
+		if (!resource_set_->dirty_sets_) continue;
+		device = &resource_set_->parent_pool->parent_device->device;
+		for (u32 set_ = 0; set_ < resource_set_->sets.size(); ++set_) {
+			if (resource_set_->dirty_sets_ & 1u << set_) {
+				resource_set_->append_writes(set_, writes);
+			}
+		}
+		resource_set_->dirty_sets_ = 0;
+	}
+	if (!writes.empty()) {
+		device->updateDescriptorSets(writes, {});
+	}
 }
 
 Res<ResourceSet> ResourcePool::allocate_resource_set() {
-	std::vector<vk::DescriptorSet> sets;
-	auto [res, set_vector] = parent_device->device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
-		.descriptorPool = pool_,
-		.descriptorSetCount = cast<u32>(layout->descriptor_set_layouts.size()),
-		.pSetLayouts = layout->descriptor_set_layouts.data()
+	// The bindless set is the device's; only the others come from this pool.
+	const auto& bindless = parent_device->bindless;
+	std::vector<vk::DescriptorSetLayout> set_layouts;
+	for (const auto& dsl_ : layout->descriptor_set_layouts) {
+		if (dsl_ != bindless.set_layout) set_layouts.push_back(dsl_);
+	}
+	const auto set_count = cast<u32>(set_layouts.size());
+	const auto with_bindless = [this, &bindless](std::vector<vk::DescriptorSet>&& _sets) {
+		if (bindless.valid() && BindlessHeap::set_index < layout->descriptor_set_layouts.size() && layout->descriptor_set_layouts[BindlessHeap::set_index] == bindless.set_layout) {
+			_sets.insert(_sets.begin() + BindlessHeap::set_index, bindless.set);
+		}
+		return std::move(_sets);
+	};
+	if (set_count == 0) {
+		return ResourceSet{ borrow(this), borrow(layout->layout_info), with_bindless({}) };
+	}
+
+	auto& chain = chains_[current_chain_];
+	while (true) {
+		const b8 is_new_pool = chain.current == chain.pools.size();
+		if (is_new_pool) {
+			// Each new pool doubles the chain, so a steady state needs few pools.
+			const auto capacity = chain.capacities.empty() ? max_resource_sets : chain.capacities.back() * 2;
+			auto pool = create_pool(capacity);
+			if (!pool) {
+				return Err::make(std::fmt("Layout %s Descriptor Pool growth failed" CODE_LOC, layout->layout_info.name.c_str()), std::move(pool.error()));
+			}
+			chain.pools.push_back(pool.value());
+			chain.capacities.push_back(capacity);
+		}
+
+		auto [res, set_vector] = parent_device->device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
+			.descriptorPool = chain.pools[chain.current],
+			.descriptorSetCount = set_count,
+			.pSetLayouts = set_layouts.data()
+		});
+		if (res == vk::Result::eErrorOutOfPoolMemory || res == vk::Result::eErrorFragmentedPool) {
+			// An empty pool sized for the layout can not fit one set, so growing further never will.
+			if (is_new_pool) {
+				return Err::make(std::fmt("Layout %s Descriptor Set does not fit a fresh pool, failed with %s" CODE_LOC, layout->layout_info.name.c_str(), to_cstr(res)), res);
+			}
+			++stats.overflows;
+			++chain.current;
+			continue;
+		}
+		if (failed(res)) {
+			return Err::make(std::fmt("Layout %s Descriptor Set allocation failed with %s" CODE_LOC, layout->layout_info.name.c_str(), to_cstr(res)), res);
+		}
+
+		++chain.allocated;
+		++stats.sets_allocated;
+		return ResourceSet{ borrow(this), borrow(layout->layout_info), with_bindless(std::move(set_vector)) };
+	}
+}
+
+void ResourcePool::begin_frame(const u32 _frame_index) {
+	if (!transient) {
+		ERROR(std::fmt("Layout %s resource pool is not transient", layout->layout_info.name.c_str()));
+		return;
+	}
+
+	current_chain_ = _frame_index % cast<u32>(chains_.size());
+	auto& chain = chains_[current_chain_];
+	for (const auto& pool_ : chain.pools) {
+		// Always succeeds; older headers still return a result.
+		(void)parent_device->device.resetDescriptorPool(pool_);
+	}
+	chain.current = 0;
+	chain.allocated = 0;
+	++stats.resets;
+}
+
+u32 ResourcePool::pool_count() const {
+	u32 count = 0;
+	for (const auto& chain_ : chains_) {
+		count += cast<u32>(chain_.pools.size());
+	}
+	return count;
+}
+
+f32 ResourcePool::utilization() const {
+	u64 allocated = 0;
+	u64 capacity = 0;
+	for (const auto& chain_ : chains_) {
+		allocated += chain_.allocated;
+		for (const auto capacity_ : chain_.capacities) {
+			capacity += capacity_;
+		}
+	}
+	return capacity ? cast<f32>(allocated) / cast<f32>(capacity) : 0.0f;
+}
+
+Res<vk::DescriptorPool> ResourcePool::create_pool(const u32 _resource_sets) {
+	auto pool_sizes = set_sizes_;
+	for (auto& size_ : pool_sizes) {
+		size_.descriptorCount *= _resource_sets;
+	}
+
+	auto [result, pool] = parent_device->device.createDescriptorPool(vk::DescriptorPoolCreateInfo{
+		.maxSets = _resource_sets * cast<u32>(std::ranges::count_if(layout->descriptor_set_layouts, [this](const vk::DescriptorSetLayout _dsl) { return _dsl != parent_device->bindless.set_layout; })),
+		.poolSizeCount = cast<u32>(pool_sizes.size()),
+		.pPoolSizes = pool_sizes.data()
 	});
-	if (failed(res)) {
-		return Err::make(std::fmt("Layout %s Descriptor Set allocation failed with %s" CODE_LOC, layout->layout_info.name.c_str(), to_cstr(res)));
+	if (failed(result)) {
+		return Err::make(std::fmt("Layout %s Descriptor Pool creation failed with %s" CODE_LOC, layout->layout_info.name.c_str(), to_cstr(result)), result);
 	}
-	return ResourceSet{ borrow(this), borrow(layout->layout_info), std::move(set_vector) };
+	parent_device->set_object_name(pool, std::fmt("%s Descriptor Pool %u", layout->layout_info.name.c_str(), pool_count()));
+	++stats.pools_created;
+	return pool;
 }
 
 Res<ResourcePool> ResourcePool::create(const Borrowed<Device>& _device, Layout* _layout, const u32 _max_resource_sets) {
+	ResourcePool pool;
+	pool.parent_device = _device;
+	pool.layout = _layout;
+	pool.max_resource_sets = std::max(_max_resource_sets, 1u);
 
-	auto& shader_info = _layout->layout_info;
-
-	std::vector<vk::DescriptorPoolSize> pool_sizes;
-	for (auto& desc_ : shader_info.descriptors) {
-		for (auto& pool_ : pool_sizes) {
-			if (pool_.type == desc_.type) {
-				++pool_.descriptorCount;
-				break;
-			}
+	const auto& bindless = _device->bindless;
+	for (const auto& desc_ : _layout->layout_info.descriptors) {
+		if (bindless.valid() && desc_.set == BindlessHeap::set_index) continue;
+		const auto found = std::ranges::find(pool.set_sizes_, desc_.type, &vk::DescriptorPoolSize::type);
+		if (found != pool.set_sizes_.end()) {
+			found->descriptorCount += desc_.array_length;
+			continue;
 		}
-		pool_sizes.push_back(vk::DescriptorPoolSize{
+		pool.set_sizes_.push_back(vk::DescriptorPoolSize{
 			.type = desc_.type,
-			.descriptorCount = 1,
+			.descriptorCount = desc_.array_length,
 		});
 	}
 
-	const auto descriptor_set_count = cast<u32>(_layout->descriptor_set_layouts.size());
+	pool.chains_.resize(1);
+	if (!_layout->descriptor_set_layouts.empty()) {
+		auto first = pool.create_pool(pool.max_resource_sets);
+		if (!first) {
+			return Err::make(std::move(first.error()));
+		}
+		pool.chains_.front().pools.push_back(first.value());
+		pool.chains_.front().capacities.push_back(pool.max_resource_sets);
+	}
+	return std::move(pool);
+}
 
-	vk::DescriptorPool pool;
-	if (const auto res = _device->device.createDescriptorPool(vk::DescriptorPoolCreateInfo{
-		.maxSets = _max_resource_sets * descriptor_set_count,
-		.poolSizeCount = cast<u32>(pool_sizes.size()),
-		.pPoolSizes = pool_sizes.data()
-	}); failed(res.result)) {
-		return Err::make(std::fmt("Layout %s Descriptor Pool creation failed with %s" CODE_LOC, _layout->layout_info.name.c_str(), to_cstr(res.result)));
-	} else {
-		pool = res.value;
+Res<ResourcePool> ResourcePool::create_transient(const Borrowed<Device>& _device, Layout* _layout, const u32 _sets_per_frame, const u32 _frames_in_flight) {
+	auto pool = create(_device, _layout, _sets_per_frame);
+	if (!pool) {
+		return Err::make(std::fmt("Transient resource pool for %s failed" CODE_LOC, _layout->layout_info.name.c_str()), std::move(pool.error()));
 	}
+	// The other frames grow their chains on first use.
+	pool->transient = true;
+	pool->chains_.resize(std::max(_frames_in_flight, 1u));
+	return std::move(pool.value());
+}
 
-	return ResourcePool{ _device, _layout, pool, _max_resource_sets };
+ResourcePool::~ResourcePool() {
+	for (const auto& chain_ : chains_) {
+		for (const auto& pool_ : chain_.pools) {
+			parent_device->device.destroyDescriptorPool(pool_);
+		}
+	}
 }
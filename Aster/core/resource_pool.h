@@ -4,12 +4,30 @@
 // =============================================
 
 #pragma once
-#include <deque>
+#include <span>
 #include <core/device.h>
 #include <core/pipeline.h>
 
 class ResourcePool;
 
+/**
+ * A descriptor resolved by name once, through ResourceSet::resolve.
+ * Setters taking a handle skip the name lookup, so they are safe in hot loops.
+ */
+struct BindingHandle {
+	u32 set{};
+	u32 binding{};
+	vk::DescriptorType type{};
+	// Index into ShaderInfo::descriptors.
+	u32 index{ max_value<u32> };
+	u32 array_length{};
+
+	[[nodiscard]]
+	b8 valid() const {
+		return index != max_value<u32>;
+	}
+};
+
 struct ResourceSet {
 public:
 	Borrowed<ResourcePool> parent_pool;
@@ -18,10 +36,7 @@ public:
 
 	ResourceSet() = default;
 
-	explicit ResourceSet(const Borrowed<ResourcePool>& _pool, const Borrowed<ShaderInfo>& _shader_info, std::vector<vk::DescriptorSet>&& _sets)
-		: parent_pool(_pool)
-		, shader_info(_shader_info)
-		, sets(std::move(_sets)) {}
+	explicit ResourceSet(const Borrowed<ResourcePool>& _pool, const Borrowed<ShaderInfo>& _shader_info, std::vector<vk::DescriptorSet>&& _sets);
 
 	ResourceSet(const ResourceSet& _other) = delete;
 
@@ -29,9 +44,9 @@ public:
 		: parent_pool{ std::move(_other.parent_pool) }
 		, shader_info{ std::move(_other.shader_info) }
 		, sets{ std::move(_other.sets) }
-		, buffer_info_storage_{ std::move(_other.buffer_info_storage_) }
-		, image_info_storage_{ std::move(_other.image_info_storage_) }
-		, writes_{ std::move(_other.writes_) } {}
+		, slots_{ std::move(_other.slots_) }
+		, written_{ std::move(_other.written_) }
+		, dirty_sets_{ std::exchange(_other.dirty_sets_, 0) } {}
 
 	ResourceSet& operator=(const ResourceSet& _other) = delete;
 
@@ -40,12 +55,19 @@ public:
 		parent_pool = std::move(_other.parent_pool);
 		shader_info = std::move(_other.shader_info);
 		sets = std::move(_other.sets);
-		buffer_info_storage_ = std::move(_other.buffer_info_storage_);
-		image_info_storage_ = std::move(_other.image_info_storage_);
-		writes_ = std::move(_other.writes_);
+		slots_ = std::move(_other.slots_);
+		written_ = std::move(_other.written_);
+		dirty_sets_ = std::exchange(_other.dirty_sets_, 0);
 		return *this;
 	}
 
+	/**
+	 * Look up `_name` in the layout this set was allocated for.
+	 * Fails if no shader of the pipeline declares it.
+	 */
+	[[nodiscard]]
+	Res<BindingHandle> resolve(const std::string_view& _name) const;
+
 	void set_buffer(const std::string_view& _name, vk::DescriptorBufferInfo&& _buffer_info);
 	void set_buffer_array_index(const std::string_view& _name, vk::DescriptorBufferInfo&& _buffer_info, u32 _index);
 	void set_buffer_array(const std::string_view& _name, const std::vector<vk::DescriptorBufferInfo>& _buffer_info, u32 _offset = 0);
@@ -53,56 +75,135 @@ public:
 	void set_texture_array_index(const std::string_view& _name, vk::DescriptorImageInfo&& _image_info, u32 _index);
 	void set_texture_array(const std::string_view& _name, const std::vector<vk::DescriptorImageInfo>& _image_info, u32 _offset = 0);
 
+	void set_buffer(const BindingHandle& _binding, vk::DescriptorBufferInfo&& _buffer_info);
+	void set_buffer_array_index(const BindingHandle& _binding, vk::DescriptorBufferInfo&& _buffer_info, u32 _index);
+	void set_buffer_array(const BindingHandle& _binding, const std::vector<vk::DescriptorBufferInfo>& _buffer_info, u32 _offset = 0);
+	void set_texture(const BindingHandle& _binding, vk::DescriptorImageInfo&& _image_info);
+	void set_texture_array_index(const BindingHandle& _binding, vk::DescriptorImageInfo&& _image_info, u32 _index);
+	void set_texture_array(const BindingHandle& _binding, const std::vector<vk::DescriptorImageInfo>& _image_info, u32 _offset = 0);
+
+	/**
+	 * Flush the pending writes.
+	 * A set whose descriptors have all been written goes through the layout's update template in one call,
+	 * a partially written set falls back to plain writes of the written elements.
+	 */
 	void update();
 
+	/**
+	 * Flush the pending writes of every set in `_sets` with a single `vkUpdateDescriptorSets`.
+	 * All of them must come from the same device.
+	 */
+	static void update_all(std::span<ResourceSet* const> _sets);
+
 	~ResourceSet() = default;
 
 private:
-	std::deque<vk::DescriptorBufferInfo> buffer_info_storage_;
-	std::deque<vk::DescriptorImageInfo> image_info_storage_;
-	std::vector<vk::WriteDescriptorSet> writes_;
+	// Rejects handles from another layout, writes of the wrong kind and elements past the array.
+	[[nodiscard]]
+	b8 check_write(const BindingHandle& _binding, b8 _is_image, u32 _first, u32 _count) const;
+	[[nodiscard]]
+	DescriptorSlot* slot(const BindingHandle& _binding, u32 _element);
+	void append_writes(u32 _set, std::vector<vk::WriteDescriptorSet>& _writes) const;
+
+	// Laid out as Layout::descriptor_slots, so a set's slice is the data of its update template.
+	std::vector<DescriptorSlot> slots_;
+	std::vector<b8> written_;
+	// Bit per descriptor set with writes not yet flushed.
+	u32 dirty_sets_{};
 };
 
+/**
+ * @class ResourcePool
+ *
+ * @brief Allocates ResourceSets of one layout from a chain of descriptor pools.
+ *
+ * Pools are sized from the layout's reflected descriptor counts, array lengths included. When a pool runs
+ * out another one twice its size is chained on, so allocation only fails if the device does.
+ * A transient pool keeps one chain per frame in flight; `begin_frame` resets a slot's chain wholesale,
+ * invalidating every set allocated from it. Sets are never freed individually.
+ */
 class ResourcePool {
 public:
+	struct Stats {
+		u64 sets_allocated{};
+		u64 pools_created{};
+		// Allocations that found the current pool exhausted or fragmented.
+		u64 overflows{};
+		u64 resets{};
+	};
+
 	Borrowed<Device> parent_device;
 	Layout* layout{ nullptr };
+	// Sets the first pool of each chain is sized for.
 	u32 max_resource_sets{ 1 };
+	b8 transient{ false };
+	Stats stats;
 
 	ResourcePool() = default;
 
-	ResourcePool(const Borrowed<Device>& _parent_device, Layout* _layout, const vk::DescriptorPool& _pool, u32 _max_resource_sets)
-		: parent_device(_parent_device)
-		, layout(_layout)
-		, max_resource_sets(_max_resource_sets)
-		, pool_(_pool) {}
-
-
 	ResourcePool(const ResourcePool& _other) = delete;
 
 	ResourcePool(ResourcePool&& _other) noexcept
 		: parent_device{ std::move(_other.parent_device) }
 		, layout{ std::exchange(_other.layout, nullptr) }
-		, pool_{ std::exchange(_other.pool_, nullptr) } {}
+		, max_resource_sets{ _other.max_resource_sets }
+		, transient{ _other.transient }
+		, stats{ _other.stats }
+		, set_sizes_{ std::move(_other.set_sizes_) }
+		, chains_{ std::move(_other.chains_) }
+		, current_chain_{ _other.current_chain_ } {}
 
 	ResourcePool& operator=(const ResourcePool& _other) = delete;
 
 	ResourcePool& operator=(ResourcePool&& _other) noexcept {
 		if (this == &_other) return *this;
-		parent_device = std::move(_other.parent_device);
-		layout = std::exchange(_other.layout, nullptr);
-		pool_ = std::exchange(_other.pool_, nullptr);
+		// The old pools leave with `_other`, which destroys them.
+		std::swap(parent_device, _other.parent_device);
+		std::swap(layout, _other.layout);
+		std::swap(max_resource_sets, _other.max_resource_sets);
+		std::swap(transient, _other.transient);
+		std::swap(stats, _other.stats);
+		std::swap(set_sizes_, _other.set_sizes_);
+		std::swap(chains_, _other.chains_);
+		std::swap(current_chain_, _other.current_chain_);
 		return *this;
 	}
 
 	Res<ResourceSet> allocate_resource_set();
 
+	/**
+	 * Move to the chain of `_frame_index` and reset its pools. The caller guarantees the GPU is done with it.
+	 * Only valid on a transient pool.
+	 */
+	void begin_frame(u32 _frame_index);
+
+	[[nodiscard]]
+	u32 pool_count() const;
+
+	/**
+	 * Fraction of the set capacity of every created pool that is currently allocated.
+	 */
+	[[nodiscard]]
+	f32 utilization() const;
+
 	static Res<ResourcePool> create(const Borrowed<Device>& _device, Layout* _layout, u32 _max_resource_sets);
+	static Res<ResourcePool> create_transient(const Borrowed<Device>& _device, Layout* _layout, u32 _sets_per_frame, u32 _frames_in_flight = CommandAllocator::default_frames_in_flight);
 
-	~ResourcePool() {
-		parent_device->device.destroyDescriptorPool(pool_);
-	}
+	~ResourcePool();
 
 private:
-	vk::DescriptorPool pool_;
+	struct Chain {
+		std::vector<vk::DescriptorPool> pools;
+		std::vector<u32> capacities;
+		u32 current{ 0 };
+		u32 allocated{ 0 };
+	};
+
+	[[nodiscard]]
+	Res<vk::DescriptorPool> create_pool(u32 _resource_sets);
+
+	// Descriptors needed by one ResourceSet, by type.
+	std::vector<vk::DescriptorPoolSize> set_sizes_;
+	std::vector<Chain> chains_;
+	u32 current_chain_{ 0 };
 };
@@ -32,7 +32,8 @@ Sampler::Sampler(Sampler&& _other) noexcept: parent_device{ std::move(_other.par
                                            , compare_op{ _other.compare_op }
                                            , border_color{ _other.border_color }
                                            , unnormalized_coordinates{ _other.unnormalized_coordinates }
-                                           , name{ std::move(_other.name) } {}
+                                           , name{ std::move(_other.name) }
+                                           , bindless_index{ std::exchange(_other.bindless_index, BindlessHeap::invalid_index) } {}
 
 Sampler& Sampler::operator=(Sampler&& _other) noexcept {
 	if (this == &_other) return *this;
@@ -47,11 +48,24 @@ Sampler& Sampler::operator=(Sampler&& _other) noexcept {
 	border_color = _other.border_color;
 	unnormalized_coordinates = _other.unnormalized_coordinates;
 	name = std::move(_other.name);
+	std::swap(bindless_index, _other.bindless_index);
 	return *this;
 }
 
+Res<u32> Sampler::register_bindless() {
+	if (bindless_index != BindlessHeap::invalid_index) return bindless_index;
+
+	auto index = parent_device->bindless.register_sampler(sampler);
+	if (!index) {
+		return Err::make(std::fmt("Sampler '%s' could not be registered" CODE_LOC, name.c_str()), std::move(index.error()));
+	}
+	bindless_index = index.value();
+	return bindless_index;
+}
+
 Sampler::~Sampler() {
 	if (parent_device && sampler) {
+		parent_device->bindless.release(BindlessHeap::Kind::eSampler, bindless_index);
 		parent_device->device.destroySampler(sampler);
 	}
 }
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <global.h>
+#include <core/bindless_heap.h>
 
 class Device;
 
@@ -40,6 +41,8 @@ struct Sampler {
 	vk::BorderColor border_color{ vk::BorderColor::eFloatTransparentBlack };
 	b8 unnormalized_coordinates = {};
 	std::string name;
+	// Slot in the device's bindless heap, released with the sampler.
+	u32 bindless_index{ BindlessHeap::invalid_index };
 
 	Sampler() = default;
 	Sampler(const std::string_view& _name, const Borrowed<Device>& _device, vk::Sampler _sampler, const vk::SamplerCreateInfo& _create_info);
@@ -49,6 +52,12 @@ struct Sampler {
 	Sampler& operator=(const Sampler& _other) = delete;
 	Sampler& operator=(Sampler&& _other) noexcept;
 
+	/**
+	 * Register the sampler in the bindless heap once and return its index. Later calls return the same index.
+	 */
+	[[nodiscard]]
+	Res<u32> register_bindless();
+
 	~Sampler();
 
 	static Res<Sampler> create(const std::string_view& _name, const Borrowed<Device>& _device, const vk::SamplerCreateInfo& _create_info);
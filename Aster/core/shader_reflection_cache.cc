@@ -0,0 +1,313 @@
+// =============================================
+//  Aster: shader_reflection_cache.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "shader_reflection_cache.h"
+
+#include <core/pipeline.h>
+#include <util/files.h>
+
+#include <bit>
+
+namespace {
+	struct BinaryWriter {
+		std::vector<u8> data;
+
+		template <typename T>
+		void write(const T& _value) {
+			static_assert(std::is_trivially_copyable_v<T>);
+			const auto* bytes = recast<const u8*>(&_value);
+			data.insert(data.end(), bytes, bytes + sizeof(T));
+		}
+
+		void write(const std::string& _value) {
+			write(cast<u32>(_value.size()));
+			data.insert(data.end(), _value.begin(), _value.end());
+		}
+	};
+
+	// Every read is bounds checked; a short or malformed entry fails instead of reading past the end.
+	struct BinaryReader {
+		std::span<const u8> data;
+		b8 failed{ false };
+
+		template <typename T>
+		T read() {
+			static_assert(std::is_trivially_copyable_v<T>);
+			T value{};
+			if (failed || data.size() < sizeof(T)) {
+				failed = true;
+				return value;
+			}
+			memcpy(&value, data.data(), sizeof(T));
+			data = data.subspan(sizeof(T));
+			return value;
+		}
+
+		std::string read_string() {
+			const auto size = read<u32>();
+			if (failed || data.size() < size) {
+				failed = true;
+				return {};
+			}
+			std::string value{ recast<const char*>(data.data()), size };
+			data = data.subspan(size);
+			return value;
+		}
+
+		std::span<const u8> read_bytes(const usize _size) {
+			if (failed || data.size() < _size) {
+				failed = true;
+				return {};
+			}
+			const auto value = data.subspan(0, _size);
+			data = data.subspan(_size);
+			return value;
+		}
+	};
+
+	void write_interface_vars(BinaryWriter& _writer, const std::vector<InterfaceVariableInfo>& _vars) {
+		_writer.write(cast<u32>(_vars.size()));
+		for (const auto& var_ : _vars) {
+			_writer.write(var_.name);
+			_writer.write(var_.location);
+			_writer.write(var_.format);
+		}
+	}
+
+	std::vector<InterfaceVariableInfo> read_interface_vars(BinaryReader& _reader) {
+		std::vector<InterfaceVariableInfo> vars(_reader.read<u32>());
+		for (auto& var_ : vars) {
+			var_.name = _reader.read_string();
+			var_.location = _reader.read<u32>();
+			var_.format = _reader.read<vk::Format>();
+			if (_reader.failed) return {};
+		}
+		return vars;
+	}
+
+	std::vector<u8> serialize(const ShaderInfo& _info) {
+		BinaryWriter writer;
+		writer.write(_info.stage);
+		write_interface_vars(writer, _info.input_vars);
+		write_interface_vars(writer, _info.output_vars);
+
+		writer.write(cast<u32>(_info.descriptors.size()));
+		for (const auto& desc_ : _info.descriptors) {
+			writer.write(desc_.type);
+			writer.write(desc_.set);
+			writer.write(desc_.binding);
+			writer.write(desc_.array_length);
+			writer.write(cast<VkShaderStageFlags>(desc_.stages));
+			writer.write(desc_.block_size);
+			writer.write(desc_.name);
+		}
+
+		writer.write(cast<u32>(_info.push_ranges.size()));
+		for (const auto& range_ : _info.push_ranges) {
+			writer.write(cast<VkShaderStageFlags>(range_.stageFlags));
+			writer.write(range_.offset);
+			writer.write(range_.size);
+		}
+
+		writer.write(_info.local_size);
+
+		writer.write(cast<u32>(_info.spec_constants.size()));
+		for (const auto& constant_ : _info.spec_constants) {
+			writer.write(constant_.name);
+			writer.write(constant_.id);
+			writer.write(constant_.type);
+		}
+		return std::move(writer.data);
+	}
+
+	Option<ShaderInfo> deserialize(const std::span<const u8>& _data) {
+		BinaryReader reader{ .data = _data };
+
+		ShaderInfo info = {
+			.stage = reader.read<vk::ShaderStageFlagBits>(),
+		};
+		info.input_vars = read_interface_vars(reader);
+		info.output_vars = read_interface_vars(reader);
+
+		info.descriptors.resize(reader.read<u32>());
+		for (u32 i_ = 0; i_ < info.descriptors.size() && !reader.failed; ++i_) {
+			auto& desc_ = info.descriptors[i_];
+			desc_.type = reader.read<vk::DescriptorType>();
+			desc_.set = reader.read<u32>();
+			desc_.binding = reader.read<u32>();
+			desc_.array_length = reader.read<u32>();
+			desc_.stages = cast<vk::ShaderStageFlags>(reader.read<VkShaderStageFlags>());
+			desc_.block_size = reader.read<u32>();
+			desc_.name = reader.read_string();
+			// Reflection numbers the names in descriptor order, so the map is rebuilt rather than stored.
+			info.descriptor_names[desc_.name] = i_;
+		}
+
+		info.push_ranges.resize(reader.read<u32>());
+		for (auto& range_ : info.push_ranges) {
+			range_.stageFlags = cast<vk::ShaderStageFlags>(reader.read<VkShaderStageFlags>());
+			range_.offset = reader.read<u32>();
+			range_.size = reader.read<u32>();
+		}
+
+		info.local_size = reader.read<std::array<u32, 3>>();
+
+		info.spec_constants.resize(reader.read<u32>());
+		for (auto& constant_ : info.spec_constants) {
+			constant_.name = reader.read_string();
+			constant_.id = reader.read<u32>();
+			constant_.type = reader.read<SpecializationType>();
+		}
+
+		if (reader.failed || !reader.data.empty()) return std::nullopt;
+		return info;
+	}
+
+	u64 mix64(u64 _value) {
+		_value ^= _value >> 30;
+		_value *= 0xbf58476d1ce4e5b9ull;
+		_value ^= _value >> 27;
+		_value *= 0x94d049bb133111ebull;
+		_value ^= _value >> 31;
+		return _value;
+	}
+}
+
+ShaderReflectionCache::ShaderReflectionCache(ShaderReflectionCache&& _other) noexcept: path{ std::move(_other.path) }
+                                                                                     , stats{ _other.stats }
+                                                                                     , entries_{ std::move(_other.entries_) }
+                                                                                     , dirty_{ std::exchange(_other.dirty_, false) } {}
+
+ShaderReflectionCache& ShaderReflectionCache::operator=(ShaderReflectionCache&& _other) noexcept {
+	if (this == &_other) return *this;
+	std::swap(path, _other.path);
+	std::swap(stats, _other.stats);
+	std::swap(entries_, _other.entries_);
+	std::swap(dirty_, _other.dirty_);
+	return *this;
+}
+
+ShaderReflectionCache::~ShaderReflectionCache() = default;
+
+ShaderReflectionCache ShaderReflectionCache::load(const std::string_view& _path) {
+	ShaderReflectionCache cache;
+	cache.path = _path;
+
+	if (!file_exists(_path)) return cache;
+
+	const auto file_data = load_binary_file(_path);
+	const auto* header = recast<const FileHeader*>(file_data.data());
+	const auto payload = file_data.size() >= sizeof(FileHeader) ? std::span<const u8>{ file_data }.subspan(sizeof(FileHeader)) : std::span<const u8>{};
+	if (file_data.size() < sizeof(FileHeader) || header->magic != file_magic) {
+		WARN(std::fmt("Shader reflection cache '%s' is not a cache file, starting cold", _path.data()));
+		return cache;
+	}
+	if (header->schema_version != schema_version) {
+		INFO(std::fmt("Shader reflection cache '%s' has schema %u (expected %u), starting cold", _path.data(), header->schema_version, schema_version));
+		return cache;
+	}
+	if (header->data_size != payload.size() || header->data_hash != hash_any(std::string_view{ recast<const char*>(payload.data()), payload.size() })) {
+		WARN(std::fmt("Shader reflection cache '%s' is corrupt, starting cold", _path.data()));
+		return cache;
+	}
+
+	BinaryReader reader{ .data = payload };
+	for (u64 i_ = 0; i_ < header->entry_count && !reader.failed; ++i_) {
+		const auto key = reader.read<Key>();
+		const auto size = reader.read<u64>();
+		const auto data = reader.read_bytes(size);
+		cache.entries_[key] = { .data = { data.begin(), data.end() } };
+	}
+	if (reader.failed || !reader.data.empty()) {
+		WARN(std::fmt("Shader reflection cache '%s' is truncated, starting cold", _path.data()));
+		cache.entries_.clear();
+		return cache;
+	}
+
+	cache.stats.loaded_entries = cache.entries_.size();
+	INFO(std::fmt("Shader reflection cache loaded %llu entries from '%s'", cast<u64>(cache.stats.loaded_entries), _path.data()));
+	return cache;
+}
+
+ShaderReflectionCache::Key ShaderReflectionCache::key_of(const std::span<const u32>& _code) {
+	// Two independently seeded lanes; one 64-bit hash would make a wrong layout merely unlikely.
+	u64 lane_lo = 0xcbf29ce484222325ull;
+	u64 lane_hi = 0x9e3779b97f4a7c15ull ^ _code.size();
+	for (const auto word_ : _code) {
+		lane_lo = (lane_lo ^ word_) * 0x100000001b3ull;
+		lane_hi = std::rotl(lane_hi ^ mix64(word_ + lane_hi), 23) * 0x9e3779b97f4a7c15ull;
+	}
+	return {
+		.code_size = _code.size_bytes(),
+		.hash_lo = mix64(lane_lo),
+		.hash_hi = mix64(lane_hi),
+	};
+}
+
+Option<ShaderInfo> ShaderReflectionCache::find(const Key& _key) {
+	const auto found = entries_.find(_key);
+	if (found == entries_.end()) {
+		++stats.misses;
+		return std::nullopt;
+	}
+
+	auto info = deserialize(found->second.data);
+	if (!info) {
+		WARN("Shader reflection cache entry is malformed, reflecting again");
+		entries_.erase(found);
+		dirty_ = true;
+		++stats.misses;
+		return std::nullopt;
+	}
+
+	found->second.used = true;
+	++stats.hits;
+	return info;
+}
+
+void ShaderReflectionCache::insert(const Key& _key, const ShaderInfo& _info) {
+	entries_[_key] = { .data = serialize(_info), .used = true };
+	dirty_ = true;
+}
+
+Res<> ShaderReflectionCache::save() const {
+	if (!dirty_ || path.empty()) return {};
+
+	// Entries used this run are always kept; the rest fill up to max_entries.
+	std::vector<const std::pair<const Key, Entry>*> kept;
+	kept.reserve(entries_.size());
+	for (const auto& entry_ : entries_) {
+		if (entry_.second.used) kept.push_back(&entry_);
+	}
+	for (const auto& entry_ : entries_) {
+		if (kept.size() >= max_entries) break;
+		if (!entry_.second.used) kept.push_back(&entry_);
+	}
+
+	BinaryWriter payload;
+	for (const auto* entry_ : kept) {
+		payload.write(entry_->first);
+		payload.write(cast<u64>(entry_->second.data.size()));
+		payload.data.insert(payload.data.end(), entry_->second.data.begin(), entry_->second.data.end());
+	}
+
+	const FileHeader header = {
+		.magic = file_magic,
+		.schema_version = schema_version,
+		.entry_count = kept.size(),
+		.data_size = payload.data.size(),
+		.data_hash = hash_any(std::string_view{ recast<const char*>(payload.data.data()), payload.data.size() }),
+	};
+
+	std::vector<u8> file_data(sizeof(FileHeader) + payload.data.size());
+	memcpy(file_data.data(), &header, sizeof(FileHeader));
+	memcpy(file_data.data() + sizeof(FileHeader), payload.data.data(), payload.data.size());
+
+	if (!write_binary_file_atomic(path, file_data)) {
+		return Err::make(std::fmt("Shader reflection cache could not be written to '%s'" CODE_LOC, path.c_str()));
+	}
+	VERBOSE(std::fmt("Shader reflection cache saved %llu entries to '%s'", cast<u64>(kept.size()), path.c_str()));
+	return {};
+}
@@ -0,0 +1,108 @@
+// =============================================
+//  Aster: shader_reflection_cache.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+struct ShaderInfo;
+
+/**
+ * @class ShaderReflectionCache
+ *
+ * @brief Reflected ShaderInfo persisted to disk, keyed by the SPIR-V contents.
+ *
+ * The key is a 128-bit hash of the code plus its size, so an edited or stale `.spv` misses instead of
+ * reusing another shader's layout. The file has a schema version and a payload hash; anything that does
+ * not match is dropped and the cache starts cold. Entries stay serialized in memory and are decoded on a hit.
+ * Shader names are not stored, the caller fills them in.
+ * Not thread-safe; the pipeline factory only touches it under its own lock.
+ */
+class ShaderReflectionCache {
+public:
+	static constexpr const char* default_path = "shader_reflection_cache.bin";
+
+	// Entries not used by the current run are evicted beyond this count on save.
+	static constexpr usize max_entries = 512;
+
+	struct Key {
+		u64 code_size{};
+		u64 hash_lo{};
+		u64 hash_hi{};
+
+		b8 operator==(const Key& _other) const = default;
+	};
+
+	struct Stats {
+		usize loaded_entries{};
+		u64 hits{};
+		u64 misses{};
+	};
+
+	std::string path;
+	Stats stats;
+
+	ShaderReflectionCache() = default;
+
+	ShaderReflectionCache(const ShaderReflectionCache& _other) = delete;
+	ShaderReflectionCache(ShaderReflectionCache&& _other) noexcept;
+	ShaderReflectionCache& operator=(const ShaderReflectionCache& _other) = delete;
+	ShaderReflectionCache& operator=(ShaderReflectionCache&& _other) noexcept;
+
+	~ShaderReflectionCache();
+
+	/**
+	 * Load `_path` if it exists. Missing, corrupt or outdated files start an empty cache.
+	 */
+	static ShaderReflectionCache load(const std::string_view& _path = default_path);
+
+	[[nodiscard]]
+	static Key key_of(const std::span<const u32>& _code);
+
+	/**
+	 * Copy of the cached reflection for `_key`, with an empty name.
+	 */
+	[[nodiscard]]
+	Option<ShaderInfo> find(const Key& _key);
+
+	void insert(const Key& _key, const ShaderInfo& _info);
+
+	/**
+	 * Write the cache back to `path` if anything was added this run.
+	 */
+	[[nodiscard]]
+	Res<> save() const;
+
+private:
+	struct KeyHash {
+		usize operator()(const Key& _key) const noexcept {
+			return cast<usize>(_key.hash_lo ^ _key.hash_hi);
+		}
+	};
+
+	struct Entry {
+		std::vector<u8> data;
+		b8 used{ false };
+	};
+
+	struct FileHeader {
+		u32 magic;
+		u32 schema_version;
+		u64 entry_count;
+		u64 data_size;
+		u64 data_hash;
+	};
+
+	static constexpr u32 file_magic = 0x43525341; // "ASRC"
+	// Bump on any change to ShaderInfo or its serialized layout.
+	static constexpr u32 schema_version = 2;
+
+	std::unordered_map<Key, Entry, KeyHash> entries_;
+	b8 dirty_{ false };
+};
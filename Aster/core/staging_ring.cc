@@ -0,0 +1,171 @@
+// =============================================
+//  Aster: staging_ring.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "staging_ring.h"
+
+StagingRing::StagingRing(StagingRing&& _other) noexcept: buffer{ std::exchange(_other.buffer, nullptr) }
+                                                       , allocation{ std::exchange(_other.allocation, nullptr) }
+                                                       , mapped{ std::exchange(_other.mapped, nullptr) }
+                                                       , capacity{ std::exchange(_other.capacity, 0) }
+                                                       , stats{ _other.stats }
+                                                       , device_{ std::exchange(_other.device_, nullptr) }
+                                                       , allocator_{ std::exchange(_other.allocator_, nullptr) }
+                                                       , head_{ _other.head_ }
+                                                       , tail_{ _other.tail_ }
+                                                       , guarded_head_{ _other.guarded_head_ }
+                                                       , regions_{ std::move(_other.regions_) } {}
+
+StagingRing& StagingRing::operator=(StagingRing&& _other) noexcept {
+	if (this == &_other) return *this;
+	std::swap(buffer, _other.buffer);
+	std::swap(allocation, _other.allocation);
+	std::swap(mapped, _other.mapped);
+	std::swap(capacity, _other.capacity);
+	std::swap(stats, _other.stats);
+	std::swap(device_, _other.device_);
+	std::swap(allocator_, _other.allocator_);
+	std::swap(head_, _other.head_);
+	std::swap(tail_, _other.tail_);
+	std::swap(guarded_head_, _other.guarded_head_);
+	std::swap(regions_, _other.regions_);
+	return *this;
+}
+
+Res<StagingRing> StagingRing::create(const vk::Device& _device, const vma::Allocator& _allocator, const usize _capacity) {
+	const auto capacity = closest_multiple(_capacity, default_alignment);
+
+	vma::AllocationInfo allocation_info;
+	auto [result, buffer] = _allocator.createBuffer({
+		.size = capacity,
+		.usage = vk::BufferUsageFlagBits::eTransferSrc,
+		.sharingMode = vk::SharingMode::eExclusive,
+	}, {
+		.flags = vma::AllocationCreateFlagBits::eMapped,
+		.usage = vma::MemoryUsage::eCpuOnly,
+	}, allocation_info);
+	if (failed(result)) {
+		return Err::make(std::fmt("Staging ring creation failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	return StagingRing{
+		_device,
+		_allocator,
+		buffer.first,
+		buffer.second,
+		cast<u8*>(allocation_info.pMappedData),
+		capacity,
+	};
+}
+
+Res<StagingRing::Slice> StagingRing::allocate(const usize _size, const usize _alignment) {
+	if (_size > capacity) {
+		return Err::make(std::fmt("Staging allocation of %llu bytes exceeds ring capacity %llu" CODE_LOC, cast<u64>(_size), cast<u64>(capacity)));
+	}
+
+	reclaim();
+
+	u64 start;
+	while (true) {
+		start = slice_start(head_, _size, _alignment);
+		if (start + _size - tail_ <= capacity) {
+			break;
+		}
+
+		if (regions_.empty()) {
+			return Err::make("Staging ring is full of unsubmitted slices. Call guard_pending after submitting uploads." CODE_LOC);
+		}
+
+		++stats.stalls;
+		const auto& oldest = regions_.front();
+		const auto result = device_.waitSemaphores({
+			.semaphoreCount = 1,
+			.pSemaphores = &oldest.timeline,
+			.pValues = &oldest.value,
+		}, max_value<u64>);
+		if (failed(result)) {
+			return Err::make(std::fmt("Staging ring timeline wait failed with %s" CODE_LOC, to_cstr(result)), result);
+		}
+		reclaim();
+	}
+
+	head_ = start + _size;
+
+	++stats.allocations;
+	stats.allocated_bytes += _size;
+	stats.in_use = cast<usize>(head_ - tail_);
+	stats.peak_in_use = std::max(stats.peak_in_use, stats.in_use);
+
+	const auto offset = start % capacity;
+	return Slice{
+		.buffer = buffer,
+		.offset = offset,
+		.size = _size,
+		.mapped = mapped + offset,
+	};
+}
+
+void StagingRing::guard_pending(const vk::Semaphore _timeline, const u64 _value) {
+	if (head_ == guarded_head_) return;
+
+	regions_.push_back({
+		.end = head_,
+		.timeline = _timeline,
+		.value = _value,
+	});
+	guarded_head_ = head_;
+}
+
+b8 StagingRing::needs_guard(const usize _size, const usize _alignment) const {
+	return slice_start(head_, _size, _alignment) + _size - guarded_head_ > capacity;
+}
+
+u64 StagingRing::slice_start(const u64 _head, const usize _size, const usize _alignment) const {
+	auto start = closest_multiple(_head, _alignment);
+	// Slices never straddle the end of the buffer; skip to the next lap instead.
+	if (start / capacity != (start + _size - 1) / capacity) {
+		start = closest_multiple(start, capacity);
+	}
+	return start;
+}
+
+void StagingRing::reclaim() {
+	vk::Semaphore queried;
+	u64 counter = 0;
+	while (!regions_.empty()) {
+		const auto& region_ = regions_.front();
+		if (region_.timeline != queried) {
+			auto [result, value] = device_.getSemaphoreCounterValue(region_.timeline);
+			if (failed(result)) {
+				WARN(std::fmt("Staging ring timeline query failed with %s", to_cstr(result)));
+				break;
+			}
+			queried = region_.timeline;
+			counter = value;
+		}
+		if (counter < region_.value) break;
+
+		tail_ = region_.end;
+		regions_.pop_front();
+	}
+	stats.in_use = cast<usize>(head_ - tail_);
+}
+
+void StagingRing::destroy() {
+	if (!device_) return;
+
+	regions_.clear();
+	if (buffer) {
+		allocator_.destroyBuffer(buffer, allocation);
+	}
+	buffer = nullptr;
+	allocation = nullptr;
+	mapped = nullptr;
+	device_ = nullptr;
+	allocator_ = nullptr;
+}
+
+StagingRing::~StagingRing() {
+	destroy();
+}
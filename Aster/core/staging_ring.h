@@ -0,0 +1,107 @@
+// =============================================
+//  Aster: staging_ring.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <deque>
+
+/**
+ * @class StagingRing
+ *
+ * @brief Persistently mapped CPU buffer that upload slices are carved out of.
+ *
+ * Slices are handed out linearly and reclaimed in submission order once the
+ * timeline value guarding them has been reached.
+ */
+struct StagingRing {
+	static constexpr usize default_capacity = 64 * 1024 * 1024;
+	static constexpr usize default_alignment = 16;
+
+	struct Slice {
+		vk::Buffer buffer;
+		vk::DeviceSize offset{};
+		vk::DeviceSize size{};
+		u8* mapped{ nullptr };
+	};
+
+	struct Stats {
+		usize capacity{};
+		usize in_use{};
+		usize peak_in_use{};
+		u64 allocations{};
+		u64 allocated_bytes{};
+		u64 stalls{};
+		u64 fallbacks{};
+	};
+
+	vk::Buffer buffer;
+	vma::Allocation allocation;
+	u8* mapped{ nullptr };
+	usize capacity{ 0 };
+	Stats stats;
+
+	StagingRing() = default;
+
+	StagingRing(const vk::Device& _device, const vma::Allocator& _allocator, const vk::Buffer& _buffer, const vma::Allocation& _allocation, u8* _mapped, usize _capacity)
+		: buffer(_buffer)
+		, allocation(_allocation)
+		, mapped(_mapped)
+		, capacity(_capacity)
+		, stats{ .capacity = _capacity }
+		, device_(_device)
+		, allocator_(_allocator) {}
+
+	StagingRing(const StagingRing& _other) = delete;
+	StagingRing(StagingRing&& _other) noexcept;
+	StagingRing& operator=(const StagingRing& _other) = delete;
+	StagingRing& operator=(StagingRing&& _other) noexcept;
+
+	static Res<StagingRing> create(const vk::Device& _device, const vma::Allocator& _allocator, usize _capacity);
+
+	/**
+	 * Carve out a slice of the ring. Stalls on the oldest in-flight submission if there is no space.
+	 * Fails if `_size` is larger than the ring; the caller is expected to fall back to a dedicated buffer.
+	 */
+	[[nodiscard]]
+	Res<Slice> allocate(usize _size, usize _alignment = default_alignment);
+
+	/**
+	 * Guard every slice allocated since the last call with `_value` on the `_timeline` semaphore.
+	 */
+	void guard_pending(vk::Semaphore _timeline, u64 _value);
+
+	/**
+	 * True if `_size` bytes can not be carved out without guarding the slices allocated since the last `guard_pending`.
+	 */
+	[[nodiscard]]
+	b8 needs_guard(usize _size, usize _alignment = default_alignment) const;
+
+	void reclaim();
+
+	void destroy();
+
+	~StagingRing();
+
+private:
+	struct Region {
+		u64 end{};
+		vk::Semaphore timeline;
+		u64 value{};
+	};
+
+	[[nodiscard]] u64 slice_start(u64 _head, usize _size, usize _alignment) const;
+
+	vk::Device device_;
+	vma::Allocator allocator_;
+
+	// Monotonic positions; physical offset is `pos % capacity`.
+	u64 head_{ 0 };
+	u64 tail_{ 0 };
+	u64 guarded_head_{ 0 };
+
+	std::deque<Region> regions_;
+};
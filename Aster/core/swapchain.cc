@@ -70,6 +70,7 @@ Swapchain::Swapchain(const std::string_view& _name, Borrowed<Window>&& _window,
 
 	_device->set_object_name(swapchain, name);
 
+	// Swapchain images are owned by the presentation engine; their size is an estimate at 4 bytes per texel.
 	if (auto [res, vk_images] = _device->device.getSwapchainImagesKHR(swapchain); !failed(res)) {
 		int i_ = 0;
 		image_views.clear();
@@ -78,7 +79,8 @@ Swapchain::Swapchain(const std::string_view& _name, Borrowed<Window>&& _window,
 		for (auto& vk_image : vk_images) {
 			auto name_ = std::fmt("%s Image %u", name.data(), i_++);
 			_device->set_object_name(vk_image, name_);
-			images.emplace_back(_device, vk_image, vma::Allocation{}, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuOnly, extent.width * extent.height * 4, name_, vk::ImageType::e2D, format, vk::Extent3D{ extent.width, extent.height, 1 }, 1, 1);
+			images.emplace_back(_device, vk_image, vma::Allocation{}, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuOnly, extent.width * extent.height * 4, name_, vk::ImageType::e2D, format, vk::Extent3D{ extent.width, extent.height, 1 }, 1, 1, MemoryCategory::eSwapchain);
+			_device->memory.track(MemoryCategory::eSwapchain, images.back().size);
 		}
 	} else {
 		ERROR(std::fmt("Could not fetch images with %s", to_cstr(res))) THEN_CRASH(res);
@@ -185,12 +187,16 @@ void Swapchain::recreate() {
 
 	if (auto [res, vk_images] = parent_device->device.getSwapchainImagesKHR(swapchain); !failed(res)) {
 		int i_ = 0;
+		for (const auto& image_ : images) {
+			parent_device->memory.untrack(image_.category, image_.size);
+		}
 		images.clear();
 		images.reserve(vk_images.size());
 		for (auto& vk_image : vk_images) {
 			auto name_ = std::fmt("%s Image %u", name.data(), i_++);
 			parent_device->set_object_name(vk_image, name_);
-			images.emplace_back(parent_device, vk_image, vma::Allocation{}, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuOnly, extent.width * extent.height * 4, name_, vk::ImageType::e2D, format, vk::Extent3D{ extent.width, extent.height, 1 }, 1, 1);
+			images.emplace_back(parent_device, vk_image, vma::Allocation{}, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuOnly, extent.width * extent.height * 4, name_, vk::ImageType::e2D, format, vk::Extent3D{ extent.width, extent.height, 1 }, 1, 1, MemoryCategory::eSwapchain);
+			parent_device->memory.track(MemoryCategory::eSwapchain, images.back().size);
 		}
 	} else {
 		ERROR(std::fmt("Could not fetch images with %s", to_cstr(res))) THEN_CRASH(res);
@@ -241,6 +247,9 @@ Swapchain& Swapchain::operator=(Swapchain&& _other) noexcept {
 Swapchain::~Swapchain() {
 
 	if (swapchain) {
+		for (const auto& image_ : images) {
+			parent_device->memory.untrack(image_.category, image_.size);
+		}
 		parent_device->device.destroySwapchainKHR(swapchain);
 	}
 	INFO(std::fmt("Swapchain '%s' destroyed", name.data()));
@@ -0,0 +1,148 @@
+// =============================================
+//  Aster: sync_pool.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "sync_pool.h"
+
+FencePool::FencePool(FencePool&& _other) noexcept: stats{ _other.stats }
+                                                 , device_{ std::exchange(_other.device_, nullptr) }
+                                                 , free_{ std::move(_other.free_) }
+                                                 , signaled_{ std::move(_other.signaled_) } {}
+
+FencePool& FencePool::operator=(FencePool&& _other) noexcept {
+	if (this == &_other) return *this;
+	std::swap(stats, _other.stats);
+	std::swap(device_, _other.device_);
+	std::swap(free_, _other.free_);
+	std::swap(signaled_, _other.signaled_);
+	return *this;
+}
+
+Res<vk::Fence> FencePool::acquire(const b8 _signaled) {
+	if (auto& matching = _signaled ? signaled_ : free_; !matching.empty()) {
+		const auto fence = matching.back();
+		matching.pop_back();
+		++stats.hits;
+		++stats.live;
+		stats.free = free_.size() + signaled_.size();
+		return fence;
+	}
+
+	if (!_signaled && !signaled_.empty()) {
+		const auto fence = signaled_.back();
+		signaled_.pop_back();
+		if (const auto result = device_.resetFences({ fence }); !failed(result)) {
+			++stats.hits;
+			++stats.live;
+			stats.free = free_.size() + signaled_.size();
+			return fence;
+		} else {
+			WARN(std::fmt("Fence reset failed with %s. Dropping it from the pool.", to_cstr(result)));
+			device_.destroyFence(fence);
+		}
+	}
+
+	auto [result, fence] = device_.createFence({
+		.flags = _signaled ? vk::FenceCreateFlagBits::eSignaled : vk::FenceCreateFlags{},
+	});
+	if (failed(result)) {
+		return Err::make(std::fmt("Fence creation failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+	++stats.misses;
+	++stats.live;
+	return fence;
+}
+
+void FencePool::release(const vk::Fence _fence) {
+	if (!_fence) return;
+
+	--stats.live;
+	++stats.releases;
+	// Not pending, so the fence is either signalled or was never submitted.
+	const auto status = device_.getFenceStatus(_fence);
+	if (status == vk::Result::eSuccess) {
+		signaled_.push_back(_fence);
+	} else if (status == vk::Result::eNotReady) {
+		free_.push_back(_fence);
+	} else {
+		WARN(std::fmt("Fence status query failed with %s. Dropping it from the pool.", to_cstr(status)));
+		device_.destroyFence(_fence);
+		return;
+	}
+	stats.free = free_.size() + signaled_.size();
+}
+
+void FencePool::destroy() {
+	if (!device_) return;
+
+	WARN_IF(stats.live != 0, std::fmt("%llu fences still live at pool destruction", cast<u64>(stats.live)));
+	for (auto& fence_ : free_) {
+		device_.destroyFence(fence_);
+	}
+	for (auto& fence_ : signaled_) {
+		device_.destroyFence(fence_);
+	}
+	free_.clear();
+	signaled_.clear();
+	device_ = nullptr;
+}
+
+FencePool::~FencePool() {
+	destroy();
+}
+
+SemaphorePool::SemaphorePool(SemaphorePool&& _other) noexcept: stats{ _other.stats }
+                                                             , device_{ std::exchange(_other.device_, nullptr) }
+                                                             , free_{ std::move(_other.free_) } {}
+
+SemaphorePool& SemaphorePool::operator=(SemaphorePool&& _other) noexcept {
+	if (this == &_other) return *this;
+	std::swap(stats, _other.stats);
+	std::swap(device_, _other.device_);
+	std::swap(free_, _other.free_);
+	return *this;
+}
+
+Res<vk::Semaphore> SemaphorePool::acquire() {
+	if (!free_.empty()) {
+		const auto semaphore = free_.back();
+		free_.pop_back();
+		++stats.hits;
+		++stats.live;
+		stats.free = free_.size();
+		return semaphore;
+	}
+
+	auto [result, semaphore] = device_.createSemaphore({});
+	if (failed(result)) {
+		return Err::make(std::fmt("Semaphore creation failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+	++stats.misses;
+	++stats.live;
+	return semaphore;
+}
+
+void SemaphorePool::release(const vk::Semaphore _semaphore) {
+	if (!_semaphore) return;
+
+	--stats.live;
+	++stats.releases;
+	free_.push_back(_semaphore);
+	stats.free = free_.size();
+}
+
+void SemaphorePool::destroy() {
+	if (!device_) return;
+
+	WARN_IF(stats.live != 0, std::fmt("%llu semaphores still live at pool destruction", cast<u64>(stats.live)));
+	for (auto& semaphore_ : free_) {
+		device_.destroySemaphore(semaphore_);
+	}
+	free_.clear();
+	device_ = nullptr;
+}
+
+SemaphorePool::~SemaphorePool() {
+	destroy();
+}
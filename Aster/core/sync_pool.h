@@ -0,0 +1,94 @@
+// =============================================
+//  Aster: sync_pool.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <vector>
+
+struct SyncPoolStats {
+	u64 hits{};
+	u64 misses{};
+	u64 releases{};
+	usize live{};
+	usize free{};
+};
+
+/**
+ * @class FencePool
+ *
+ * @brief Recycles fences so steady state submission never creates one.
+ *
+ * Released fences are kept in their current state, so both signalled and unsignalled requests
+ * can be served without creating one.
+ */
+class FencePool {
+public:
+	SyncPoolStats stats;
+
+	FencePool() = default;
+	explicit FencePool(const vk::Device& _device) : device_(_device) {}
+
+	FencePool(const FencePool& _other) = delete;
+	FencePool(FencePool&& _other) noexcept;
+	FencePool& operator=(const FencePool& _other) = delete;
+	FencePool& operator=(FencePool&& _other) noexcept;
+
+	/**
+	 * Fetch an unsignalled fence, or a signalled one if `_signaled` is set.
+	 * Signalled fences are reset to serve unsignalled requests; the reverse needs a submission, so it creates one.
+	 */
+	[[nodiscard]]
+	Res<vk::Fence> acquire(b8 _signaled = false);
+
+	/**
+	 * Return a fence to the pool. It must not be in use by a pending submission.
+	 */
+	void release(vk::Fence _fence);
+
+	void destroy();
+
+	~FencePool();
+
+private:
+	vk::Device device_;
+	std::vector<vk::Fence> free_;
+	std::vector<vk::Fence> signaled_;
+};
+
+/**
+ * @class SemaphorePool
+ *
+ * @brief Recycles binary semaphores so steady state submission never creates one.
+ *
+ * A semaphore may only be released once the wait on it has retired, since binary
+ * semaphores can not be reset on the host.
+ */
+class SemaphorePool {
+public:
+	SyncPoolStats stats;
+
+	SemaphorePool() = default;
+	explicit SemaphorePool(const vk::Device& _device) : device_(_device) {}
+
+	SemaphorePool(const SemaphorePool& _other) = delete;
+	SemaphorePool(SemaphorePool&& _other) noexcept;
+	SemaphorePool& operator=(const SemaphorePool& _other) = delete;
+	SemaphorePool& operator=(SemaphorePool&& _other) noexcept;
+
+	[[nodiscard]]
+	Res<vk::Semaphore> acquire();
+
+	void release(vk::Semaphore _semaphore);
+
+	void destroy();
+
+	~SemaphorePool();
+
+private:
+	vk::Device device_;
+	std::vector<vk::Semaphore> free_;
+};
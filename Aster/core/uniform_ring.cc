@@ -0,0 +1,132 @@
+// =============================================
+//  Aster: uniform_ring.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "uniform_ring.h"
+
+UniformRing::UniformRing(UniformRing&& _other) noexcept: buffer{ std::exchange(_other.buffer, nullptr) }
+                                                       , allocation{ std::exchange(_other.allocation, nullptr) }
+                                                       , mapped{ std::exchange(_other.mapped, nullptr) }
+                                                       , alignment{ _other.alignment }
+                                                       , frame_capacity{ std::exchange(_other.frame_capacity, 0) }
+                                                       , frame_count{ std::exchange(_other.frame_count, 0) }
+                                                       , is_coherent{ _other.is_coherent }
+                                                       , stats{ _other.stats }
+                                                       , allocator_{ std::exchange(_other.allocator_, nullptr) }
+                                                       , head_{ _other.head_ }
+                                                       , frame_begin_{ _other.frame_begin_ }
+                                                       , frame_end_{ _other.frame_end_ }
+                                                       , flushed_{ _other.flushed_ } {}
+
+UniformRing& UniformRing::operator=(UniformRing&& _other) noexcept {
+	if (this == &_other) return *this;
+	std::swap(buffer, _other.buffer);
+	std::swap(allocation, _other.allocation);
+	std::swap(mapped, _other.mapped);
+	std::swap(alignment, _other.alignment);
+	std::swap(frame_capacity, _other.frame_capacity);
+	std::swap(frame_count, _other.frame_count);
+	std::swap(is_coherent, _other.is_coherent);
+	std::swap(stats, _other.stats);
+	std::swap(allocator_, _other.allocator_);
+	std::swap(head_, _other.head_);
+	std::swap(frame_begin_, _other.frame_begin_);
+	std::swap(frame_end_, _other.frame_end_);
+	std::swap(flushed_, _other.flushed_);
+	return *this;
+}
+
+Res<UniformRing> UniformRing::create(const vma::Allocator& _allocator, const usize _frame_capacity, const u32 _frame_count, const usize _alignment, const std::vector<u32>& _shared_families) {
+	const auto alignment = std::max(_alignment, cast<usize>(1));
+	const auto frame_capacity = closest_multiple(_frame_capacity, alignment);
+	const auto capacity = frame_capacity * _frame_count;
+
+	if (capacity > max_value<u32>) {
+		return Err::make(std::fmt("Uniform ring of %llu bytes can not be addressed by dynamic offsets" CODE_LOC, cast<u64>(capacity)));
+	}
+
+	vma::AllocationInfo allocation_info;
+	auto [result, buffer] = _allocator.createBuffer({
+		.size = capacity,
+		.usage = vk::BufferUsageFlagBits::eUniformBuffer,
+		.sharingMode = _shared_families.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+		.queueFamilyIndexCount = cast<u32>(_shared_families.size()),
+		.pQueueFamilyIndices = _shared_families.data(),
+	}, {
+		.flags = vma::AllocationCreateFlagBits::eMapped,
+		.usage = vma::MemoryUsage::eCpuToGpu,
+	}, allocation_info);
+	if (failed(result)) {
+		return Err::make(std::fmt("Uniform ring creation failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	const auto memory_flags = _allocator.getMemoryTypeProperties(allocation_info.memoryType);
+
+	return UniformRing{
+		_allocator,
+		buffer.first,
+		buffer.second,
+		cast<u8*>(allocation_info.pMappedData),
+		alignment,
+		frame_capacity,
+		_frame_count,
+		cast<b8>(memory_flags & vk::MemoryPropertyFlagBits::eHostCoherent),
+	};
+}
+
+Res<UniformRing::Allocation> UniformRing::allocate(const usize _size) {
+	const auto start = closest_multiple(head_, alignment);
+	if (start + _size > frame_end_) {
+		++stats.overflows;
+		return Err::make(std::fmt("Uniform allocation of %llu bytes overflows the frame's %llu bytes" CODE_LOC, cast<u64>(_size), cast<u64>(frame_capacity)));
+	}
+
+	head_ = start + _size;
+
+	++stats.allocations;
+	stats.frame_used = head_ - frame_begin_;
+	stats.peak_frame_used = std::max(stats.peak_frame_used, stats.frame_used);
+
+	return Allocation{
+		.buffer = buffer,
+		.offset = cast<u32>(start),
+		.size = _size,
+		.mapped = mapped + start,
+	};
+}
+
+void UniformRing::begin_frame(const u32 _frame_index) {
+	flush();
+
+	frame_begin_ = cast<usize>(_frame_index % frame_count) * frame_capacity;
+	frame_end_ = frame_begin_ + frame_capacity;
+	head_ = frame_begin_;
+	flushed_ = frame_begin_;
+	stats.frame_used = 0;
+}
+
+void UniformRing::flush() {
+	if (head_ == flushed_) return;
+
+	if (!is_coherent) {
+		allocator_.flushAllocation(allocation, flushed_, head_ - flushed_);
+	}
+	flushed_ = head_;
+}
+
+void UniformRing::destroy() {
+	if (!allocator_) return;
+
+	if (buffer) {
+		allocator_.destroyBuffer(buffer, allocation);
+	}
+	buffer = nullptr;
+	allocation = nullptr;
+	mapped = nullptr;
+	allocator_ = nullptr;
+}
+
+UniformRing::~UniformRing() {
+	destroy();
+}
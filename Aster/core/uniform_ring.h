@@ -0,0 +1,124 @@
+// =============================================
+//  Aster: uniform_ring.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+/**
+ * @class UniformRing
+ *
+ * @brief Persistently mapped uniform buffer that per-frame constants are bump-allocated from.
+ *
+ * The buffer is split into one segment per frame in flight. Allocations are carved linearly
+ * out of the current frame's segment and bound through dynamic uniform buffer descriptors, so
+ * descriptor sets can be written once against `buffer` and reused. The segment is reset when
+ * its frame slot comes around again, which the owner only does after that slot has retired.
+ */
+struct UniformRing {
+	static constexpr usize default_frame_capacity = 256 * 1024;
+
+	struct Allocation {
+		vk::Buffer buffer;
+		u32 offset{};
+		usize size{};
+		u8* mapped{ nullptr };
+	};
+
+	struct Stats {
+		usize frame_capacity{};
+		usize frame_used{};
+		usize peak_frame_used{};
+		u64 allocations{};
+		u64 overflows{};
+	};
+
+	vk::Buffer buffer;
+	vma::Allocation allocation;
+	u8* mapped{ nullptr };
+	usize alignment{ 0 };
+	usize frame_capacity{ 0 };
+	u32 frame_count{ 0 };
+	b8 is_coherent{ false };
+	Stats stats;
+
+	UniformRing() = default;
+
+	UniformRing(const vma::Allocator& _allocator, const vk::Buffer& _buffer, const vma::Allocation& _allocation, u8* _mapped, usize _alignment, usize _frame_capacity, u32 _frame_count, b8 _is_coherent)
+		: buffer(_buffer)
+		, allocation(_allocation)
+		, mapped(_mapped)
+		, alignment(_alignment)
+		, frame_capacity(_frame_capacity)
+		, frame_count(_frame_count)
+		, is_coherent(_is_coherent)
+		, stats{ .frame_capacity = _frame_capacity }
+		, allocator_(_allocator)
+		, frame_end_(_frame_capacity) {}
+
+	UniformRing(const UniformRing& _other) = delete;
+	UniformRing(UniformRing&& _other) noexcept;
+	UniformRing& operator=(const UniformRing& _other) = delete;
+	UniformRing& operator=(UniformRing&& _other) noexcept;
+
+	/**
+	 * `_alignment` should be the device's `minUniformBufferOffsetAlignment`.
+	 * The ring is concurrent between `_shared_families` when there is more than one.
+	 */
+	static Res<UniformRing> create(const vma::Allocator& _allocator, usize _frame_capacity, u32 _frame_count, usize _alignment, const std::vector<u32>& _shared_families = {});
+
+	/**
+	 * Carve `_size` bytes out of the current frame. The memory is valid until the frame slot is reused.
+	 */
+	[[nodiscard]]
+	Res<Allocation> allocate(usize _size);
+
+	/**
+	 * Allocate and copy `_value` in. The returned offset goes straight into `bindDescriptorSets`.
+	 */
+	template <typename T>
+	[[nodiscard]]
+	Res<Allocation> push(const T& _value) {
+		auto res = allocate(sizeof(T));
+		if (res) {
+			memcpy(res->mapped, &_value, sizeof(T));
+		}
+		return res;
+	}
+
+	/**
+	 * Descriptor info to write once into a dynamic uniform buffer binding of `_range` bytes.
+	 */
+	[[nodiscard]]
+	vk::DescriptorBufferInfo descriptor_info(const usize _range) const {
+		return {
+			.buffer = buffer,
+			.offset = 0,
+			.range = _range,
+		};
+	}
+
+	/**
+	 * Reset the segment of `_frame_index`. The caller guarantees the GPU is done with it.
+	 */
+	void begin_frame(u32 _frame_index);
+
+	/**
+	 * Make everything written since the last flush visible to the device. No-op on coherent memory.
+	 */
+	void flush();
+
+	void destroy();
+
+	~UniformRing();
+
+private:
+	vma::Allocator allocator_;
+
+	usize head_{ 0 };
+	usize frame_begin_{ 0 };
+	usize frame_end_{ 0 };
+	usize flushed_{ 0 };
+};
@@ -0,0 +1,226 @@
+// =============================================
+//  Aster: upload_batcher.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "upload_batcher.h"
+
+#include <core/queue_ownership.h>
+
+UploadBatcher::UploadBatcher(UploadBatcher&& _other) noexcept: stats{ _other.stats }
+                                                             , device_{ std::exchange(_other.device_, nullptr) }
+                                                             , pool_{ std::exchange(_other.pool_, nullptr) }
+                                                             , family_{ _other.family_ }
+                                                             , open_{ std::exchange(_other.open_, std::nullopt) }
+                                                             , in_flight_{ std::move(_other.in_flight_) }
+                                                             , free_batches_{ std::move(_other.free_batches_) }
+                                                             , next_batch_{ _other.next_batch_ }
+                                                             , completed_batch_{ _other.completed_batch_ }
+                                                             , discarded_{ std::move(_other.discarded_) } {}
+
+UploadBatcher& UploadBatcher::operator=(UploadBatcher&& _other) noexcept {
+	if (this == &_other) return *this;
+	std::swap(stats, _other.stats);
+	std::swap(device_, _other.device_);
+	std::swap(pool_, _other.pool_);
+	std::swap(family_, _other.family_);
+	std::swap(open_, _other.open_);
+	std::swap(in_flight_, _other.in_flight_);
+	std::swap(free_batches_, _other.free_batches_);
+	std::swap(next_batch_, _other.next_batch_);
+	std::swap(completed_batch_, _other.completed_batch_);
+	std::swap(discarded_, _other.discarded_);
+	return *this;
+}
+
+Res<UploadBatcher> UploadBatcher::create(const vk::Device& _device, const u32 _queue_family) {
+	auto [result, pool] = _device.createCommandPool({
+		.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+		.queueFamilyIndex = _queue_family,
+	});
+	if (failed(result)) {
+		return Err::make(std::fmt("Upload batch command pool creation failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	return UploadBatcher{ _device, pool, _queue_family };
+}
+
+Res<> UploadBatcher::open_batch() {
+	if (open_) {
+		if (!open_->closed) return {};
+		return Err::make("Upload batch is closed but was neither submitted nor discarded" CODE_LOC);
+	}
+
+	Batch batch;
+	if (!free_batches_.empty()) {
+		batch = std::move(free_batches_.back());
+		free_batches_.pop_back();
+	} else {
+		vk::CommandBufferAllocateInfo allocate_info = {
+			.commandPool = pool_,
+			.level = vk::CommandBufferLevel::ePrimary,
+			.commandBufferCount = 1,
+		};
+		if (const auto result = device_.allocateCommandBuffers(&allocate_info, &batch.cmd); failed(result)) {
+			return Err::make(std::fmt("Upload batch command buffer allocation failed with %s" CODE_LOC, to_cstr(result)), result);
+		}
+	}
+
+	if (const auto result = batch.cmd.begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit, }); failed(result)) {
+		free_batches_.push_back(std::move(batch));
+		return Err::make(std::fmt("Upload batch begin failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+
+	batch.id = next_batch_++;
+	batch.copies = 0;
+	batch.closed = false;
+	open_ = std::move(batch);
+	return {};
+}
+
+Res<UploadTicket> UploadBatcher::copy_buffer(const vk::Buffer _src, const vk::Buffer _dst, const vk::BufferCopy& _region, const u32 _dst_family) {
+	if (auto res = open_batch(); !res) {
+		return Err::make(std::move(res.error()));
+	}
+
+	open_->cmd.copyBuffer(_src, _dst, { _region });
+	QueueOwnershipTransfer{
+		.src_family = family_,
+		.dst_family = _dst_family,
+		.src_stage = vk::PipelineStageFlagBits::eTransfer,
+		.src_access = vk::AccessFlagBits::eTransferWrite,
+	}.release(open_->cmd, _dst, _region.dstOffset, _region.size);
+	++open_->copies;
+	++stats.copies;
+	stats.bytes += _region.size;
+	return UploadTicket{ open_->id };
+}
+
+Res<UploadTicket> UploadBatcher::copy_image(const vk::Buffer _src, const vk::Image _dst, const vk::BufferImageCopy& _region, const vk::ImageSubresourceRange& _range, const vk::ImageLayout _final_layout, const u32 _dst_family) {
+	if (auto res = open_batch(); !res) {
+		return Err::make(std::move(res.error()));
+	}
+
+	auto& cmd = open_->cmd;
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, {
+		{
+			.srcAccessMask = {},
+			.dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+			.oldLayout = vk::ImageLayout::eUndefined,
+			.newLayout = vk::ImageLayout::eTransferDstOptimal,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = _dst,
+			.subresourceRange = _range,
+		} });
+	cmd.copyBufferToImage(_src, _dst, vk::ImageLayout::eTransferDstOptimal, { _region });
+
+	const QueueOwnershipTransfer transfer = {
+		.src_family = family_,
+		.dst_family = _dst_family,
+		.src_stage = vk::PipelineStageFlagBits::eTransfer,
+		.src_access = vk::AccessFlagBits::eTransferWrite,
+	};
+	if (transfer.is_required()) {
+		transfer.release(cmd, _dst, _range, vk::ImageLayout::eTransferDstOptimal, _final_layout);
+	} else {
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, {
+			{
+				.srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+				.dstAccessMask = {},
+				.oldLayout = vk::ImageLayout::eTransferDstOptimal,
+				.newLayout = _final_layout,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = _dst,
+				.subresourceRange = _range,
+			} });
+	}
+
+	++open_->copies;
+	++stats.copies;
+	return UploadTicket{ open_->id };
+}
+
+Res<> UploadBatcher::keep_alive(Buffer&& _staging) {
+	if (auto res = open_batch(); !res) {
+		return Err::make(std::move(res.error()));
+	}
+
+	open_->staging.emplace_back(std::move(_staging));
+	return {};
+}
+
+Res<vk::CommandBuffer> UploadBatcher::close() {
+	if (!open_) return vk::CommandBuffer{};
+	if (open_->closed) return open_->cmd;
+
+	if (const auto result = open_->cmd.end(); failed(result)) {
+		discard();
+		return Err::make(std::fmt("Upload batch end failed with %s" CODE_LOC, to_cstr(result)), result);
+	}
+	open_->closed = true;
+	return open_->cmd;
+}
+
+void UploadBatcher::submitted(const u64 _timeline_value) {
+	ERROR_IF(!open_ || !open_->closed, "Only a closed upload batch can be submitted");
+	if (!open_) return;
+
+	auto& batch = open_.value();
+	batch.timeline_value = _timeline_value;
+
+	++stats.batches;
+	stats.max_copies_per_batch = std::max(stats.max_copies_per_batch, batch.copies);
+	VERBOSE(std::fmt("Upload batch %llu submitted with %llu copies", batch.id, batch.copies));
+
+	in_flight_.push_back(std::move(batch));
+	open_ = std::nullopt;
+}
+
+void UploadBatcher::discard() {
+	if (!open_) return;
+
+	WARN(std::fmt("Upload batch %llu with %llu copies discarded", open_->id, open_->copies));
+	WARN_IF(failed(open_->cmd.reset({})), "Upload batch command reset failed");
+	discarded_.push_back(open_->id);
+	open_->staging.clear();
+	free_batches_.push_back(std::move(open_.value()));
+	open_ = std::nullopt;
+}
+
+void UploadBatcher::retire(const u64 _completed_value) {
+	while (!in_flight_.empty() && in_flight_.front().timeline_value <= _completed_value) {
+		auto& batch = in_flight_.front();
+		completed_batch_ = batch.id;
+		batch.staging.clear();
+		const auto result = batch.cmd.reset({});
+		WARN_IF(failed(result), std::fmt("Upload batch command reset failed with %s", to_cstr(result)));
+		free_batches_.push_back(std::move(batch));
+		in_flight_.pop_front();
+	}
+}
+
+Option<u64> UploadBatcher::timeline_value(const UploadTicket& _ticket) const {
+	for (const auto& batch_ : in_flight_) {
+		if (batch_.id == _ticket.batch) return batch_.timeline_value;
+	}
+	return std::nullopt;
+}
+
+void UploadBatcher::destroy() {
+	if (!device_) return;
+
+	// The owner waits for the transfer queue to idle before tearing down.
+	open_ = std::nullopt;
+	in_flight_.clear();
+	free_batches_.clear();
+
+	device_.destroyCommandPool(pool_);
+	pool_ = nullptr;
+	device_ = nullptr;
+}
+
+UploadBatcher::~UploadBatcher() {
+	destroy();
+}
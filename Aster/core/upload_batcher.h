@@ -0,0 +1,147 @@
+// =============================================
+//  Aster: upload_batcher.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+#include <core/buffer.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+struct UploadTicket {
+	u64 batch{ 0 };
+
+	[[nodiscard]]
+	b8 valid() const {
+		return batch != 0;
+	}
+};
+
+/**
+ * @class UploadBatcher
+ *
+ * @brief Coalesces buffer and image copies into a single transfer submission.
+ *
+ * Copies are recorded into the open batch as they come in. The owner closes the batch,
+ * submits it once, and reports the timeline value it will complete at. Every copy gets a
+ * ticket naming its batch, which can be polled or waited on.
+ */
+class UploadBatcher {
+public:
+	struct Stats {
+		u64 batches{};
+		u64 copies{};
+		u64 bytes{};
+		u64 max_copies_per_batch{};
+		u64 direct_writes{};
+		u64 direct_bytes{};
+	};
+
+	Stats stats;
+
+	UploadBatcher() = default;
+
+	UploadBatcher(const vk::Device& _device, const vk::CommandPool& _pool, const u32 _queue_family)
+		: device_(_device)
+		, pool_(_pool)
+		, family_(_queue_family) {}
+
+	UploadBatcher(const UploadBatcher& _other) = delete;
+	UploadBatcher(UploadBatcher&& _other) noexcept;
+	UploadBatcher& operator=(const UploadBatcher& _other) = delete;
+	UploadBatcher& operator=(UploadBatcher&& _other) noexcept;
+
+	static Res<UploadBatcher> create(const vk::Device& _device, u32 _queue_family);
+
+	/**
+	 * If `_dst_family` differs from the batcher's family, ownership of the copied range is released to it.
+	 */
+	[[nodiscard]]
+	Res<UploadTicket> copy_buffer(vk::Buffer _src, vk::Buffer _dst, const vk::BufferCopy& _region, u32 _dst_family = VK_QUEUE_FAMILY_IGNORED);
+
+	/**
+	 * Copy into `_dst`, transitioning `_range` from undefined to transfer dst before and to `_final_layout` after.
+	 * If `_dst_family` differs from the batcher's family, the final transition doubles as the ownership release.
+	 */
+	[[nodiscard]]
+	Res<UploadTicket> copy_image(vk::Buffer _src, vk::Image _dst, const vk::BufferImageCopy& _region, const vk::ImageSubresourceRange& _range, vk::ImageLayout _final_layout, u32 _dst_family = VK_QUEUE_FAMILY_IGNORED);
+
+	/**
+	 * Keep a dedicated staging buffer alive until the open batch retires.
+	 */
+	[[nodiscard]]
+	Res<> keep_alive(Buffer&& _staging);
+
+	[[nodiscard]]
+	b8 has_pending() const {
+		return open_.has_value();
+	}
+
+	/**
+	 * End the open batch for submission. Returns a null handle if there was nothing recorded.
+	 * Must be followed by `submitted` or `discard`.
+	 */
+	[[nodiscard]]
+	Res<vk::CommandBuffer> close();
+
+	void submitted(u64 _timeline_value);
+
+	/**
+	 * Drop the open batch. Its tickets never complete.
+	 */
+	void discard();
+
+	/**
+	 * Recycle every batch the transfer timeline has passed.
+	 */
+	void retire(u64 _completed_value);
+
+	[[nodiscard]]
+	b8 is_complete(const UploadTicket& _ticket) const {
+		return _ticket.batch <= completed_batch_ && !is_discarded(_ticket);
+	}
+
+	[[nodiscard]]
+	b8 is_discarded(const UploadTicket& _ticket) const {
+		return std::ranges::binary_search(discarded_, _ticket.batch);
+	}
+
+	/**
+	 * Timeline value the ticket's batch completes at, if it has been submitted.
+	 */
+	[[nodiscard]]
+	Option<u64> timeline_value(const UploadTicket& _ticket) const;
+
+	void destroy();
+
+	~UploadBatcher();
+
+private:
+	struct Batch {
+		u64 id{};
+		vk::CommandBuffer cmd;
+		u64 copies{};
+		u64 timeline_value{};
+		b8 closed{ false };
+		std::vector<Buffer> staging;
+	};
+
+	Res<> open_batch();
+
+	vk::Device device_;
+	vk::CommandPool pool_;
+	u32 family_{ VK_QUEUE_FAMILY_IGNORED };
+
+	Option<Batch> open_;
+	std::deque<Batch> in_flight_;
+	std::vector<Batch> free_batches_;
+
+	u64 next_batch_{ 1 };
+	u64 completed_batch_{ 0 };
+	// Ids are handed out in order, so this stays sorted.
+	std::vector<u64> discarded_;
+};
@@ -0,0 +1,17 @@
+// =============================================
+//  Aster: bindless.hlsli
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+// Mirrors BindlessHeap: set 3, one unbounded array per resource kind.
+// Indices come from ImageView::register_sampled/register_storage, Buffer::register_storage
+// and Sampler::register_bindless, and reach the shader through push constants.
+[[vk::binding(0, 3)]] Texture2D bindless_textures[];
+[[vk::binding(1, 3)]] RWTexture2D<float4> bindless_storage_images[];
+[[vk::binding(2, 3)]] SamplerState bindless_samplers[];
+[[vk::binding(3, 3)]] RWByteAddressBuffer bindless_buffers[];
+
+// Indices must be uniform across the draw; non-uniform indexing is not enabled on the device.
+float4 sample_bindless(uint _texture, uint _sampler, float2 _uv) {
+	return bindless_textures[_texture].Sample(bindless_samplers[_sampler], _uv);
+}
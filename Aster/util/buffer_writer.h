@@ -21,18 +21,24 @@ public:
 	BufferWriter(const BufferWriter& _other)
 		: buffer_{ _other.buffer_ }
 		, parent_device_{ _other.parent_device_ }
-		, alignment_{ _other.alignment_ } {}
+		, alignment_{ _other.alignment_ }
+		, dirty_begin_{ _other.dirty_begin_ }
+		, dirty_end_{ _other.dirty_end_ } {}
 
 	BufferWriter(BufferWriter&& _other) noexcept
 		: buffer_{ std::move(_other.buffer_) }
 		, parent_device_{ std::move(_other.parent_device_) }
-		, alignment_{ _other.alignment_ } {}
+		, alignment_{ _other.alignment_ }
+		, dirty_begin_{ std::exchange(_other.dirty_begin_, max_value<usize>) }
+		, dirty_end_{ std::exchange(_other.dirty_end_, 0) } {}
 
 	BufferWriter& operator=(const BufferWriter& _other) {
 		if (this == &_other) return *this;
 		buffer_ = _other.buffer_;
 		parent_device_ = _other.parent_device_;
 		alignment_ = _other.alignment_;
+		dirty_begin_ = _other.dirty_begin_;
+		dirty_end_ = _other.dirty_end_;
 		return *this;
 	}
 
@@ -41,6 +47,8 @@ public:
 		buffer_ = std::move(_other.buffer_);
 		parent_device_ = std::move(_other.parent_device_);
 		alignment_ = _other.alignment_;
+		dirty_begin_ = std::exchange(_other.dirty_begin_, max_value<usize>);
+		dirty_end_ = std::exchange(_other.dirty_end_, 0);
 		return *this;
 	}
 
@@ -51,7 +59,8 @@ public:
 
 	template <typename... Ts>
 	Res<usize> write(Ts const&... _writes) {
-		ERROR_IF(buffer_->memory_usage != vma::MemoryUsage::eCpuToGpu &&
+		ERROR_IF(!buffer_->is_host_writable() &&
+			buffer_->memory_usage != vma::MemoryUsage::eCpuToGpu &&
 			buffer_->memory_usage != vma::MemoryUsage::eCpuOnly, "Memory is not on CPU so mapping can't be done. Use upload_data");
 
 		auto mapped_memory = begin_mapping();
@@ -65,6 +74,25 @@ public:
 		return written;
 	}
 
+	/**
+	 * Make everything written since the last flush visible to the device with a single flush of the dirty range.
+	 * Nothing is issued for host coherent memory.
+	 */
+	void flush() {
+		if (dirty_begin_ >= dirty_end_) return;
+
+		if (!buffer_->is_host_coherent()) {
+			parent_device_->allocator.flushAllocation(buffer_->allocation, dirty_begin_, dirty_end_ - dirty_begin_);
+		}
+		dirty_begin_ = max_value<usize>;
+		dirty_end_ = 0;
+	}
+
+	[[nodiscard]]
+	b8 is_dirty() const {
+		return dirty_begin_ < dirty_end_;
+	}
+
 
 	class BufferWriterOStream {
 	public:
@@ -116,6 +144,13 @@ private:
 	Borrowed<Device> parent_device_;
 	usize alignment_{ 4 };
 
+	// Byte range written since the last flush.
+	usize dirty_begin_{ max_value<usize> };
+	usize dirty_end_{ 0 };
+
+	// Base of the current mapping, so write heads can be turned into dirty offsets.
+	u8* base_{ nullptr };
+
 	template <typename T> requires std::is_same_v<T, usize>
 	static usize expand(T _first) {
 		return _first;
@@ -130,22 +165,38 @@ private:
 		return 0;
 	}
 
-	usize write_to(u8** _ptr, const void* _data, const usize _size) const {
+	usize write_to(u8** _ptr, const void* _data, const usize _size) {
 		const auto to_write = closest_multiple(_size, alignment_);
 		memcpy(*_ptr, _data, _size);
+		mark_dirty(*_ptr, _size);
 		*_ptr += to_write;
 		return to_write;
 	}
 
+	void mark_dirty(const u8* _ptr, const usize _size) {
+		const auto offset = cast<usize>(_ptr - base_);
+		dirty_begin_ = std::min(dirty_begin_, offset);
+		dirty_end_ = std::max(dirty_end_, offset + _size);
+	}
+
 	Res<u8*> begin_mapping() {
+		if (buffer_->mapped) {
+			base_ = buffer_->mapped;
+			return base_;
+		}
+
 		if (auto res = parent_device_->allocator.mapMemory(buffer_->allocation); failed(res.result)) {
 			return Err::make(std::fmt("Memory mapping failed with %s" CODE_LOC, to_cstr(res.result)), res.result);
 		} else {
-			return cast<u8*>(res.value);
+			base_ = cast<u8*>(res.value);
+			return base_;
 		}
 	}
 
 	void end_mapping() {
+		if (buffer_->mapped) return;
+		// Flushing needs the memory mapped, so transient mappings flush before they go away.
+		flush();
 		parent_device_->allocator.unmapMemory(buffer_->allocation);
 	}
 };
@@ -0,0 +1,100 @@
+// =============================================
+//  Aster: cache_key.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "cache_key.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace {
+	constexpr u64 secret0 = 0xa0761d6478bd642full;
+	constexpr u64 secret1 = 0xe7037ed1a0b428dbull;
+	constexpr u64 secret2 = 0x8ebc6af09c88c6e3ull;
+	constexpr u64 secret3 = 0x589965cc75374cc3ull;
+
+	// 64x64 -> 128 multiply; `_a` gets the low half, `_b` the high half.
+	void multiply(u64& _a, u64& _b) {
+#if defined(__SIZEOF_INT128__)
+		const auto product = cast<unsigned __int128>(_a) * _b;
+		_a = cast<u64>(product);
+		_b = cast<u64>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+		_a = _umul128(_a, _b, &_b);
+#else
+		const u64 ha = _a >> 32, hb = _b >> 32, la = cast<u32>(_a), lb = cast<u32>(_b);
+		const u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+		const u64 t = rl + (rm0 << 32);
+		const u64 lo = t + (rm1 << 32);
+		_b = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+		_a = lo;
+#endif
+	}
+
+	u64 mix(u64 _a, u64 _b) {
+		multiply(_a, _b);
+		return _a ^ _b;
+	}
+
+	u64 read8(const u8* _p) {
+		u64 value;
+		memcpy(&value, _p, sizeof(value));
+		return value;
+	}
+
+	u64 read4(const u8* _p) {
+		u32 value;
+		memcpy(&value, _p, sizeof(value));
+		return value;
+	}
+
+	u64 read3(const u8* _p, const usize _k) {
+		return (cast<u64>(_p[0]) << 16) | (cast<u64>(_p[_k >> 1]) << 8) | _p[_k - 1];
+	}
+}
+
+u64 hash_bytes(const std::span<const u8>& _data, u64 _seed) noexcept {
+	const auto* p = _data.data();
+	const auto length = _data.size();
+
+	_seed ^= mix(_seed ^ secret0, secret1);
+	u64 a, b;
+	if (length <= 16) {
+		if (length >= 4) {
+			a = (read4(p) << 32) | read4(p + ((length >> 3) << 2));
+			b = (read4(p + length - 4) << 32) | read4(p + length - 4 - ((length >> 3) << 2));
+		} else if (length > 0) {
+			a = read3(p, length);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		usize remaining = length;
+		if (remaining > 48) {
+			u64 seed1 = _seed;
+			u64 seed2 = _seed;
+			do {
+				_seed = mix(read8(p) ^ secret1, read8(p + 8) ^ _seed);
+				seed1 = mix(read8(p + 16) ^ secret2, read8(p + 24) ^ seed1);
+				seed2 = mix(read8(p + 32) ^ secret3, read8(p + 40) ^ seed2);
+				p += 48;
+				remaining -= 48;
+			} while (remaining > 48);
+			_seed ^= seed1 ^ seed2;
+		}
+		while (remaining > 16) {
+			_seed = mix(read8(p) ^ secret1, read8(p + 8) ^ _seed);
+			p += 16;
+			remaining -= 16;
+		}
+		a = read8(p + remaining - 16);
+		b = read8(p + remaining - 8);
+	}
+	a ^= secret1;
+	b ^= _seed;
+	multiply(a, b);
+	return mix(a ^ secret0 ^ length, b ^ secret1);
+}
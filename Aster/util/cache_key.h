@@ -0,0 +1,86 @@
+// =============================================
+//  Aster: cache_key.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <bit>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+/**
+ * 64-bit wyhash over `_data`. Much faster than chaining `hash_combine` per field, and mixes the full width.
+ */
+[[nodiscard]]
+u64 hash_bytes(const std::span<const u8>& _data, u64 _seed = 0) noexcept;
+
+/**
+ * @struct CacheKey
+ *
+ * @brief Canonical bytes of a cache key, with their hash.
+ *
+ * Maps keyed on this compare the bytes on a hash match, so a collision is a miss instead of a wrong hit.
+ */
+struct CacheKey {
+	std::vector<u8> data;
+	u64 hash{};
+
+	[[nodiscard]]
+	b8 operator==(const CacheKey& _other) const {
+		return hash == _other.hash && data == _other.data;
+	}
+};
+
+template <>
+struct std::hash<CacheKey> {
+	[[nodiscard]]
+	usize operator()(const CacheKey& _value) const noexcept {
+		return cast<usize>(_value.hash);
+	}
+};
+
+/**
+ * @class CacheKeyWriter
+ *
+ * @brief Appends fields to a canonical byte serialization.
+ *
+ * Values are written field by field, never as whole structs, so padding and pointers never reach the key.
+ * Ranges and strings are length prefixed, so two adjacent lists cannot alias each other.
+ */
+class CacheKeyWriter {
+public:
+	template <typename T>
+	CacheKeyWriter& write(const T& _value) {
+		static_assert(std::is_trivially_copyable_v<T> && std::has_unique_object_representations_v<T>, "Write the fields of padded types one by one");
+		const auto* bytes = recast<const u8*>(&_value);
+		data_.insert(data_.end(), bytes, bytes + sizeof(T));
+		return *this;
+	}
+
+	// Floats are written by bits, so -0.0 and 0.0 are different keys; that only costs a duplicate.
+	CacheKeyWriter& write(const f32 _value) {
+		return write(std::bit_cast<u32>(_value));
+	}
+
+	CacheKeyWriter& write(const std::string_view& _value) {
+		write(cast<u64>(_value.size()));
+		data_.insert(data_.end(), _value.begin(), _value.end());
+		return *this;
+	}
+
+	[[nodiscard]]
+	CacheKey finish() && {
+		const auto hash = hash_bytes(data_);
+		return {
+			.data = std::move(data_),
+			.hash = hash,
+		};
+	}
+
+private:
+	std::vector<u8> data_;
+};
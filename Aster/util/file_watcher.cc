@@ -0,0 +1,65 @@
+// =============================================
+//  Aster: file_watcher.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "file_watcher.h"
+
+namespace fs = std::filesystem;
+
+FileWatcher::FileWatcher(const std::string_view& _directory, const std::string_view& _extension, Callback&& _on_change, const u32 _interval_ms)
+	: directory_(_directory)
+	, extension_(_extension)
+	, on_change_(std::move(_on_change))
+	, interval_(_interval_ms) {
+	// The first scan only records the current state.
+	std::error_code error;
+	for (const auto& entry_ : fs::directory_iterator(directory_, error)) {
+		if (entry_.path().extension() != extension_) continue;
+		stamps_[entry_.path().generic_string()] = entry_.last_write_time(error);
+	}
+	WARN_IF(error, std::fmt("Watching '%s' failed with '%s'", directory_.c_str(), error.message().c_str())) ELSE_INFO(std::fmt("Watching '%s' for %s changes", directory_.c_str(), extension_.c_str()));
+
+	thread_ = std::thread{ [this] { watch(); } };
+}
+
+FileWatcher::~FileWatcher() {
+	{
+		std::lock_guard lock{ mutex_ };
+		stopping_ = true;
+	}
+	wake_.notify_all();
+	thread_.join();
+}
+
+void FileWatcher::watch() {
+	std::unique_lock lock{ mutex_ };
+	while (!wake_.wait_for(lock, interval_, [this] { return stopping_; })) {
+		lock.unlock();
+		poll();
+		lock.lock();
+	}
+}
+
+void FileWatcher::poll() {
+	std::error_code error;
+	for (const auto& entry_ : fs::directory_iterator(directory_, error)) {
+		if (entry_.path().extension() != extension_) continue;
+
+		const auto write_time = entry_.last_write_time(error);
+		if (error) continue;
+
+		auto path = entry_.path().generic_string();
+		if (const auto found = settling_.find(path); found != settling_.end()) {
+			if (found->second == write_time) {
+				settling_.erase(found);
+				stamps_[path] = write_time;
+				on_change_(path);
+			} else {
+				found->second = write_time;
+			}
+		} else if (const auto stamp = stamps_.find(path); stamp == stamps_.end() || stamp->second != write_time) {
+			settling_[std::move(path)] = write_time;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+// =============================================
+//  Aster: file_watcher.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * @class FileWatcher
+ *
+ * @brief Polls a directory on its own thread and reports files whose write time changed.
+ *
+ * Polling keeps this portable across platforms and filesystems. A change is only reported once the
+ * write time holds still for one interval, so files are not picked up half-written by the compiler.
+ * The callback runs on the watcher thread.
+ */
+class FileWatcher {
+public:
+	using Callback = std::function<void(const std::string& _path)>;
+
+	FileWatcher(const std::string_view& _directory, const std::string_view& _extension, Callback&& _on_change, u32 _interval_ms = 250);
+
+	FileWatcher(const FileWatcher& _other) = delete;
+	FileWatcher(FileWatcher&& _other) noexcept = delete;
+	FileWatcher& operator=(const FileWatcher& _other) = delete;
+	FileWatcher& operator=(FileWatcher&& _other) noexcept = delete;
+
+	~FileWatcher();
+
+private:
+	void watch();
+	void poll();
+
+	std::string directory_;
+	std::string extension_;
+	Callback on_change_;
+	std::chrono::milliseconds interval_;
+
+	std::unordered_map<std::string, std::filesystem::file_time_type> stamps_;
+	// Changed files waiting for their write time to settle.
+	std::unordered_map<std::string, std::filesystem::file_time_type> settling_;
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	b8 stopping_{ false };
+	std::thread thread_;
+};
@@ -6,6 +6,7 @@
 #include "files.h"
 #include <vector>
 #include <fstream>
+#include <filesystem>
 
 b8 file_exists(const std::string_view& _name) noexcept {
 	struct stat s;
@@ -26,3 +27,41 @@ std::vector<u32> load_binary32_file(const std::string_view& _name) noexcept {
 	}
 	return filedata;
 }
+
+std::vector<u8> load_binary_file(const std::string_view& _name) noexcept {
+	std::vector<u8> filedata;
+	std::ifstream file(_name.data(), std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		const size_t filesize = file.tellg();
+		filedata.resize(filesize);
+		file.seekg(0);
+		file.read((char*)filedata.data(), filesize);
+		file.close();
+	}
+	return filedata;
+}
+
+b8 write_text_file(const std::string_view& _name, const std::string_view& _text) noexcept {
+	std::ofstream file(_name.data(), std::ios::trunc | std::ios::binary);
+	if (!file.is_open()) return false;
+	file.write(_text.data(), _text.size());
+	return file.good();
+}
+
+b8 write_binary_file_atomic(const std::string_view& _name, const std::span<const u8>& _data) noexcept {
+	const auto temp_name = std::string{ _name } + ".tmp";
+	{
+		std::ofstream file(temp_name, std::ios::trunc | std::ios::binary);
+		if (!file.is_open()) return false;
+		file.write((const char*)_data.data(), _data.size());
+		if (!file.good()) return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temp_name, _name, error);
+	if (error) {
+		std::filesystem::remove(temp_name, error);
+		return false;
+	}
+	return true;
+}
@@ -7,6 +7,11 @@
 
 #include <global.h>
 #include <vector>
+#include <span>
 
 b8 file_exists(const std::string_view& _name) noexcept;
 std::vector<u32> load_binary32_file(const std::string_view& _name) noexcept;
+std::vector<u8> load_binary_file(const std::string_view& _name) noexcept;
+b8 write_text_file(const std::string_view& _name, const std::string_view& _text) noexcept;
+// Writes next to `_name` first and renames over it, so a crash never leaves a truncated file behind.
+b8 write_binary_file_atomic(const std::string_view& _name, const std::span<const u8>& _data) noexcept;
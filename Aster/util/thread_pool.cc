@@ -0,0 +1,40 @@
+// =============================================
+//  Aster: thread_pool.cc
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(const u32 _worker_count) {
+	// Jobs would never run without a worker.
+	const auto worker_count = std::max(_worker_count, 1u);
+	workers_.reserve(worker_count);
+	for (u32 i = 0; i < worker_count; ++i) {
+		workers_.emplace_back([this] { work(); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock{ mutex_ };
+		stopping_ = true;
+	}
+	job_ready_.notify_all();
+	for (auto& worker_ : workers_) {
+		worker_.join();
+	}
+}
+
+void ThreadPool::work() {
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock lock{ mutex_ };
+			job_ready_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+			if (jobs_.empty()) return;
+			job = std::move(jobs_.front());
+			jobs_.pop_front();
+		}
+		job();
+	}
+}
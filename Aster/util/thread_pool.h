@@ -0,0 +1,77 @@
+// =============================================
+//  Aster: thread_pool.h
+//  Copyright (c) 2020-2021 Anish Bhobe
+// =============================================
+
+#pragma once
+
+#include <global.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ *
+ * @brief Fixed set of workers draining a shared FIFO of jobs.
+ *
+ * Jobs must not block on other jobs of the same pool, or a small pool can deadlock.
+ * The destructor finishes every queued job before joining the workers.
+ */
+class ThreadPool {
+public:
+	explicit ThreadPool(u32 _worker_count = default_worker_count());
+
+	ThreadPool(const ThreadPool& _other) = delete;
+	ThreadPool(ThreadPool&& _other) noexcept = delete;
+	ThreadPool& operator=(const ThreadPool& _other) = delete;
+	ThreadPool& operator=(ThreadPool&& _other) noexcept = delete;
+
+	~ThreadPool();
+
+	/**
+	 * Queue `_job` and return a future for its result.
+	 */
+	template <typename TLambda>
+	[[nodiscard]]
+	auto submit(TLambda&& _job) -> std::future<std::invoke_result_t<TLambda>> {
+		using result_type = std::invoke_result_t<TLambda>;
+
+		// std::function needs a copyable target, so the task is shared.
+		auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<TLambda>(_job));
+		auto future = task->get_future();
+		{
+			std::lock_guard lock{ mutex_ };
+			jobs_.emplace_back([task] { (*task)(); });
+		}
+		job_ready_.notify_one();
+		return future;
+	}
+
+	[[nodiscard]]
+	u32 worker_count() const {
+		return cast<u32>(workers_.size());
+	}
+
+	/**
+	 * One worker per hardware thread, leaving one for the submitting thread.
+	 */
+	[[nodiscard]]
+	static u32 default_worker_count() {
+		return std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+
+private:
+	void work();
+
+	std::vector<std::thread> workers_;
+	std::deque<std::function<void()>> jobs_;
+	std::mutex mutex_;
+	std::condition_variable job_ready_;
+	b8 stopping_{ false };
+};
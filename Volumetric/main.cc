@@ -18,7 +18,6 @@
 #include <core/image_view.h>
 #include <core/resource_pool.h>
 
-#include <util/buffer_writer.h>
 
 #include <vector>
 
@@ -66,6 +65,8 @@ i32 aster_main() {
 		if (failed(result1) || present_modes.empty()) return false;
 
 		return true;
+	}).select_on([](DInfo& _inf) {
+		return cast<bool>(_inf.features12.timelineSemaphore);
 	}).sort_by([](DInfo& _inf) {
 		u32 score = 0;
 		if (_inf.properties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu) {
@@ -77,6 +78,9 @@ i32 aster_main() {
 		if (_inf.queue_families.has_compute()) {
 			score++;
 		}
+		if (_inf.queue_families.has_async_compute()) {
+			score++;
+		}
 
 		const auto& device_features = _inf.features;
 		if (device_features.samplerAnisotropy) {
@@ -105,6 +109,11 @@ i32 aster_main() {
 	Camera camera{ { 0.0f, 1000.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, window->extent, 0.1f, 30.0f, 70_deg };
 	CameraController camera_controller{ window.borrow(), borrow(camera), 10000.0f };
 	Owned<PipelineFactory> pipeline_factory = new PipelineFactory{ device.borrow() };
+#if !defined(NDEBUG)
+	// Rebuilding a shader in the IDE swaps it in without a restart.
+	pipeline_factory->enable_hot_reload("res/shaders");
+	pipeline_factory->capture_statistics = true;
+#endif // !defined(NDEBUG)
 
 	Gui::Init(swapchain.borrow());
 
@@ -184,88 +193,48 @@ i32 aster_main() {
 
 	recreate_framebuffers();
 
-	if (auto res = pipeline_factory->create_pipeline({
+	// Compiles on a factory worker while the LUT contexts build theirs.
+	auto main_pipeline = pipeline_factory->create_pipeline_async({
 		.renderpass = borrow(render_pass),
 		.viewport_state = {
 			.enable_dynamic = true,
 		},
 		.shader_files = { R"(res/shaders/hillaire.vs.spv)", R"(res/shaders/hillaire.fs.spv)" },
+		.dynamic_buffers = { "camera", "sun", "atmos" },
 		.dynamic_states = { vk::DynamicState::eViewport, vk::DynamicState::eScissor },
 		.name = "Main Pipeline"
-	})) {
-		pipeline = res.value();
-		INFO(std::fmt("Pipeline %s Created", pipeline->name.c_str()));
-	} else {
-		ERROR(std::fmt("Pipeline creation failed with %s" CODE_LOC "\n|> %s", to_cstr(res.error().code()), res.error().what())) THEN_CRASH(res.error().code());
-	}
-
-	ResourcePool resource_pool;
-	if (auto res = ResourcePool::create(device.borrow(), pipeline->layout, swapchain->image_count)) {
-		resource_pool = std::move(res.value());
-		INFO(std::fmt("Resource Binders for pipeline %s successfully created", pipeline->name.c_str()));
-	} else {
-		ERROR(std::fmt("Resource Binders creation failed with %s" CODE_LOC "\n|> %s", to_cstr(res.error().code()), res.error().what())) THEN_CRASH(res.error().code());
-	}
-
-	std::vector<ResourceSet> resource_sets;
-	resource_sets.reserve(swapchain->image_count);
-	for (u32 i = 0; i < swapchain->image_count; ++i) {
-		if (auto res = resource_pool.allocate_resource_set()) {
-			resource_sets.push_back(std::move(res.value()));
-		}
-		else {
-			ERROR(std::fmt("Resource set alloc failed " CODE_LOC " |> %s", res.error().what())) THEN_CRASH(res.error().code());
-		}
-	}
+	});
 
 	struct Frame {
 		vk::Semaphore image_available_sem;
 		vk::Semaphore render_finished_sem;
 		vk::Fence in_flight_fence;
 
-		vk::CommandPool command_pool;
-		vk::CommandBuffer command_buffer;
-
 		Borrowed<Device> parent_device{};
 
 		void init(Borrowed<Device>&& _device, u32 _frame_index) {
 			parent_device = _device;
-			vk::Result result;
 
-			tie(result, image_available_sem) = _device->device.createSemaphore({});
-			ERROR_IF(failed(result), std::fmt("Image available semaphore creation failed with %s", to_cstr(result))) THEN_CRASH(result);
+			auto sem = _device->semaphore_pool.acquire();
+			ERROR_IF(!sem, std::fmt("Image available semaphore creation failed\n|> %s", sem.error().what())) THEN_CRASH(sem.error().code());
+			image_available_sem = sem.value();
 			_device->set_object_name(image_available_sem, std::fmt("Frame %d Image Available Sem", _frame_index));
 
-			tie(result, render_finished_sem) = _device->device.createSemaphore({});
-			ERROR_IF(failed(result), std::fmt("Render finished semaphore creation failed with %s", to_cstr(result))) THEN_CRASH(result);
+			sem = _device->semaphore_pool.acquire();
+			ERROR_IF(!sem, std::fmt("Render finished semaphore creation failed\n|> %s", sem.error().what())) THEN_CRASH(sem.error().code());
+			render_finished_sem = sem.value();
 			_device->set_object_name(render_finished_sem, std::fmt("Frame %d Render Finished Sem", _frame_index));
 
-			tie(result, in_flight_fence) = _device->device.createFence({ .flags = vk::FenceCreateFlagBits::eSignaled });
-			ERROR_IF(failed(result), std::fmt("In flight fence creation failed with %s", to_cstr(result))) THEN_CRASH(result);
-			_device->set_object_name(render_finished_sem, std::fmt("Frame %d In Flight Fence", _frame_index));
-
-			tie(result, command_pool) = _device->device.createCommandPool({
-				.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
-				.queueFamilyIndex = _device->physical_device.queue_families.graphics_idx,
-			});
-			ERROR_IF(failed(result), std::fmt("Command pool creation failed with %s", to_cstr(result))) THEN_CRASH(result);
-			_device->set_object_name(command_pool, std::fmt("Frame %d Command Pool", _frame_index));
-
-			vk::CommandBufferAllocateInfo cmd_buf_alloc_info = {
-				.commandPool = command_pool,
-				.level = vk::CommandBufferLevel::ePrimary,
-				.commandBufferCount = 1,
-			};
-			result = _device->device.allocateCommandBuffers(&cmd_buf_alloc_info, &command_buffer);
-			ERROR_IF(failed(result), std::fmt("Cmd Buffer allocation failed with %s", to_cstr(result))) THEN_CRASH(result) ELSE_VERBOSE("Cmd Allocated Buffer");
-			_device->set_object_name(command_buffer, std::fmt("Frame %d Command Buffer", _frame_index));
+			auto fence = _device->fence_pool.acquire(true);
+			ERROR_IF(!fence, std::fmt("In flight fence creation failed\n|> %s", fence.error().what())) THEN_CRASH(fence.error().code());
+			in_flight_fence = fence.value();
+			_device->set_object_name(in_flight_fence, std::fmt("Frame %d In Flight Fence", _frame_index));
 		}
 
 		void destroy() {
-			parent_device->device.destroySemaphore(image_available_sem);
-			parent_device->device.destroySemaphore(render_finished_sem);
-			parent_device->device.destroyFence(in_flight_fence);
-			parent_device->device.destroyCommandPool(command_pool);
+			parent_device->semaphore_pool.release(image_available_sem);
+			parent_device->semaphore_pool.release(render_finished_sem);
+			parent_device->fence_pool.release(in_flight_fence);
 		}
 	};
 
@@ -280,6 +249,13 @@ i32 aster_main() {
 		in_flight_frames.push_back(&frame);
 	}
 
+	// The frame sync objects outlive recreation; an out of date acquire signals nothing and a present still waits.
+	const auto recreate_swapchain = [&] {
+		swapchain->recreate();
+		recreate_framebuffers();
+		Gui::Recreate();
+	};
+
 	SunData sun = {
 		.direction = normalize(vec3(0.0f, 0.0f, 1.0f)),
 		.intensities = vec3(12.8f),
@@ -303,55 +279,48 @@ i32 aster_main() {
 
 	Owned<TransmittanceContext> transmittance = new TransmittanceContext{ pipeline_factory.borrow(), atmosphere_info };
 
-	Owned<SkyViewContext> sky_view = new SkyViewContext{ pipeline_factory.borrow(), transmittance.borrow() };
+	Owned<SkyViewContext> sky_view = new SkyViewContext{ pipeline_factory.borrow(), transmittance.borrow(), atmosphere_info };
 
 #pragma endregion
 
-	// ======== Buffer Setup ==================================================================================================================
-	std::vector<Buffer> uniform_buffers;
-	uniform_buffers.reserve(swapchain->image_count);
-	std::vector<BufferWriter> uniform_buffer_writers;
-	uniform_buffer_writers.reserve(swapchain->image_count);
-	const auto ubo_alignment = device->physical_device.properties.limits.minUniformBufferOffsetAlignment;
-	for (u32 i = 0; i < swapchain->image_count; ++i) {
-		if (auto res = Buffer::create(std::fmt("Camera Ubo %i", i), device.borrow(), closest_multiple(sizeof(Camera), ubo_alignment) + closest_multiple(sizeof(SunData), ubo_alignment) + closest_multiple(sizeof(AtmosphereInfo), ubo_alignment), vk::BufferUsageFlagBits::eUniformBuffer, vma::MemoryUsage::eCpuToGpu)) {
-			uniform_buffers.emplace_back(std::move(res.value()));
-		} else {
-			ERROR(std::fmt("Camera uniform buffer creation failed \n|> %s", res.error().what())) THEN_CRASH(res.error().code());
-		}
+	if (auto res = main_pipeline.get()) {
+		pipeline = res.value();
+		INFO(std::fmt("Pipeline %s Created", pipeline->name.c_str()));
+	} else {
+		ERROR(std::fmt("Pipeline creation failed with %s" CODE_LOC "\n|> %s", to_cstr(res.error().code()), res.error().what())) THEN_CRASH(res.error().code());
+	}
 
-		auto& ubo_ = uniform_buffers.back();
-		uniform_buffer_writers.emplace_back(BufferWriter{ borrow(ubo_) });
-		{
-			uniform_buffer_writers.back() << camera << sun << atmosphere_info;
-		}
+	ResourcePool resource_pool;
+	if (auto res = ResourcePool::create(device.borrow(), pipeline->layout, 1)) {
+		resource_pool = std::move(res.value());
+		INFO(std::fmt("Resource Binders for pipeline %s successfully created", pipeline->name.c_str()));
+	} else {
+		ERROR(std::fmt("Resource Binders creation failed with %s" CODE_LOC "\n|> %s", to_cstr(res.error().code()), res.error().what())) THEN_CRASH(res.error().code());
+	}
 
-		resource_sets[i].set_buffer("camera", {
-				.buffer = ubo_.buffer,
-				.offset = 0,
-				.range = sizeof(Camera),
-			});
-		resource_sets[i].set_buffer("sun", {
-				.buffer = ubo_.buffer,
-				.offset = closest_multiple(sizeof(Camera), ubo_alignment),
-				.range = sizeof(SunData),
-			});
-		resource_sets[i].set_buffer("atmos", {
-				.buffer = ubo_.buffer,
-				.offset = closest_multiple(sizeof(Camera), ubo_alignment) + closest_multiple(sizeof(SunData), ubo_alignment),
-				.range = sizeof(AtmosphereInfo),
-			});
-		resource_sets[i].set_texture("transmittance_lut", {
-			.sampler = transmittance->lut_sampler.sampler,
-			.imageView = transmittance->lut_view.image_view,
-			.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-			});
-		resource_sets[i].set_texture("skyview_lut", {
-			.imageView = sky_view->lut_view.image_view,
-			.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-			});
-		resource_sets[i].update();
+	ResourceSet resource_set;
+	if (auto res = resource_pool.allocate_resource_set()) {
+		resource_set = std::move(res.value());
 	}
+	else {
+		ERROR(std::fmt("Resource set alloc failed " CODE_LOC " |> %s", res.error().what())) THEN_CRASH(res.error().code());
+	}
+
+	// ======== Resource Setup ==================================================================================================================
+	// Written once; per-frame constants come from the device uniform ring through dynamic offsets.
+	resource_set.set_buffer("camera", device->uniforms.descriptor_info(sizeof(Camera)));
+	resource_set.set_buffer("sun", device->uniforms.descriptor_info(sizeof(SunData)));
+	resource_set.set_buffer("atmos", device->uniforms.descriptor_info(sizeof(AtmosphereInfo)));
+	resource_set.set_texture("transmittance_lut", {
+		.sampler = transmittance->lut_sampler.sampler,
+		.imageView = transmittance->lut_view.image_view,
+		.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+		});
+	resource_set.set_texture("skyview_lut", {
+		.imageView = sky_view->lut_view.image_view,
+		.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+		});
+	resource_set.update();
 
 	AtmosphereInfo atmosphere_ui_view = {
 		.scatter_coeff_rayleigh = atmosphere_info.scatter_coeff_rayleigh * 1.0e+6f,
@@ -368,6 +337,8 @@ i32 aster_main() {
 	};
 
 	u32 frame_idx = 0;
+	// The async sky view pass may only overwrite its LUT once graphics is done sampling it.
+	u64 graphics_value = 0;
 
 	f32 time_of_day = 6.0f;
 	b8 dynamic_time_of_day = false;
@@ -385,6 +356,16 @@ i32 aster_main() {
 		{
 			OPTICK_EVENT("Frame wait");
 			result = device->device.waitForFences({ current_frame->in_flight_fence }, true, max_value<u64>);
+
+			auto res = device->begin_frame();
+			ERROR_IF(!res, std::fmt("Frame begin failed\n|> %s", res.error().what())) THEN_CRASH(res.error().code());
+		}
+
+		for (const auto* reloaded_ : pipeline_factory->apply_pipeline_swaps()) {
+			// The transmittance LUT is only computed on demand, the sky view is redone every frame anyway.
+			if (reloaded_ == transmittance->pipeline) {
+				transmittance->recalculate(atmosphere_info);
+			}
 		}
 
 		{
@@ -394,7 +375,7 @@ i32 aster_main() {
 
 			INFO_IF(result == vk::Result::eSuboptimalKHR, std::fmt("Swapchain %s suboptimal", swapchain->name.data()))
 			ELSE_IF_INFO(result == vk::Result::eErrorOutOfDateKHR, "Recreating Swapchain " + swapchain->name)
-				DO(swapchain->recreate()) DO(recreate_framebuffers()) DO(Gui::Recreate())
+				DO(recreate_swapchain())
 			ELSE_IF_ERROR(failed(result), std::fmt("Image acquire failed with %s", to_cstr(result))) THEN_CRASH(result)
 			ELSE_VERBOSE("Image Acquired");
 		}
@@ -444,13 +425,89 @@ i32 aster_main() {
 				if (Gui::InputFloat("Mei Scatter", &atmosphere_ui_view.scatter_coeff_mei, 0.01f, 0.1f, "%.4f e-6")) {
 					atmosphere_info.scatter_coeff_rayleigh = atmosphere_ui_view.scatter_coeff_rayleigh * 1.0e-6f;
 				}
-				Gui::InputInt("Depth Samples", &atmosphere_info.depth_samples, 10, 100);
-				Gui::InputInt("View Samples", &atmosphere_info.view_samples, 1, 10);
+				// Each count compiles its own pipeline variant, and the shaders divide by it.
+				constexpr i32 max_samples = 10000;
+				if (Gui::InputInt("Depth Samples", &atmosphere_info.depth_samples, 10, 100)) {
+					atmosphere_info.depth_samples = std::clamp(atmosphere_info.depth_samples, 1, max_samples);
+				}
+				if (Gui::InputInt("View Samples", &atmosphere_info.view_samples, 1, 10)) {
+					atmosphere_info.view_samples = std::clamp(atmosphere_info.view_samples, 1, max_samples);
+				}
 				if (Gui::Button("Recalculate Transmittance")) {
 					transmittance->recalculate(atmosphere_info);
 				}
 			}
 
+			if (Gui::CollapsingHeader("Device Stats")) {
+				const auto& fences = device->fence_pool.stats;
+				const auto& sems = device->semaphore_pool.stats;
+				Gui::Text("Fence pool: %llu hits, %llu misses, %llu live", fences.hits, fences.misses, cast<u64>(fences.live));
+				Gui::Text("Semaphore pool: %llu hits, %llu misses, %llu live", sems.hits, sems.misses, cast<u64>(sems.live));
+				const auto commands = device->commands.stats();
+				Gui::Text("Command buffers: %llu allocated, %llu created in %llu pools", commands.allocations, commands.buffers_created, commands.pools_created);
+				const auto& pipelines = pipeline_factory->pipeline_cache.stats;
+				Gui::Text("Pipelines (%s cache): %llu created in %.3f ms, %llu cache hits", pipelines.warm ? "warm" : "cold", pipelines.pipelines, pipelines.creation_ms, pipelines.cache_hits);
+				const auto& reflection = pipeline_factory->reflection_cache.stats;
+				Gui::Text("Shader reflection: %llu cached, %llu reflected", reflection.hits, reflection.misses);
+				const auto contention = pipeline_factory->contention_stats();
+				Gui::Text("Pipeline factory: %llu hits, %llu compiles, %llu deduplicated", contention.cache_hits, contention.compiles, contention.deduplicated);
+				Gui::Text("Pipeline factory waits: %llu shard, %llu factory", contention.shard_waits, contention.factory_waits);
+				const auto& uniforms = device->uniforms.stats;
+				const auto& uploads = device->uploads.stats;
+				Gui::Text("Uploads: %llu copies in %llu batches, %llu direct writes (%llu bytes)", uploads.copies, uploads.batches, uploads.direct_writes, uploads.direct_bytes);
+				Gui::Text("Uniform ring: %llu / %llu bytes (peak %llu), %llu overflows", cast<u64>(uniforms.frame_used), cast<u64>(uniforms.frame_capacity), cast<u64>(uniforms.peak_frame_used), uniforms.overflows);
+				Gui::Text("Descriptor pools: %u holding %llu sets (%.0f%% used), %llu overflows", resource_pool.pool_count(), resource_pool.stats.sets_allocated, resource_pool.utilization() * 100.0f, resource_pool.stats.overflows);
+				if (const auto& bindless = device->bindless; bindless.valid()) {
+					Gui::Text("Bindless heap: %u / %u sampled, %u / %u storage images, %u / %u samplers, %u / %u buffers", bindless.stats.live[0], bindless.stats.capacity[0], bindless.stats.live[1], bindless.stats.capacity[1], bindless.stats.live[2], bindless.stats.capacity[2], bindless.stats.live[3], bindless.stats.capacity[3]);
+				} else {
+					Gui::Text("Bindless heap: not supported");
+				}
+			}
+			if (Gui::CollapsingHeader("Pipeline Statistics")) {
+				if (!device->extensions.pipeline_executable_properties || !pipeline_factory->capture_statistics) {
+					Gui::Text("Statistics capture is not enabled");
+				}
+				for (const auto& pipeline_ : pipeline_factory->live_pipelines()) {
+					if (!Gui::TreeNode(pipeline_.name.c_str())) continue;
+					for (const auto& executable_ : pipeline_.executables) {
+						Gui::Text("%s (%s, subgroup %u)", executable_.name.c_str(), to_string(executable_.stages).c_str(), executable_.subgroup_size);
+						Gui::Columns(2, executable_.name.c_str());
+						for (const auto& statistic_ : executable_.statistics) {
+							Gui::Text("%s", statistic_.name.c_str());
+							Gui::NextColumn();
+							Gui::Text("%g", statistic_.value);
+							Gui::NextColumn();
+						}
+						Gui::Columns(1);
+					}
+					Gui::TreePop();
+				}
+				if (Gui::Button("Dump pipeline statistics")) {
+					auto res = pipeline_factory->dump_statistics_report();
+					ERROR_IF(!res, std::fmt("Pipeline statistics report failed\n|> %s", res.error().what()));
+				}
+			}
+			if (Gui::CollapsingHeader("Memory")) {
+				constexpr f32 mib = 1.0f / (1024.0f * 1024.0f);
+				for (usize i_ = 0; i_ < memory_category_count; ++i_) {
+					const auto category_ = cast<MemoryCategory>(i_);
+					const auto usage_ = device->memory.usage(category_);
+					Gui::Text("%-12s %8.2f MiB in %llu (peak %.2f MiB)", to_cstr(category_), cast<f32>(usage_.bytes) * mib, usage_.allocations, cast<f32>(usage_.peak_bytes) * mib);
+				}
+				Gui::Separator();
+				Gui::Text(device->memory.has_budget_extension ? "Heap budgets (VK_EXT_memory_budget)" : "Heap budgets (estimated)");
+				const auto heaps = device->memory.heap_usage();
+				for (usize i_ = 0; i_ < heaps.size(); ++i_) {
+					const auto& heap_ = heaps[i_];
+					const auto fraction = heap_.budget ? cast<f32>(heap_.usage) / cast<f32>(heap_.budget) : 0.0f;
+					Gui::ProgressBar(fraction, { -1.0f, 0.0f }, std::fmt("Heap %llu%s: %.1f / %.1f MiB", cast<u64>(i_), (heap_.flags & vk::MemoryHeapFlagBits::eDeviceLocal) ? " (local)" : "", cast<f32>(heap_.usage) * mib, cast<f32>(heap_.budget) * mib).c_str());
+				}
+				if (Gui::Button("Dump memory report")) {
+					auto res = device->dump_memory_report();
+					ERROR_IF(!res, std::fmt("Memory report failed\n|> %s", res.error().what()));
+				}
+			}
+
 			Gui::End();
 
 			Gui::EndBuild();
@@ -471,24 +528,36 @@ i32 aster_main() {
 			OPTICK_EVENT("Ubo Update");
 			camera_controller.update();
 			camera.update();
+		}
 
-			uniform_buffer_writers[frame_idx] << camera << sun << atmosphere_info;
+		std::array<u32, 3> uniform_offsets;
+		{
+			OPTICK_EVENT("Ubo Push");
+			auto camera_res = device->uniforms.push(camera);
+			ERROR_IF(!camera_res, std::fmt("Camera ubo push failed\n|> %s", camera_res.error().what())) THEN_CRASH(camera_res.error().code());
+			auto sun_res = device->uniforms.push(sun);
+			ERROR_IF(!sun_res, std::fmt("Sun ubo push failed\n|> %s", sun_res.error().what())) THEN_CRASH(sun_res.error().code());
+			auto atmos_res = device->uniforms.push(atmosphere_info);
+			ERROR_IF(!atmos_res, std::fmt("Atmosphere ubo push failed\n|> %s", atmos_res.error().what())) THEN_CRASH(atmos_res.error().code());
+			uniform_offsets = { camera_res->offset, sun_res->offset, atmos_res->offset };
 		}
 
 		sky_view->update(camera, sun, atmosphere_info);
 
 		// ======== Record Commands ==================================================================================================================
 
+		vk::CommandBuffer cmd;
 		{
-			OPTICK_EVENT("Reset Command Pool");
-			device->device.resetCommandPool(current_frame->command_pool, {});
+			OPTICK_EVENT("Allocate Command Buffer");
+			auto res = device->alloc_temp_command_buffer(device->queues.graphics);
+			ERROR_IF(!res, std::fmt("Cmd Buffer allocation failed\n|> %s", res.error().what())) THEN_CRASH(res.error().code());
+			cmd = res.value();
 		}
-		auto& cmd = current_frame->command_buffer;
 
 		result = cmd.begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit, });
 		ERROR_IF(failed(result), std::fmt("Cmd Buffer begin failed with %s", to_cstr(result))) THEN_CRASH(result) ELSE_VERBOSE("Start Cmd Buffer");
 
-		sky_view->recalculate(cmd);
+		const auto sky_view_waits = sky_view->compute(cmd, graphics_value);
 
 		vk::ClearValue clear_val(std::array{ 0.0f, 0.0f, 0.0f, 1.0f });
 
@@ -524,7 +593,7 @@ i32 aster_main() {
 			} });
 
 		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline->pipeline);
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline->layout->layout, 0, resource_sets[frame_idx].sets, {});
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline->layout->layout, 0, resource_set.sets, uniform_offsets);
 		cmd.draw(4, 1, 0, 0);
 
 		cmd.endRenderPass();
@@ -543,18 +612,10 @@ i32 aster_main() {
 
 		{
 			OPTICK_EVENT("Submit");
-			vk::SubmitInfo submit_info = {
-				.waitSemaphoreCount = 1,
-				.pWaitSemaphores = &current_frame->image_available_sem,
-				.pWaitDstStageMask = &wait_stage,
-				.commandBufferCount = 1,
-				.pCommandBuffers = &cmd,
-				.signalSemaphoreCount = 1,
-				.pSignalSemaphores = &current_frame->render_finished_sem,
-			};
-			result = device->queues.graphics.submit({ submit_info }, current_frame->in_flight_fence);
-
-			ERROR_IF(failed(result), std::fmt("Submission failed with %s", to_cstr(result))) THEN_CRASH(result) ELSE_VERBOSE("Submit");
+			auto res = device->submit(device->queues.graphics, { cmd }, { current_frame->image_available_sem }, wait_stage, { current_frame->render_finished_sem }, current_frame->in_flight_fence, sky_view_waits);
+
+			ERROR_IF(!res, std::fmt("Submission failed\n|> %s", res.error().what())) THEN_CRASH(res.error().code()) ELSE_VERBOSE("Submit");
+			graphics_value = res.value();
 		}
 
 		{
@@ -567,7 +628,7 @@ i32 aster_main() {
 				.pImageIndices = &image_idx,
 			});
 			INFO_IF(result == vk::Result::eSuboptimalKHR, std::fmt("Swapchain %s suboptimal", swapchain->name.data()))
-			ELSE_IF_INFO(result == vk::Result::eErrorOutOfDateKHR, "Recreating Swapchain " + swapchain->name) DO(swapchain->recreate()) DO(recreate_framebuffers()) DO(Gui::Recreate())
+			ELSE_IF_INFO(result == vk::Result::eErrorOutOfDateKHR, "Recreating Swapchain " + swapchain->name) DO(recreate_swapchain())
 			ELSE_IF_ERROR(failed(result), std::fmt("Present failed with %s", to_cstr(result))) THEN_CRASH(result)
 			ELSE_VERBOSE("Present");
 		}
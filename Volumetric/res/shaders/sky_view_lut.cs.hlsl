@@ -1,17 +1,14 @@
 /*==============================================*/
-/*  Aster: res/shaders/sky_view_lut.fs.hlsl		*/
+/*  Aster: res/shaders/sky_view_lut.cs.hlsl		*/
 /*  Copyright (c) 2020 Anish Bhobe				*/
 /*==============================================*/
 
 #include "sky_view_lut.hlsli"
 
-struct FSIn {
-	float2 uv : UV;
-};
+[[vk::binding(4, 0)]] [[vk::image_format("rgba16f")]] RWTexture2D<float4> sky_view_lut;
 
-struct FSOut {
-	float4 color : SV_TARGET0;
-};
+// Specialized per pipeline so the scattering loops have a constant trip count.
+[[vk::constant_id(0)]] const int view_samples = 3000;
 
 // Transmittance
 float3 T(float3 x, float3 y) {
@@ -50,7 +47,7 @@ float3 L(float3 c, float3 v) {
 	float alen = distance_to_atmosphere(c, v);
 	float glen = distance_to_ground(c, v);
 	float len = min(alen, glen);
-	int lim = atmosphere.view_samples;
+	int lim = view_samples;
 	float dt = len / float(lim);
 
 	bool ground = !isinf(glen);
@@ -81,12 +78,14 @@ float3 get_skyview(float2 longlat) {
 	return L(x, dir);
 }
 
-FSOut main(FSIn input) {
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID) {
+	uint2 size;
+	sky_view_lut.GetDimensions(size.x, size.y);
+	if (any(id.xy >= size)) return;
 
-	FSOut output;
+	const float2 uv = (id.xy + 0.5f) / float2(size);
+	const float2 longlat = get_skyview_longlat_from_uv(uv);
 
-	const float2 longlat = get_skyview_longlat_from_uv(input.uv);
-	output.color = float4(get_skyview(longlat), 1.0f);
-
-	return output;
+	sky_view_lut[id.xy] = float4(get_skyview(longlat), 1.0f);
 }
\ No newline at end of file
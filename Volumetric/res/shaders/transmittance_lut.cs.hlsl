@@ -1,5 +1,5 @@
 /*=================================================*/
-/*  Aster: res/shaders/transmittance_lut.vs.hlsl   */
+/*  Aster: res/shaders/transmittance_lut.cs.hlsl   */
 /*  Copyright (c) 2020 Anish Bhobe                 */
 /*=================================================*/
 
@@ -7,13 +7,18 @@
 [[vk::push_constant]] AtmosphereParams atmosphere;
 #include "functions.hlsli"
 
+[[vk::binding(0, 0)]] [[vk::image_format("rgba32f")]] RWTexture2D<float4> transmittance_lut;
+
+// Specialized per pipeline so the integration loops have a constant trip count.
+[[vk::constant_id(0)]] const int depth_samples = 3000;
+
 float optical_length_rayleigh(float2 rmu, float len) {
 	float r = rmu.x;
 	float mu = rmu.y;
-	int lim = atmosphere.depth_samples;
+	int lim = depth_samples;
 	float dx = len / float(lim);
 	float odepth = 0.0f;
-	for (int i = 0; i <= atmosphere.depth_samples; ++i) {
+	for (int i = 0; i <= depth_samples; ++i) {
 		float d_i = dx * i;
 		float r_i = sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r);
 		odepth += density_rayleigh(r_i) * dx * (i == 0 || i == lim ? 0.5f : 1.0f);
@@ -24,10 +29,10 @@ float optical_length_rayleigh(float2 rmu, float len) {
 float optical_length_mei(float2 rmu, float len) {
 	float r = rmu.x;
 	float mu = rmu.y;
-	int lim = atmosphere.depth_samples;
+	int lim = depth_samples;
 	float dx = len / float(lim);
 	float odepth = 0.0f;
-	for (int i = 0; i <= atmosphere.depth_samples; ++i) {
+	for (int i = 0; i <= depth_samples; ++i) {
 		float d_i = dx * i;
 		float r_i = sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r);
 		odepth += density_mei(r_i) * dx * (i == 0 || i == lim ? 0.5f : 1.0f);
@@ -38,10 +43,10 @@ float optical_length_mei(float2 rmu, float len) {
 float optical_length_ozone(float2 rmu, float len) {
 	float r = rmu.x;
 	float mu = rmu.y;
-	int lim = atmosphere.depth_samples;
+	int lim = depth_samples;
 	float dx = len / float(lim);
 	float odepth = 0.0f;
-	for (int i = 0; i <= atmosphere.depth_samples; ++i) {
+	for (int i = 0; i <= depth_samples; ++i) {
 		float d_i = dx * i;
 		float r_i = sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r);
 		odepth += density_ozone(r_i) * dx * (i == 0 || i == lim ? 0.5f : 1.0f);
@@ -59,19 +64,15 @@ float3 calculate_transmittance(float2 rmu) {
 	return exp(-exp_term);
 }
 
-struct FSIn {
-	float2 uv : UV;
-};
-
-struct FSOut {
-	float4 color : SV_TARGET0;
-};
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID) {
+	uint2 size;
+	transmittance_lut.GetDimensions(size.x, size.y);
+	if (any(id.xy >= size)) return;
 
-FSOut main(FSIn input) {
-	float2 rmu = get_transmittance_rmu_from_uv(input.uv);
-	
-	FSOut output;
-	output.color = float4(calculate_transmittance(rmu), 1.0f);
+	// Texel centers, matching what the old full-screen pass interpolated.
+	float2 uv = (id.xy + 0.5f) / float2(size);
+	float2 rmu = get_transmittance_rmu_from_uv(uv);
 
-	return output;
+	transmittance_lut[id.xy] = float4(calculate_transmittance(rmu), 1.0f);
 }
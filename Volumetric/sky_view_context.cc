@@ -7,19 +7,15 @@
 
 #include "optick/optick.h"
 
-SkyViewContext::SkyViewContext(const Borrowed<PipelineFactory>& _pipeline_factory, const Borrowed<TransmittanceContext>& _transmittance)
+SkyViewContext::SkyViewContext(const Borrowed<PipelineFactory>& _pipeline_factory, const Borrowed<TransmittanceContext>& _transmittance, const AtmosphereInfo& _atmos)
 	: parent_factory{ _pipeline_factory } {
 
 	const auto& device = _pipeline_factory->parent_device;
-	const auto ubo_alignment = device->physical_device.properties.limits.minUniformBufferOffsetAlignment;
-
-	ubo = Buffer::create("Sky View uniform buffer", device, closest_multiple(sizeof(Camera), ubo_alignment) + closest_multiple(sizeof(SunData), ubo_alignment) + closest_multiple(sizeof(AtmosphereInfo), ubo_alignment), vk::BufferUsageFlagBits::eUniformBuffer, vma::MemoryUsage::eCpuToGpu).value();
-
-	ubo_writer = BufferWriter{ borrow(ubo) };
 
 	transmittance = _transmittance;
+	queue = device->physical_device.queue_families.has_async_compute() ? device->queues.compute.value() : device->queues.graphics;
 
-	lut = Image::create("Sky View LUT", device, vk::ImageType::e2D, vk::Format::eR16G16B16A16Sfloat, sky_view_lut_extent, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled).value();
+	lut = Image::create("Sky View LUT", device, vk::ImageType::e2D, vk::Format::eR16G16B16A16Sfloat, sky_view_lut_extent, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled, 1, vma::MemoryUsage::eGpuOnly, 1, MemoryCategory::eLut).value();
 
 	lut_view = ImageView::create(borrow(lut), vk::ImageViewType::e2D, {
 		.aspectMask = vk::ImageAspectFlagBits::eColor,
@@ -27,155 +23,155 @@ SkyViewContext::SkyViewContext(const Borrowed<PipelineFactory>& _pipeline_factor
 		.layerCount = 1,
 		}).value();
 
-	vk::AttachmentDescription attach_desc = {
-		.format = lut.format,
-		.loadOp = vk::AttachmentLoadOp::eClear,
-		.storeOp = vk::AttachmentStoreOp::eStore,
-		.stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
-		.stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
-		.initialLayout = vk::ImageLayout::eUndefined,
-		.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-	};
-
-	vk::AttachmentReference attach_ref = {
-		.attachment = 0,
-		.layout = vk::ImageLayout::eColorAttachmentOptimal,
-	};
-
-	vk::SubpassDescription subpass = {
-		.pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
-		.colorAttachmentCount = 1,
-		.pColorAttachments = &attach_ref,
-	};
-
-	vk::SubpassDependency dependency = {
-		.srcSubpass = VK_SUBPASS_EXTERNAL,
-		.dstSubpass = 0,
-		.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
-		.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
-		.srcAccessMask = {},
-		.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
-	};
-
-	// Renderpass
-	renderpass = RenderPass::create("Sky View LUT pass", _pipeline_factory->parent_device, {
-		.attachmentCount = 1,
-		.pAttachments = &attach_desc,
-		.subpassCount = 1,
-		.pSubpasses = &subpass,
-		.dependencyCount = 1,
-		.pDependencies = &dependency,
-		}).value();
-
-	pipeline = parent_factory->create_pipeline({
-		.renderpass = borrow(renderpass),
-		.viewport_state = {
-			.enable_dynamic = false,
-			.viewports = {
-				{
-					.x = 0.0f,
-					.y = 0.0f,
-					.width = cast<f32>(lut.extent.width),
-					.height = cast<f32>(lut.extent.height),
-					.minDepth = 0.0f,
-					.maxDepth = 1.0f,
-				}
-			},
-			.scissors = {
-				{
-					.offset = { 0, 0 },
-					.extent = { lut.extent.width, lut.extent.height },
-				}
-			}
-		},
-		.raster_state = {
-			.front_face = vk::FrontFace::eCounterClockwise,
-		},
-		.shader_files = { R"(res/shaders/sky_view_lut.vs.spv)", R"(res/shaders/sky_view_lut.fs.spv)" },
-		.name = "Sky View LUT Pipeline",
-		}).value();
-
-	framebuffer = Framebuffer::create("Sky view LUT framebuffer", borrow(renderpass), { borrow(lut_view) }, 1).value();
-
-	std::vector<vk::DescriptorPoolSize> pool_sizes = {
-		{
-			.type = vk::DescriptorType::eUniformBuffer,
-			.descriptorCount = 3,
-		},
-		{
-			.type = vk::DescriptorType::eCombinedImageSampler,
-			.descriptorCount = 1,
-		}
-	};
+	specialize(_atmos.view_samples);
 
 	resource_pool = ResourcePool::create(device, pipeline->layout, 1).value();
 	resource_set = resource_pool.allocate_resource_set().value();
 
 	{
-		usize offset = 0;
-		const auto cam_offset = offset;
-		offset += closest_multiple(sizeof(Camera), ubo_alignment);
-		const auto sun_offset = offset;
-		offset += closest_multiple(sizeof(SunData), ubo_alignment);
-		const auto atmos_offset = offset;
-
-		resource_set.set_buffer("camera", {
-				.buffer = ubo.buffer,
-				.offset = cam_offset,
-				.range = sizeof(Camera),
-		});
-		resource_set.set_buffer("sun",{
-				.buffer = ubo.buffer,
-				.offset = sun_offset,
-				.range = sizeof(SunData),
-		});
-		resource_set.set_buffer("atmos", {
-				.buffer = ubo.buffer,
-				.offset = atmos_offset,
-				.range = sizeof(AtmosphereInfo),
-		});
+		resource_set.set_buffer("camera", device->uniforms.descriptor_info(sizeof(Camera)));
+		resource_set.set_buffer("sun", device->uniforms.descriptor_info(sizeof(SunData)));
+		resource_set.set_buffer("atmos", device->uniforms.descriptor_info(sizeof(AtmosphereInfo)));
 		resource_set.set_texture("transmittance_lut", {
 			.sampler = transmittance->lut_sampler.sampler,
 			.imageView = transmittance->lut_view.image_view,
 			.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
 		});
+		resource_set.set_texture("sky_view_lut", {
+			.imageView = lut_view.image_view,
+			.imageLayout = vk::ImageLayout::eGeneral,
+		});
 		resource_set.update();
 	}
 }
 
 void SkyViewContext::update(const Camera& _camera, const SunData& _sun_data, const AtmosphereInfo& _atmos) {
-	ubo_writer << _camera << _sun_data << _atmos;
+	if (_atmos.view_samples != view_samples) {
+		specialize(_atmos.view_samples);
+	}
+
+	auto& uniforms = parent_factory->parent_device->uniforms;
+
+	auto camera = uniforms.push(_camera);
+	ERROR_IF(!camera, std::fmt("Sky view camera push failed\n|> %s", camera.error().what())) THEN_CRASH(camera.error().code());
+	auto sun = uniforms.push(_sun_data);
+	ERROR_IF(!sun, std::fmt("Sky view sun push failed\n|> %s", sun.error().what())) THEN_CRASH(sun.error().code());
+	auto atmos = uniforms.push(_atmos);
+	ERROR_IF(!atmos, std::fmt("Sky view atmosphere push failed\n|> %s", atmos.error().what())) THEN_CRASH(atmos.error().code());
+
+	uniform_offsets = { camera->offset, sun->offset, atmos->offset };
+}
+
+std::vector<TimelineWait> SkyViewContext::compute(const vk::CommandBuffer _graphics_cmd, const u64 _last_graphics_value) {
+	auto& device = parent_factory->parent_device;
+	if (queue == device->queues.graphics) {
+		recalculate(_graphics_cmd);
+		acquire(_graphics_cmd);
+		return {};
+	}
+
+	auto cmd = device->alloc_temp_command_buffer(queue);
+	ERROR_IF(!cmd, std::fmt("Sky view command buffer allocation failed\n|> %s", cmd.error().what())) THEN_CRASH(cmd.error().code());
+
+	auto result = cmd->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit, });
+	ERROR_IF(failed(result), std::fmt("Sky view command buffer begin failed with %s", to_cstr(result))) THEN_CRASH(result);
+
+	recalculate(cmd.value());
+
+	result = cmd->end();
+	ERROR_IF(failed(result), std::fmt("Sky view command buffer end failed with %s", to_cstr(result))) THEN_CRASH(result);
+
+	auto value = device->submit(queue, { cmd.value() }, {}, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {
+		{
+			.queue = device->queues.graphics,
+			.value = _last_graphics_value,
+			.stage = vk::PipelineStageFlagBits::eComputeShader,
+		} });
+	ERROR_IF(!value, std::fmt("Sky view submit failed\n|> %s", value.error().what())) THEN_CRASH(value.error().code());
+
+	acquire(_graphics_cmd);
+	return {
+		{
+			.queue = queue,
+			.value = value.value(),
+			.stage = vk::PipelineStageFlagBits::eFragmentShader,
+		} };
 }
 
 void SkyViewContext::recalculate(vk::CommandBuffer _cmd) {
 
 	OPTICK_EVENT("Recalculate Skyview");
+	const b8 is_async = queue != parent_factory->parent_device->queues.graphics;
 	_cmd.beginDebugUtilsLabelEXT({
 		.pLabelName = "Sky View LUT Calculation",
 		.color = std::array{ 0.1f, 0.0f, 0.5f, 1.0f },
 	});
 
-	vk::ClearValue clear_val(std::array{ 0.0f, 1.0f, 0.0f, 1.0f });
-	_cmd.beginRenderPass({
-		.renderPass = renderpass.renderpass,
-		.framebuffer = framebuffer.framebuffer,
-		.renderArea = {
-			.offset = { 0, 0 },
-			.extent = framebuffer.extent,
-		},
-		.clearValueCount = 1,
-		.pClearValues = &clear_val,
-	}, vk::SubpassContents::eInline);
+	const vk::ImageSubresourceRange lut_range = {
+		.aspectMask = vk::ImageAspectFlagBits::eColor,
+		.levelCount = 1,
+		.layerCount = 1,
+	};
+
+	// The previous frame's sky pass may still be sampling the LUT. On async compute the timeline wait covers that
+	// and only the compute stage can be named. The contents are discarded, so ownership is not transferred back.
+	vk::ImageMemoryBarrier to_storage = {
+		.srcAccessMask = vk::AccessFlagBits::eShaderRead,
+		.dstAccessMask = vk::AccessFlagBits::eShaderWrite,
+		.oldLayout = vk::ImageLayout::eUndefined,
+		.newLayout = vk::ImageLayout::eGeneral,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = lut.image,
+		.subresourceRange = lut_range,
+	};
+	_cmd.pipelineBarrier(is_async ? vk::PipelineStageFlagBits::eComputeShader : vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {}, { to_storage });
 
-	_cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline->pipeline);
-	_cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline->layout->layout, 0, resource_set.sets, {});
-	_cmd.draw(4, 1, 0, 0);
+	_cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline->pipeline);
+	_cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline->layout->layout, 0, resource_set.sets, uniform_offsets);
+	pipeline->dispatch(_cmd, lut.extent);
 
-	_cmd.endRenderPass();
+	lut_transfer().release(_cmd, lut.image, lut_range, vk::ImageLayout::eGeneral, vk::ImageLayout::eShaderReadOnlyOptimal);
 
 	_cmd.endDebugUtilsLabelEXT();
 }
 
+void SkyViewContext::acquire(vk::CommandBuffer _graphics_cmd) {
+	// Without a family change this is the plain barrier to the sampled layout.
+	lut_transfer().acquire(_graphics_cmd, lut.image, {
+		.aspectMask = vk::ImageAspectFlagBits::eColor,
+		.levelCount = 1,
+		.layerCount = 1,
+	}, vk::ImageLayout::eGeneral, vk::ImageLayout::eShaderReadOnlyOptimal);
+}
+
+QueueOwnershipTransfer SkyViewContext::lut_transfer() {
+	auto& device = parent_factory->parent_device;
+	auto transfer = device->ownership_transfer(queue, device->queues.graphics);
+	transfer.src_stage = vk::PipelineStageFlagBits::eComputeShader;
+	transfer.src_access = vk::AccessFlagBits::eShaderWrite;
+	transfer.dst_stage = vk::PipelineStageFlagBits::eFragmentShader;
+	transfer.dst_access = vk::AccessFlagBits::eShaderRead;
+	return transfer;
+}
+
+void SkyViewContext::specialize(const i32 _view_samples) {
+	auto* specialized = parent_factory->create_compute_pipeline({
+		.shader_file = R"(res/shaders/sky_view_lut.cs.spv)",
+		.dynamic_buffers = { "camera", "sun", "atmos" },
+		.specialization = { { .name = "view_samples", .value = _view_samples } },
+		.name = std::fmt("Sky View LUT Pipeline (%d samples)", _view_samples),
+	}).value();
+
+	if (pipeline) {
+		// Recorded every frame, so earlier frames may still be using the old variant.
+		WARN_IF(failed(parent_factory->parent_device->device.waitIdle()), "Device wait idle failed");
+		pipeline->destroy();
+	}
+	pipeline = specialized;
+	view_samples = _view_samples;
+}
+
 SkyViewContext::~SkyViewContext() {
 	pipeline->destroy();
 }
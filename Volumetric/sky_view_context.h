@@ -12,17 +12,16 @@
 #include <core/image_view.h>
 #include <core/camera.h>
 #include <core/resource_pool.h>
-#include <core/framebuffer.h>
 
 #include <sun_data.h>
 #include <transmittance_context.h>
 
-#include <util/buffer_writer.h>
+#include <array>
 
 struct SkyViewContext {
 	static constexpr vk::Extent3D sky_view_lut_extent = { 256, 128, 1 };
 
-	SkyViewContext(const Borrowed<PipelineFactory>& _pipeline_factory, const Borrowed<TransmittanceContext>& _transmittance);
+	SkyViewContext(const Borrowed<PipelineFactory>& _pipeline_factory, const Borrowed<TransmittanceContext>& _transmittance, const AtmosphereInfo& _atmos);
 
 	SkyViewContext(const SkyViewContext& _other) = delete;
 	SkyViewContext(SkyViewContext&& _other) = delete;
@@ -32,20 +31,38 @@ struct SkyViewContext {
 	~SkyViewContext();
 
 	void update(const Camera& _camera, const SunData& _sun_data, const AtmosphereInfo& _atmos);
+
+	/**
+	 * Compute the LUT for this frame and record its acquire into `_graphics_cmd`.
+	 * On async compute the pass is submitted to `queue` after graphics reaches `_last_graphics_value`,
+	 * since the previous frame may still sample the LUT. The returned waits go on the graphics submission.
+	 */
+	std::vector<TimelineWait> compute(vk::CommandBuffer _graphics_cmd, u64 _last_graphics_value);
+
+	// Record the pass into a command buffer of `queue`, releasing the LUT to graphics.
 	void recalculate(vk::CommandBuffer _cmd);
+	void acquire(vk::CommandBuffer _graphics_cmd);
+
+	[[nodiscard]]
+	QueueOwnershipTransfer lut_transfer();
+
+	// Swap to the pipeline variant for `_view_samples`, which the shader takes as a specialization constant.
+	void specialize(i32 _view_samples);
 
 	// Fields
 	Pipeline* pipeline{};
-	RenderPass renderpass;
-	Framebuffer framebuffer;
+	i32 view_samples{};
+
+	// Async compute when the device has it.
+	vk::Queue queue;
 
 	ResourcePool resource_pool;
 	ResourceSet resource_set;
 	
 	//vk::DescriptorPool descriptor_pool;
 	//vk::DescriptorSet descriptor_set;
-	Buffer ubo;
-	BufferWriter ubo_writer;
+	// Camera, sun and atmosphere offsets into the device uniform ring for this frame.
+	std::array<u32, 3> uniform_offsets{};
 
 	Image lut;
 	ImageView lut_view;
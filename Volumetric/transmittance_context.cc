@@ -12,8 +12,11 @@ TransmittanceContext::TransmittanceContext(const Borrowed<PipelineFactory>& _pip
 	: parent_factory{ _pipeline_factory } {
 
 	const auto& device = _pipeline_factory->parent_device;
+	const auto& queue_families = device->physical_device.queue_families;
 
-	lut = Image::create("Transmittance LUT", device, vk::ImageType::e2D, vk::Format::eR32G32B32A32Sfloat, transmittance_lut_extent, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled).value();
+	queue = queue_families.has_async_compute() ? device->queues.compute.value() : device->queues.graphics;
+
+	lut = Image::create("Transmittance LUT", device, vk::ImageType::e2D, vk::Format::eR32G32B32A32Sfloat, transmittance_lut_extent, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled, 1, vma::MemoryUsage::eGpuOnly, 1, MemoryCategory::eLut, queue_families.async_compute_families()).value();
 
 	lut_view = ImageView::create(borrow(lut), vk::ImageViewType::e2D, {
 		.aspectMask = vk::ImageAspectFlagBits::eColor,
@@ -28,76 +31,16 @@ TransmittanceContext::TransmittanceContext(const Borrowed<PipelineFactory>& _pip
 		.addressModeV = vk::SamplerAddressMode::eClampToEdge,
 	}).value();
 
-	vk::AttachmentDescription attach_desc = {
-		.format = lut.format,
-		.loadOp = vk::AttachmentLoadOp::eClear,
-		.storeOp = vk::AttachmentStoreOp::eStore,
-		.stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
-		.stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
-		.initialLayout = vk::ImageLayout::eUndefined,
-		.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-	};
-
-	vk::AttachmentReference attach_ref = {
-		.attachment = 0,
-		.layout = vk::ImageLayout::eColorAttachmentOptimal,
-	};
-
-	vk::SubpassDescription subpass = {
-		.pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
-		.colorAttachmentCount = 1,
-		.pColorAttachments = &attach_ref,
-	};
-
-	vk::SubpassDependency dependency = {
-		.srcSubpass = VK_SUBPASS_EXTERNAL,
-		.dstSubpass = 0,
-		.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
-		.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
-		.srcAccessMask = {},
-		.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
-	};
+	specialize(_atmos.depth_samples);
 
-	// Renderpass
-	renderpass = RenderPass::create("Transmittance LUT pass", device, {
-		.attachmentCount = 1,
-		.pAttachments = &attach_desc,
-		.subpassCount = 1,
-		.pSubpasses = &subpass,
-		.dependencyCount = 1,
-		.pDependencies = &dependency
-	}).value();
+	resource_pool = ResourcePool::create(device, pipeline->layout, 1).value();
+	resource_set = resource_pool.allocate_resource_set().value();
 
-	// Framebuffer
-	framebuffer = Framebuffer::create("Transmittance LUT Framebuffer", borrow(renderpass), { borrow(lut_view) }, lut.layer_count).value();
-
-	pipeline = parent_factory->create_pipeline({
-		.renderpass = borrow(renderpass),
-		.viewport_state = {
-			.enable_dynamic = false,
-			.viewports = {
-				{
-					.x = 0.0f,
-					.y = 0.0f,
-					.width = cast<f32>(lut.extent.width),
-					.height = cast<f32>(lut.extent.height),
-					.minDepth = 0.0f,
-					.maxDepth = 1.0f,
-				}
-			},
-			.scissors = {
-				{
-					.offset = { 0, 0 },
-					.extent = { lut.extent.width, lut.extent.height },
-				}
-			}
-		},
-		.raster_state = {
-			.front_face = vk::FrontFace::eCounterClockwise,
-		},
-		.shader_files = { R"(res/shaders/transmittance_lut.vs.spv)", R"(res/shaders/transmittance_lut.fs.spv)" },
-		.name = "LUT Pipeline",
-		}).value();
+	resource_set.set_texture("transmittance_lut", {
+		.imageView = lut_view.image_view,
+		.imageLayout = vk::ImageLayout::eGeneral,
+	});
+	resource_set.update();
 
 	recalculate(_atmos);
 }
@@ -105,9 +48,14 @@ TransmittanceContext::TransmittanceContext(const Borrowed<PipelineFactory>& _pip
 void TransmittanceContext::recalculate(const AtmosphereInfo& _atmos) {
 	OPTICK_EVENT("Recalculate Transmittance");
 
+	if (_atmos.depth_samples != depth_samples) {
+		specialize(_atmos.depth_samples);
+	}
+
 	rdoc::start_capture();
 	auto& device = parent_factory->parent_device;
-	auto cmd = device->alloc_temp_command_buffer(device->graphics_cmd_pool);
+	const b8 is_async = queue != device->queues.graphics;
+	auto cmd = device->alloc_temp_command_buffer(queue);
 	ERROR_IF(!cmd, std::fmt("Command buffer begin failed\n|> %s", cmd.error().what())) THEN_CRASH(cmd.error().code()) ELSE_INFO("Cmd Created");
 
 	auto result = cmd->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit, });
@@ -118,36 +66,84 @@ void TransmittanceContext::recalculate(const AtmosphereInfo& _atmos) {
 		.color = std::array{ 0.5f, 0.0f, 0.0f, 1.0f },
 	});
 
-	vk::ClearValue clear_val(std::array{ 0.0f, 1.0f, 0.0f, 1.0f });
-	cmd->beginRenderPass({
-		.renderPass = renderpass.renderpass,
-		.framebuffer = framebuffer.framebuffer,
-		.renderArea = {
-			.offset = { 0, 0 },
-			.extent = { lut.extent.width, lut.extent.height },
-		},
-		.clearValueCount = 1,
-		.pClearValues = &clear_val,
-	}, vk::SubpassContents::eInline);
-
-	cmd->bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline->pipeline);
-	cmd->pushConstants(pipeline->layout->layout, vk::ShaderStageFlagBits::eFragment, 0u, vk::ArrayProxy<const AtmosphereInfo>{ _atmos });
-	cmd->draw(4, 1, 0, 0);
+	const vk::ImageSubresourceRange lut_range = {
+		.aspectMask = vk::ImageAspectFlagBits::eColor,
+		.levelCount = 1,
+		.layerCount = 1,
+	};
 
-	cmd->endRenderPass();
+	// Compute queues can not name the fragment stage. Graphics reads are covered by the timeline wait on submit instead.
+	const vk::PipelineStageFlags read_stages = is_async ? vk::PipelineStageFlagBits::eComputeShader : vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+
+	// Previous contents are overwritten entirely, and may still be read by the last frame's sky pass.
+	vk::ImageMemoryBarrier to_storage = {
+		.srcAccessMask = vk::AccessFlagBits::eShaderRead,
+		.dstAccessMask = vk::AccessFlagBits::eShaderWrite,
+		.oldLayout = vk::ImageLayout::eUndefined,
+		.newLayout = vk::ImageLayout::eGeneral,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = lut.image,
+		.subresourceRange = lut_range,
+	};
+	cmd->pipelineBarrier(read_stages, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {}, { to_storage });
+
+	cmd->bindPipeline(vk::PipelineBindPoint::eCompute, pipeline->pipeline);
+	cmd->bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline->layout->layout, 0, resource_set.sets, {});
+	cmd->pushConstants(pipeline->layout->layout, vk::ShaderStageFlagBits::eCompute, 0u, vk::ArrayProxy<const AtmosphereInfo>{ _atmos });
+	pipeline->dispatch(cmd.value(), lut.extent);
+
+	vk::ImageMemoryBarrier to_sampled = {
+		.srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+		.dstAccessMask = vk::AccessFlagBits::eShaderRead,
+		.oldLayout = vk::ImageLayout::eGeneral,
+		.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = lut.image,
+		.subresourceRange = lut_range,
+	};
+	cmd->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, read_stages, {}, {}, {}, { to_sampled });
 
 	cmd->endDebugUtilsLabelEXT();
 
 	result = cmd->end();
 	ERROR_IF(failed(result), std::fmt("Command buffer end failed with %s", to_cstr(result))) THEN_CRASH(result) ELSE_INFO("Command buffer Created");
 
-	auto res = SubmitTask<void>::create(device, device->queues.graphics, device->graphics_cmd_pool, { cmd.value() })
-	.map(&SubmitTask<void>::wait_and_destroy);
-	ERROR_IF(!res, std::fmt("Submit failed\n|> %s", res.error().what())) THEN_CRASH(res.error().code()) ELSE_INFO("LUT Submitted Created");
+	// Frames still in flight on graphics may be sampling the LUT.
+	std::vector<TimelineWait> waits;
+	if (is_async) {
+		waits.push_back({
+			.queue = device->queues.graphics,
+			.value = device->timeline(device->queues.graphics).next_value - 1,
+			.stage = vk::PipelineStageFlagBits::eComputeShader,
+		});
+	}
+
+	auto value = device->submit(queue, { cmd.value() }, {}, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, waits);
+	ERROR_IF(!value, std::fmt("Submit failed\n|> %s", value.error().what())) THEN_CRASH(value.error().code()) ELSE_INFO("LUT Submitted Created");
+
+	auto res = device->wait(queue, value.value());
+	ERROR_IF(!res, std::fmt("LUT wait failed\n|> %s", res.error().what())) THEN_CRASH(res.error().code());
 
 	rdoc::end_capture();
 }
 
+void TransmittanceContext::specialize(const i32 _depth_samples) {
+	// Variants share the layout, so the resource set stays valid.
+	auto* specialized = parent_factory->create_compute_pipeline({
+		.shader_file = R"(res/shaders/transmittance_lut.cs.spv)",
+		.specialization = { { .name = "depth_samples", .value = _depth_samples } },
+		.name = std::fmt("Transmittance LUT Pipeline (%d samples)", _depth_samples),
+	}).value();
+
+	if (pipeline) {
+		pipeline->destroy();
+	}
+	pipeline = specialized;
+	depth_samples = _depth_samples;
+}
+
 TransmittanceContext::~TransmittanceContext() {
 	pipeline->destroy();
 }
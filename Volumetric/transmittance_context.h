@@ -11,10 +11,9 @@
 #include <core/image.h>
 #include <core/image_view.h>
 #include <core/sampler.h>
+#include <core/resource_pool.h>
 #include <atmosphere_info.h>
 
-#include <core/framebuffer.h>
-
 struct TransmittanceContext {
 	static constexpr vk::Extent3D transmittance_lut_extent = { 64, 256, 1 };
 
@@ -29,11 +28,19 @@ struct TransmittanceContext {
 
 	void recalculate(const AtmosphereInfo& _atmos);
 
+	// Swap to the pipeline variant for `_depth_samples`, which the shader takes as a specialization constant.
+	void specialize(i32 _depth_samples);
+
 	// fields
 
 	Pipeline* pipeline{};
-	RenderPass renderpass;
-	Framebuffer framebuffer;
+	i32 depth_samples{};
+
+	// Async compute when the device has it. The LUT is shared with graphics, which samples it every frame.
+	vk::Queue queue;
+
+	ResourcePool resource_pool;
+	ResourceSet resource_set;
 
 	Image lut;
 	ImageView lut_view;